@@ -0,0 +1,370 @@
+#ifndef MEMFD_H
+#define MEMFD_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "../common/EventTrace.h"
+
+// Bulk transfer over a UNIX socket without copying the payload through the
+// kernel: the client writes each message into a sealed memfd and passes its
+// descriptor with SCM_RIGHTS; the server maps it read-only. A pool of
+// MEMFD_POOL_SIZE memfds is reused round-robin, so a descriptor crosses the
+// socket (and is mapped) only the first time its slot is used on a
+// connection. After that a message is just its MemfdMessage header, and the
+// server answers each one with the slot number once it is done reading, so
+// the client never overwrites a slot the server is still looking at.
+
+// Linux-specific; only declared by glibc under _GNU_SOURCE.
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+#define MEMFD_POOL_SIZE 8
+
+// The transport field of the client's and server's events (--events).
+typedef enum {
+    SOCKET_EVENT_INET,
+    SOCKET_EVENT_UNIX,
+    SOCKET_EVENT_MEMFD,
+    SOCKET_EVENT_TRANSPORTS,
+} SocketEventTransport;
+
+static const char *SOCKET_EVENT_NAMES[SOCKET_EVENT_TRANSPORTS] = { "INET", "UNIX", "MEMFD" };
+
+typedef struct {
+    uint32_t slot;
+    uint32_t length;
+} MemfdMessage;
+
+typedef struct {
+    int fd;
+    uint8_t *data;
+    bool shared;    // the server has this slot's descriptor on this connection
+} MemfdSlot;
+
+typedef struct {
+    MemfdSlot slots[MEMFD_POOL_SIZE];
+    size_t capacity;
+    uint32_t next;
+    uint32_t in_flight;
+} MemfdPool;
+
+static int memfd_new(size_t size) {
+    int fd = (int)syscall(SYS_memfd_create, "lab_sockets", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1 || ftruncate(fd, (off_t)size) != 0) {
+        perror("memfd_create");
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// Fixes the size, so the server's mapping can never run past the end of
+// the file, and forbids any new writable mapping or write(); the mapping
+// the client already holds stays writable, which is what lets a slot be
+// refilled. Kernels before 5.1 lack F_SEAL_FUTURE_WRITE and only get the
+// size seals.
+static bool memfd_seal(int fd) {
+    const int size_seals = F_SEAL_SHRINK | F_SEAL_GROW;
+    if (fcntl(fd, F_ADD_SEALS, size_seals | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) == 0 ||
+        (errno == EINVAL && fcntl(fd, F_ADD_SEALS, size_seals | F_SEAL_SEAL) == 0)) {
+        return true;
+    }
+    perror("fcntl(F_ADD_SEALS)");
+    return false;
+}
+
+void MemfdPool_init(MemfdPool *pool) {
+    memset(pool, 0, sizeof(*pool));
+    for (int k = 0; k < MEMFD_POOL_SIZE; k++) {
+        pool->slots[k].fd = -1;
+    }
+}
+
+void MemfdPool_free(MemfdPool *pool) {
+    for (int k = 0; k < MEMFD_POOL_SIZE; k++) {
+        if (pool->slots[k].fd != -1) {
+            munmap(pool->slots[k].data, pool->capacity);
+            close(pool->slots[k].fd);
+        }
+    }
+    MemfdPool_init(pool);
+}
+
+// Makes every slot hold at least `capacity` bytes, recreating the pool only
+// if it is too small; false (with a message) if a memfd cannot be set up.
+bool MemfdPool_reserve(MemfdPool *pool, size_t capacity) {
+    if (pool->capacity >= capacity && pool->slots[0].fd != -1) {
+        return true;
+    }
+    MemfdPool_free(pool);
+    pool->capacity = capacity;
+    for (int k = 0; k < MEMFD_POOL_SIZE; k++) {
+        MemfdSlot *slot = &pool->slots[k];
+        if ((slot->fd = memfd_new(capacity)) == -1) {
+            MemfdPool_free(pool);
+            return false;
+        }
+        slot->data = (uint8_t *)mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, slot->fd, 0);
+        if (slot->data == MAP_FAILED) {
+            perror("mmap");
+            close(slot->fd);
+            slot->fd = -1;
+            MemfdPool_free(pool);
+            return false;
+        }
+        if (!memfd_seal(slot->fd)) {
+            MemfdPool_free(pool);
+            return false;
+        }
+    }
+    return true;
+}
+
+// A new connection starts without any of the pool's descriptors.
+void MemfdPool_connect(MemfdPool *pool) {
+    for (int k = 0; k < MEMFD_POOL_SIZE; k++) {
+        pool->slots[k].shared = false;
+    }
+    pool->next = 0;
+    pool->in_flight = 0;
+}
+
+static bool memfd_read_all(int socket_fd, void *bytes, size_t len) {
+    uint8_t *out = (uint8_t *)bytes;
+    while (len > 0) {
+        ssize_t got = read(socket_fd, out, len);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        out += got;
+        len -= got;
+    }
+    return true;
+}
+
+// Waits for the server to hand back the oldest slot in flight.
+static bool memfd_wait_ack(MemfdPool *pool, int socket_fd) {
+    uint32_t slot, oldest = (pool->next + MEMFD_POOL_SIZE - pool->in_flight) % MEMFD_POOL_SIZE;
+    if (!memfd_read_all(socket_fd, &slot, sizeof(slot)) || slot != oldest) {
+        return false;
+    }
+    pool->in_flight--;
+    return true;
+}
+
+// Sends one message of `len` bytes (at most the pool's capacity).
+bool MemfdPool_send(MemfdPool *pool, int socket_fd, const char *data, uint32_t len) {
+    if (len > pool->capacity) {
+        return false;
+    }
+    EventTrace_record(EVENT_SEND_START, SOCKET_EVENT_MEMFD);
+    if (pool->in_flight == MEMFD_POOL_SIZE && !memfd_wait_ack(pool, socket_fd)) {
+        return false;
+    }
+    EventTrace_record(EVENT_SLOT_ACQUIRED, SOCKET_EVENT_MEMFD);
+
+    MemfdSlot *slot = &pool->slots[pool->next];
+    memcpy(slot->data, data, len);
+    EventTrace_record(EVENT_COPY_DONE, SOCKET_EVENT_MEMFD);
+
+    MemfdMessage message = { pool->next, len };
+    struct iovec iov = { &message, sizeof(message) };
+    union {
+        struct cmsghdr header;
+        char bytes[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (!slot->shared) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.bytes;
+        msg.msg_controllen = sizeof(control.bytes);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &slot->fd, sizeof(int));
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != (ssize_t)sizeof(message)) {
+        return false;
+    }
+    EventTrace_record(EVENT_PUBLISHED, SOCKET_EVENT_MEMFD);
+    slot->shared = true;
+    pool->next = (pool->next + 1) % MEMFD_POOL_SIZE;
+    pool->in_flight++;
+    return true;
+}
+
+// Waits until the server has finished with every message sent.
+bool MemfdPool_drain(MemfdPool *pool, int socket_fd) {
+    while (pool->in_flight > 0) {
+        if (!memfd_wait_ack(pool, socket_fd)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The server's side of a connection: the read-only mapping of each slot
+// the client has passed so far, and what MemfdReceiver_probe read ahead.
+typedef struct {
+    const uint8_t *data[MEMFD_POOL_SIZE];
+    size_t size[MEMFD_POOL_SIZE];
+    size_t pending;     // bytes of the first header already read
+    int pending_fd;
+} MemfdReceiver;
+
+void MemfdReceiver_init(MemfdReceiver *receiver) {
+    memset(receiver, 0, sizeof(*receiver));
+    receiver->pending_fd = -1;
+}
+
+void MemfdReceiver_release(MemfdReceiver *receiver) {
+    for (int k = 0; k < MEMFD_POOL_SIZE; k++) {
+        if (receiver->data[k] != NULL) {
+            munmap((void *)receiver->data[k], receiver->size[k]);
+        }
+    }
+    if (receiver->pending_fd != -1) {
+        close(receiver->pending_fd);
+    }
+    MemfdReceiver_init(receiver);
+}
+
+// One recvmsg of up to `len` bytes; a descriptor passed along is stored in
+// *fd (closing any earlier one, so a misbehaving client cannot leak them).
+static ssize_t memfd_recv(int socket_fd, void *bytes, size_t len, int *fd) {
+    struct iovec iov = { bytes, len };
+    union {
+        struct cmsghdr header;
+        char bytes[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    ssize_t got;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.bytes;
+    msg.msg_controllen = sizeof(control.bytes);
+    do {
+        got = recvmsg(socket_fd, &msg, 0);
+    } while (got < 0 && errno == EINTR);
+
+    if (got >= 0) {
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                if (*fd != -1) {
+                    close(*fd);
+                }
+                memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+    }
+    return got;
+}
+
+// Reads the start of a new connection into `message` and tells the two
+// kinds of client apart: true if a descriptor came with it (a memfd
+// client; continue with MemfdReceiver_receive), false for a plain byte
+// stream, whose first *got bytes are now in `message`.
+bool MemfdReceiver_probe(MemfdReceiver *receiver, int socket_fd, MemfdMessage *message, ssize_t *got) {
+    *got = memfd_recv(socket_fd, message, sizeof(*message), &receiver->pending_fd);
+    receiver->pending = *got > 0 ? (size_t)*got : 0;
+    return receiver->pending_fd != -1;
+}
+
+// Maps a passed descriptor for `slot` and closes it. Refuses memfds whose
+// size is not sealed: the client could shrink them under the mapping.
+static bool memfd_map(MemfdReceiver *receiver, uint32_t slot, int fd) {
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    bool ok = seals != -1 && (seals & F_SEAL_SHRINK) && fstat(fd, &st) == 0 && st.st_size > 0;
+
+    if (ok) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if ((ok = data != MAP_FAILED)) {
+            if (receiver->data[slot] != NULL) {
+                munmap((void *)receiver->data[slot], receiver->size[slot]);
+            }
+            receiver->data[slot] = (const uint8_t *)data;
+            receiver->size[slot] = st.st_size;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+// Receives the next message header, mapping its memfd if one came with it.
+// Returns the message's payload, or NULL at the end of the connection or on
+// a malformed message.
+const uint8_t *MemfdReceiver_receive(MemfdReceiver *receiver, int socket_fd, MemfdMessage *message) {
+    size_t have = receiver->pending;
+    int fd = receiver->pending_fd;
+
+    receiver->pending = 0;
+    receiver->pending_fd = -1;
+    while (have < sizeof(*message)) {
+        ssize_t got = memfd_recv(socket_fd, (uint8_t *)message + have, sizeof(*message) - have, &fd);
+        if (got <= 0) {
+            break;
+        }
+        have += got;
+    }
+
+    if (have < sizeof(*message) || message->slot >= MEMFD_POOL_SIZE) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return NULL;
+    }
+    if (fd != -1 && !memfd_map(receiver, message->slot, fd)) {
+        fprintf(stderr, "Rejected the memfd for slot %u\n", message->slot);
+        return NULL;
+    }
+    if (receiver->data[message->slot] == NULL || message->length > receiver->size[message->slot]) {
+        return NULL;
+    }
+    return receiver->data[message->slot];
+}
+
+// Hands `slot` back to the client.
+bool MemfdReceiver_done(int socket_fd, uint32_t slot) {
+    return send(socket_fd, &slot, sizeof(slot), MSG_NOSIGNAL) == (ssize_t)sizeof(slot);
+}
+
+#endif
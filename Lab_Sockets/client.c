@@ -11,10 +11,24 @@
 #include <unistd.h>
 #include <time.h>
 #include <string.h> 
+#include "../common/Grid.h"
+#include "../common/PerfCounters.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Results.h"
+#include "../common/Samples.h"
+#include "../common/Trace.h"
+#include "Memfd.h"
 
 const char *SOCKET_FILE = "socket";
 const int SOCKET_PORT = 1234;
-const int PACKET_SIZE = 128;
+// Size of each sent package; set per grid point in main().
+int packet_size = 128;
+// MEMFD sockets pass every package as a memfd from this pool, which lives
+// across connections so only the first experiment pays for setting it up.
+MemfdPool memfd_pool;
+bool use_memfd = false;
+// What the events of send_data are recorded under.
+SocketEventTransport event_transport = SOCKET_EVENT_INET;
 
 #define DEBUG false
 
@@ -82,6 +96,9 @@ int open_unix() {
 int open_socket(const char *type_of_socket) {
     if (strcmp(type_of_socket, "UNIX") == 0) {
         return open_unix();
+    } else if (strcmp(type_of_socket, "MEMFD") == 0) {
+        MemfdPool_connect(&memfd_pool);
+        return open_unix();
     } else if (strcmp(type_of_socket, "INET") == 0) {
         return open_inet();
     }
@@ -89,7 +106,12 @@ int open_socket(const char *type_of_socket) {
 }
 
 bool send_data(int socket_file_descriptor, const char *data, const int data_len) {
+    if (use_memfd) {
+        return MemfdPool_send(&memfd_pool, socket_file_descriptor, data, data_len);
+    }
+    EventTrace_record(EVENT_SEND_START, event_transport);
     int sent_data = write(socket_file_descriptor, data, data_len);
+    EventTrace_record(EVENT_PUBLISHED, event_transport);
     if (sent_data != data_len) {
         return false;
     }
@@ -104,7 +126,7 @@ char *generate_data(const int len) {
     return data;
 }
 
-double *MeasureSocketOpeningTime(char *type_of_socket) {
+double *MeasureSocketOpeningTime(const char *type_of_socket) {
     int socket_file_descriptor = 0;
     if (DEBUG)
         printf("Opening socket ...\n");
@@ -123,33 +145,94 @@ double *MeasureSocketOpeningTime(char *type_of_socket) {
 double *MeasureSendingDataTime(int socket_file_descriptor, int number_of_packages) {
     if (DEBUG)
         printf("Generating data to send ...\n");
-    char *data = generate_data(PACKET_SIZE);
+    char *data = generate_data(packet_size);
 
     if (DEBUG)
         printf("Sending the data from client ...\n");
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    ResourceUsage start, end, usage;
+    ResourceUsage_thread(&start);
+    PerfCounters_start(&counters);
+
     uint64_t startTime, finishTime;
     startTime = getCurTime();
 
     double *result = (double *)malloc(2 * sizeof(double));
     result[1] = 0;
     for(int i = 0; i < number_of_packages; i++) {
-        if (send_data(socket_file_descriptor, data, PACKET_SIZE)) {
+        if (send_data(socket_file_descriptor, data, packet_size)) {
             //if (DEBUG)
-            printf("Successfully sent %d of data\n", PACKET_SIZE);
-            result[1] += PACKET_SIZE;
+            printf("Successfully sent %d of data\n", packet_size);
+            result[1] += packet_size;
         } else {
             printf("Error during sending the data\n");
         }
     }
 
     finishTime = getCurTime();
+    PerfCounters_stop(&counters);
+    ResourceUsage_thread(&end);
+    ResourceUsage_sub(&usage, &end, &start);
     //printf("%s %.06f\n", "Sending Data Time: ", (finishTime - startTime) / 1000000.0);
     result[0] = (finishTime - startTime) / 1000000.0;
+
+    PerfCounters_print(&counters, "sending data", number_of_packages, "message");
+    PerfCounters_close(&counters);
+    // The server prints the receiving side's usage for each connection.
+    ResourceUsage_print("sending data", &usage, NULL, (uint64_t)result[1]);
+    return result;
+}
+
+// Sends the requests of a recorded trace at their recorded times divided by
+// `speed` (0: back to back). Latency runs from each record's due time to the
+// end of its write, so falling behind the trace counts against it.
+double *MeasureReplayTime(int socket_file_descriptor, const Trace *trace, double speed) {
+    uint32_t max_size = 1;
+    for (size_t k = 0; k < trace->count; k++) {
+        max_size = trace->records[k].size > max_size ? trace->records[k].size : max_size;
+    }
+    char *data = generate_data(max_size);
+    Samples latencies;
+    Samples_init(&latencies, trace->count);
+
+    double *result = (double *)malloc(2 * sizeof(double));
+    result[1] = 0;
+
+    uint64_t startTime, finishTime;
+    startTime = getCurTime();
+    uint64_t start_ns = trace_now();
+
+    for (size_t k = 0; k < trace->count; k++) {
+        const TraceRecord *record = &trace->records[k];
+        if (record->direction != TRACE_REQUEST || record->size == 0) {
+            continue;
+        }
+
+        uint64_t due = Trace_due(record, start_ns, speed);
+        Trace_sleep_until(due);
+
+        if (send_data(socket_file_descriptor, data, record->size)) {
+            result[1] += record->size;
+        } else {
+            printf("Error during sending the data\n");
+        }
+        Samples_add(&latencies, trace_now() - due);
+    }
+
+    finishTime = getCurTime();
+    result[0] = (finishTime - startTime) / 1000000.0;
+
+    printf("Replayed %zu requests at %.2fx speed, latency mean %.6f s, p50 %.6f s, p99 %.6f s\n",
+           latencies.count, speed, Samples_mean(&latencies) / 1000000000.0,
+           Samples_quantile(&latencies, 0.5) / 1000000000.0, Samples_quantile(&latencies, 0.99) / 1000000000.0);
+
+    Samples_free(&latencies);
+    free(data);
     return result;
 }
 
 double MeasureSocketClosingTime(int socket_file_descriptor) {
-    char *data = generate_data(PACKET_SIZE);
     if (DEBUG)
         printf("Closing socket.\n");
     uint64_t startTime, finishTime;
@@ -188,27 +271,243 @@ void print_table_of_experiments(const char *type_of_socket, double *opening_time
     printf("+-------------+--------------+-------------------+--------------------------+---------------------------------+--------------+---------------+\n");
 }
 
+// Average sending speed of one grid point, kept for the crossover table.
+typedef struct {
+    char socket[8];
+    int packet_size;
+    double speed;
+} SpeedPoint;
+
+static int compare_ints(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// When UNIX and MEMFD ran at the same packet sizes, prints both speeds by
+// size and the smallest size from which passing a memfd stays faster than
+// write().
+void print_crossover(const SpeedPoint *points, int count) {
+    int *sizes = (int *)malloc(count * sizeof(int));
+    double *unix_speed = (double *)calloc(count, sizeof(double)), *memfd_speed = (double *)calloc(count, sizeof(double));
+    int number_of_sizes = 0;
+
+    for (int i = 0; i < count; i++) {
+        bool known = false;
+        for (int k = 0; k < number_of_sizes; k++) {
+            known |= sizes[k] == points[i].packet_size;
+        }
+        if (!known) {
+            sizes[number_of_sizes++] = points[i].packet_size;
+        }
+    }
+    qsort(sizes, number_of_sizes, sizeof(int), compare_ints);
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < number_of_sizes; k++) {
+            if (sizes[k] == points[i].packet_size && strcmp(points[i].socket, "UNIX") == 0) {
+                unix_speed[k] = points[i].speed;
+            } else if (sizes[k] == points[i].packet_size && strcmp(points[i].socket, "MEMFD") == 0) {
+                memfd_speed[k] = points[i].speed;
+            }
+        }
+    }
+
+    int compared = 0, crossover = -1;
+    for (int k = 0; k < number_of_sizes; k++) {
+        if (unix_speed[k] > 0 && memfd_speed[k] > 0) {
+            compared++;
+            if (memfd_speed[k] <= unix_speed[k]) {
+                crossover = -1;
+            } else if (crossover == -1) {
+                crossover = sizes[k];
+            }
+        }
+    }
+
+    if (compared > 0) {
+        printf("+-------------+--------------------------+--------------------------+---------+\n");
+        printf("| Packet size | write() speed (Byte/sec) | memfd speed (Byte/sec)   | Faster  |\n");
+        printf("+-------------+--------------------------+--------------------------+---------+\n");
+        for (int k = 0; k < number_of_sizes; k++) {
+            if (unix_speed[k] > 0 && memfd_speed[k] > 0) {
+                printf("| %11d | %24.6lf | %24.6lf | %-7s |\n", sizes[k], unix_speed[k], memfd_speed[k],
+                       memfd_speed[k] > unix_speed[k] ? "memfd" : "write()");
+            }
+        }
+        printf("+-------------+--------------------------+--------------------------+---------+\n");
+        if (crossover == -1) {
+            printf("write() is faster at the largest packet size measured\n");
+        } else {
+            printf("Passing a memfd beats write() from %d bytes\n", crossover);
+            double value = crossover;
+            Results_record_values("socket", "MEMFD", "crossover_size", "B", true, &value, 1);
+        }
+    }
+
+    free(sizes);
+    free(unix_speed);
+    free(memfd_speed);
+}
+
+// Checks every grid point before the first experiment starts.
+bool check_grid(Grid *grid) {
+    bool ok = true;
+    while (Grid_next(grid)) {
+        long packet_size, packages, experiments;
+        const char *socket = Grid_get(grid, "socket");
+        if (!Grid_parse_long(Grid_get(grid, "packet_size"), &packet_size) || packet_size < 1 ||
+            !Grid_parse_long(Grid_get(grid, "packages"), &packages) || packages < 1 ||
+            !Grid_parse_long(Grid_get(grid, "experiments"), &experiments) || experiments < 1) {
+            fprintf(stderr, "packet_size, packages and experiments must be positive numbers\n");
+            ok = false;
+        }
+        if (strcmp(socket, "INET") != 0 && strcmp(socket, "UNIX") != 0 && strcmp(socket, "MEMFD") != 0) {
+            fprintf(stderr, "Unknown socket type '%s' (INET, UNIX, MEMFD)\n", socket);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
 int main(int argc, char *argv[]) {
-    int number_of_experiments = 10,
-            number_of_packages = 64000;
-
-    char type_of_socket[] = "INET";
-    double *opening_time = (double *)malloc(number_of_experiments * sizeof(double)),
-            *sending_data_time = (double *)malloc(number_of_experiments * sizeof(double)),
-            *closing_time = (double *)malloc(number_of_experiments * sizeof(double));
-    int   *data_quantity = (int *)malloc(number_of_experiments * sizeof(int));
-
-    for(int i = 0; i < number_of_experiments; ++i) {
-        int socket_file_descriptor = 0;
-        double *result = MeasureSocketOpeningTime(type_of_socket);
-        socket_file_descriptor = (int)result[0];
-        opening_time[i] = result[1];
-        result = MeasureSendingDataTime(socket_file_descriptor, number_of_packages);
-        sending_data_time[i] = result[0];
-        data_quantity[i] = (int)result[1];
-        closing_time[i] = MeasureSocketClosingTime(socket_file_descriptor);
-    }
-
-    print_table_of_experiments(type_of_socket, opening_time, sending_data_time, closing_time, data_quantity, number_of_experiments, number_of_packages);
+    // client [--set name=v1,v2,...]... [--config <file>] ...: runs every
+    // combination of packet_size, packages, experiments and socket (INET,
+    // UNIX, MEMFD; the server must listen on the same type, UNIX for
+    // MEMFD) in one invocation, printing each table as it finishes. A
+    // config file holds the same assignments, one "name = values" per line.
+    // Sweeping socket=UNIX,MEMFD over several packet sizes also prints
+    // where passing memfds overtakes write().
+    // client --events <prefix> ...: records every send as events in
+    // <prefix>.<pid>.evt (see ../common/EventTrace.h).
+    // client --merge-events <trace.json> <file.evt>...: merges the client's
+    // and server's event files into one Chrome/Perfetto trace.
+    Grid grid;
+    Grid_init(&grid);
+    Grid_define(&grid, "packet_size", "128");
+    Grid_define(&grid, "packages", "64000");
+    Grid_define(&grid, "experiments", "10");
+    Grid_define(&grid, "socket", "INET");
+
+    // client --compare <baseline> <candidate>: compares two result files.
+    // client --results <file.jsonl|file.csv> ...: also writes every
+    // experiment to a result file.
+    if (argc >= 4 && strcmp(argv[1], "--compare") == 0) {
+        return Results_compare(argv[2], argv[3]) != 0;
+    }
+    if (argc >= 4 && strcmp(argv[1], "--merge-events") == 0) {
+        return !EventTrace_merge(argv[2], argv + 3, argc - 3);
+    }
+    if (!Grid_parse_args(&grid, &argc, argv) || !check_grid(&grid)) {
+        return EXIT_FAILURE;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--events") == 0) {
+        if (!EventTrace_open(argv[2], "client", SOCKET_EVENT_NAMES, SOCKET_EVENT_TRANSPORTS)) {
+            return EXIT_FAILURE;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--results") == 0) {
+        static char config[192];
+        snprintf(config, sizeof(config), "{\"packet_size\":%s,\"number_of_packages\":%s,\"number_of_experiments\":%s}",
+                 grid.params[0].values[0], grid.params[1].values[0], grid.params[2].values[0]);
+        if (!Results_open(argv[2], "sockets", config)) {
+            return EXIT_FAILURE;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    // client --replay <trace> [speed]: one connection driven by a recorded
+    // trace instead of the fixed packet loop.
+    Trace trace = { NULL, 0 };
+    if (argc >= 3 && strcmp(argv[1], "--replay") == 0 && !Trace_load(&trace, argv[2])) {
+        return EXIT_FAILURE;
+    }
+    double speed = argc >= 4 ? atof(argv[3]) : 1.0;
+
+    SpeedPoint *speed_points = NULL;
+    int number_of_speed_points = 0;
+    MemfdPool_init(&memfd_pool);
+
+    while (Grid_next(&grid)) {
+        int number_of_experiments = (int)Grid_get_long(&grid, "experiments"),
+                number_of_packages = (int)Grid_get_long(&grid, "packages");
+        const char *type_of_socket = Grid_get(&grid, "socket");
+        packet_size = (int)Grid_get_long(&grid, "packet_size");
+
+        if (Grid_customized(&grid)) {
+            char point[GRID_MAX_VALUES * GRID_VALUE_SIZE];
+            Grid_describe(&grid, "socket", point, sizeof(point));
+            Results_set_point(point);
+            printf("Grid point: %s;socket=%s\n", point, type_of_socket);
+        }
+        if (trace.records) {
+            number_of_experiments = 1;
+            number_of_packages = 0;
+            for (size_t k = 0; k < trace.count; k++) {
+                number_of_packages += trace.records[k].direction == TRACE_REQUEST;
+            }
+        }
+
+        use_memfd = strcmp(type_of_socket, "MEMFD") == 0;
+        event_transport = use_memfd ? SOCKET_EVENT_MEMFD
+                                    : strcmp(type_of_socket, "UNIX") == 0 ? SOCKET_EVENT_UNIX : SOCKET_EVENT_INET;
+        if (use_memfd) {
+            size_t capacity = packet_size;
+            for (size_t k = 0; trace.records && k < trace.count; k++) {
+                capacity = trace.records[k].size > capacity ? trace.records[k].size : capacity;
+            }
+            if (!MemfdPool_reserve(&memfd_pool, capacity)) {
+                return EXIT_FAILURE;
+            }
+        }
+
+        double *opening_time = (double *)malloc(number_of_experiments * sizeof(double)),
+                *sending_data_time = (double *)malloc(number_of_experiments * sizeof(double)),
+                *closing_time = (double *)malloc(number_of_experiments * sizeof(double));
+        int   *data_quantity = (int *)malloc(number_of_experiments * sizeof(int));
+
+        for(int i = 0; i < number_of_experiments; ++i) {
+            int socket_file_descriptor = 0;
+            double *result = MeasureSocketOpeningTime(type_of_socket);
+            socket_file_descriptor = (int)result[0];
+            opening_time[i] = result[1];
+            result = trace.records ? MeasureReplayTime(socket_file_descriptor, &trace, speed)
+                                   : MeasureSendingDataTime(socket_file_descriptor, number_of_packages);
+            sending_data_time[i] = result[0];
+            data_quantity[i] = (int)result[1];
+            if (use_memfd && !MemfdPool_drain(&memfd_pool, socket_file_descriptor)) {
+                printf("Error waiting for the server to release the memfds\n");
+            }
+            closing_time[i] = MeasureSocketClosingTime(socket_file_descriptor);
+        }
+
+        print_table_of_experiments(type_of_socket, opening_time, sending_data_time, closing_time, data_quantity, number_of_experiments, number_of_packages);
+
+        const char *benchmark = trace.records ? "replay" : "socket";
+        double *sending_speed = (double *)malloc(number_of_experiments * sizeof(double));
+        double average_speed = 0;
+        for (int i = 0; i < number_of_experiments; ++i) {
+            sending_speed[i] = data_quantity[i] / sending_data_time[i];
+            average_speed += sending_speed[i] / number_of_experiments;
+        }
+        speed_points = (SpeedPoint *)realloc(speed_points, (number_of_speed_points + 1) * sizeof(SpeedPoint));
+        snprintf(speed_points[number_of_speed_points].socket, sizeof(speed_points->socket), "%s", type_of_socket);
+        speed_points[number_of_speed_points].packet_size = packet_size;
+        speed_points[number_of_speed_points++].speed = average_speed;
+        Results_record_values(benchmark, type_of_socket, "opening_time", "s", true, opening_time, number_of_experiments);
+        Results_record_values(benchmark, type_of_socket, "sending_data_time", "s", true, sending_data_time, number_of_experiments);
+        Results_record_values(benchmark, type_of_socket, "sending_speed", "B/s", false, sending_speed, number_of_experiments);
+        Results_record_values(benchmark, type_of_socket, "closing_time", "s", true, closing_time, number_of_experiments);
+
+        free(opening_time);
+        free(sending_data_time);
+        free(closing_time);
+        free(data_quantity);
+        free(sending_speed);
+    }
+    print_crossover(speed_points, number_of_speed_points);
+    free(speed_points);
+    MemfdPool_free(&memfd_pool);
+    Results_close();
     return 0;
-}
\ No newline at end of file
+}
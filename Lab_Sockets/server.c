@@ -10,6 +10,9 @@
 #include <fcntl.h>
 #include <sys/un.h>
 #include <stdbool.h>
+#include "../common/ResourceUsage.h"
+#include "../common/Trace.h"
+#include "Memfd.h"
 
 #define PACKET_SIZE 1024
 const int SOCKET_PORT = 1234;
@@ -90,7 +93,7 @@ int open_inet(bool is_blocking, struct sockaddr_in *serv_addr) {
     return socket_file_descriptor;
 }
 
-int open_socket(const char *type_of_socket, bool is_blocking, struct sockaddr *serv_addr) {
+int open_socket(const char *type_of_socket, bool is_blocking) {
     if (strcmp(type_of_socket, "UNIX") == 0)
         return open_unix(is_blocking, &serv_un_addr);
     else if (strcmp(type_of_socket, "INET") == 0)
@@ -99,17 +102,65 @@ int open_socket(const char *type_of_socket, bool is_blocking, struct sockaddr *s
     return -1;
 }
 
+// Serves a MEMFD client: sums every payload in its read-only mapping, as
+// a consumer would read it, and hands the slot back. Returns the bytes
+// received.
+uint64_t receive_memfd(MemfdReceiver *receiver, int socket_fd, MemfdMessage *message, TraceRecorder *recorder) {
+    uint64_t total = 0, checksum = 0;
+    const uint8_t *payload;
+
+    EventTrace_record(EVENT_RECEIVE_START, SOCKET_EVENT_MEMFD);
+    while ((payload = MemfdReceiver_receive(receiver, socket_fd, message)) != NULL) {
+        EventTrace_record(EVENT_WOKEN, SOCKET_EVENT_MEMFD);
+        for (uint32_t k = 0; k < message->length; k++) {
+            checksum += payload[k];
+        }
+        EventTrace_record(EVENT_RECEIVED, SOCKET_EVENT_MEMFD);
+        total += message->length;
+        if (recorder) {
+            TraceRecorder_record(recorder, TRACE_REQUEST, message->length);
+        }
+        printf("Received memfd slot %u with packet size = %u\n", message->slot, message->length);
+        if (!MemfdReceiver_done(socket_fd, message->slot)) {
+            break;
+        }
+        EventTrace_record(EVENT_RELEASED, SOCKET_EVENT_MEMFD);
+        EventTrace_record(EVENT_RECEIVE_START, SOCKET_EVENT_MEMFD);
+    }
+    printf("Received empty packet (memfd checksum %lu)\n", checksum);
+    MemfdReceiver_release(receiver);
+    return total;
+}
+
 int main(int argc, char *argv[]) {
-    char type_of_socket[] = "INET";
+    const char *type_of_socket = "INET";
     bool is_blocking = false;
 
+    // server [--socket INET|UNIX] [--record <trace>] [--events <prefix>]:
+    // --socket matches the client's socket type (a UNIX server also serves
+    // MEMFD clients); --record logs every received chunk for later replay;
+    // --events records every receive in <prefix>.<pid>.evt, rewritten after
+    // each connection since the server only stops when killed.
+    TraceRecorder recorder;
+    bool recording = false;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--socket") == 0) {
+            type_of_socket = argv[i + 1];
+        } else if (strcmp(argv[i], "--record") == 0) {
+            recording = TraceRecorder_open(&recorder, argv[i + 1]);
+        } else if (strcmp(argv[i], "--events") == 0 &&
+                   !EventTrace_open(argv[i + 1], "server", SOCKET_EVENT_NAMES, SOCKET_EVENT_TRANSPORTS)) {
+            exit(-1);
+        }
+    }
+
     char data_buffer[PACKET_SIZE];
 
     struct sockaddr *serv_addr = NULL;
     //struct sockaddr *serv_addr = (struct sockaddr *) &serv_un_addr; // Или serv_in_addr для INET
 
     printf("Opening socket ...\n");
-    int socket_file_descriptor = open_socket(type_of_socket, is_blocking, serv_addr);
+    int socket_file_descriptor = open_socket(type_of_socket, is_blocking);
     while (true) {
         const int new_socket = accept(socket_file_descriptor, serv_addr, (socklen_t *) sizeof(*serv_addr));
         if (new_socket == -1) {
@@ -124,17 +175,52 @@ int main(int argc, char *argv[]) {
         }
         printf("New connection!\n");
         uint64_t total = 0;
-        while (true) {
+        ResourceUsage start, end, usage;
+        ResourceUsage_thread(&start);
+        // A MEMFD client passes a descriptor with its first message; for
+        // anyone else the probe's bytes are the start of the stream.
+        MemfdReceiver receiver;
+        MemfdMessage message;
+        ssize_t probed = 0;
+        bool memfd = false;
+        MemfdReceiver_init(&receiver);
+        if (strcmp(type_of_socket, "UNIX") == 0) {
+            memfd = MemfdReceiver_probe(&receiver, new_socket, &message, &probed);
+            if (!memfd && probed > 0) {
+                total += probed;
+                if (recording) {
+                    TraceRecorder_record(&recorder, TRACE_REQUEST, probed);
+                }
+                printf("Received data_buffer with packet size = %zd\n", probed);
+            }
+        }
+        if (memfd) {
+            total = receive_memfd(&receiver, new_socket, &message, recording ? &recorder : NULL);
+        }
+        SocketEventTransport event_transport = strcmp(type_of_socket, "UNIX") == 0 ? SOCKET_EVENT_UNIX : SOCKET_EVENT_INET;
+        while (!memfd && probed >= 0) {
+            EventTrace_record(EVENT_RECEIVE_START, event_transport);
             const int received_data_len = read(new_socket, data_buffer, sizeof(data_buffer));
+            EventTrace_record(EVENT_RECEIVED, event_transport);
             total += received_data_len;
-            if (received_data_len == 0) {
+            if (recording && received_data_len > 0) {
+                TraceRecorder_record(&recorder, TRACE_REQUEST, received_data_len);
+            }
+            if (received_data_len <= 0) {
                 printf("Received empty packet\n");
                 break;
             } else {
                 printf("Received data_buffer with packet size = %d\n", received_data_len);
             }
         }
+        ResourceUsage_thread(&end);
+        ResourceUsage_sub(&usage, &end, &start);
         printf("Total received bytes from socket = %lu\n", total);
+        ResourceUsage_print("receiving data", &usage, NULL, total);
+        if (recording) {
+            fflush(recorder.file);
+        }
+        EventTrace_save();
         close(new_socket);
     }
     return 0;
@@ -0,0 +1,327 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Per-message IPC events for finding out what both sides were doing when an
+// outlier happened. Every thread appends 16-byte events to its own ring
+// (no atomics, no locks on the hot path; the oldest events are overwritten
+// once EVENT_TRACE_CAPACITY is reached) and at exit each process writes its
+// rings to <prefix>.<pid>.evt. A forked child starts with empty rings and
+// writes its own file. EventTrace_merge turns any number of those files into
+// one Chrome trace (chrome://tracing, ui.perfetto.dev) with a track per
+// process and a row per thread.
+//
+// File format: the 8-byte magic EVENT_TRACE_MAGIC, the pid (u32), the role
+// (32 bytes), the number of transport names (u32) and the names (16 bytes
+// each), then for every ring the thread id (u32), its event count (u32)
+// and the events, oldest first.
+
+#define EVENT_TRACE_MAGIC "IPCEVT01"
+#define EVENT_TRACE_MAX_TRANSPORTS 32
+
+#ifndef EVENT_TRACE_CAPACITY
+#define EVENT_TRACE_CAPACITY (1u << 20)   // events per thread, a power of two
+#endif
+
+typedef enum {
+    EVENT_SEND_START,
+    EVENT_SLOT_ACQUIRED,   // the sender may write: a free slot or the peer's turn
+    EVENT_COPY_DONE,
+    EVENT_PUBLISHED,       // the message is visible to the peer
+    EVENT_RECEIVE_START,
+    EVENT_WOKEN,           // the receiver saw a message
+    EVENT_RECEIVED,        // the message is in the receiver's buffer
+    EVENT_RELEASED,        // the receiver handed the slot back
+    EVENT_KINDS,
+} EventKind;
+
+static const char *EVENT_KIND_NAMES[EVENT_KINDS] = {
+    "send start", "slot acquired", "copy done", "published", "receive start", "woken", "received", "released",
+};
+
+typedef struct {
+    uint64_t timestamp_ns;   // CLOCK_MONOTONIC, comparable across processes
+    uint32_t tid;
+    uint8_t kind;
+    uint8_t transport;
+    uint16_t reserved;
+} Event;
+
+typedef struct EventRing {
+    Event *events;
+    uint64_t count;
+    uint32_t tid;
+    struct EventRing *next;
+} EventRing;
+
+typedef struct {
+    bool enabled;
+    char prefix[256];
+    char role[32];
+    uint32_t pid;
+    char transports[EVENT_TRACE_MAX_TRANSPORTS][16];
+    uint32_t transport_count;
+    pthread_mutex_t lock;   // guards `rings`, not the rings themselves
+    EventRing *rings;
+} EventTracer;
+
+static EventTracer event_tracer = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static _Thread_local EventRing *event_ring;
+
+static inline uint64_t event_now() {
+    struct timespec tms;
+    clock_gettime(CLOCK_MONOTONIC, &tms);
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
+}
+
+static inline bool EventTrace_enabled() {
+    return event_tracer.enabled;
+}
+
+static EventRing *event_ring_new() {
+    EventRing *ring = (EventRing *)calloc(1, sizeof(EventRing));
+    // Untouched pages of the buffer cost nothing until events reach them.
+    ring->events = (Event *)malloc(EVENT_TRACE_CAPACITY * sizeof(Event));
+    ring->tid = (uint32_t)syscall(SYS_gettid);
+
+    pthread_mutex_lock(&event_tracer.lock);
+    ring->next = event_tracer.rings;
+    event_tracer.rings = ring;
+    pthread_mutex_unlock(&event_tracer.lock);
+    return ring;
+}
+
+// Records `kind` for `transport` at `now` (from event_now() or the same
+// clock); a no-op unless EventTrace_open succeeded.
+static inline void EventTrace_record_at(EventKind kind, int transport, uint64_t now) {
+    if (!event_tracer.enabled) {
+        return;
+    }
+    EventRing *ring = event_ring;
+    if (ring == NULL) {
+        ring = event_ring = event_ring_new();
+    }
+
+    Event *event = &ring->events[ring->count++ & (EVENT_TRACE_CAPACITY - 1)];
+    event->timestamp_ns = now;
+    event->tid = ring->tid;
+    event->kind = (uint8_t)kind;
+    event->transport = (uint8_t)transport;
+}
+
+static inline void EventTrace_record(EventKind kind, int transport) {
+    if (event_tracer.enabled) {
+        EventTrace_record_at(kind, transport, event_now());
+    }
+}
+
+// Writes this process's rings to <prefix>.<pid>.evt; runs at exit.
+void EventTrace_save() {
+    if (!event_tracer.enabled) {
+        return;
+    }
+    char path[300];
+    snprintf(path, sizeof(path), "%s.%u.evt", event_tracer.prefix, event_tracer.pid);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return;
+    }
+
+    fwrite(EVENT_TRACE_MAGIC, 1, 8, file);
+    fwrite(&event_tracer.pid, sizeof(uint32_t), 1, file);
+    fwrite(event_tracer.role, 1, sizeof(event_tracer.role), file);
+    fwrite(&event_tracer.transport_count, sizeof(uint32_t), 1, file);
+    fwrite(event_tracer.transports, sizeof(event_tracer.transports[0]), event_tracer.transport_count, file);
+
+    pthread_mutex_lock(&event_tracer.lock);
+    for (EventRing *ring = event_tracer.rings; ring != NULL; ring = ring->next) {
+        uint64_t kept = ring->count < EVENT_TRACE_CAPACITY ? ring->count : EVENT_TRACE_CAPACITY;
+        uint64_t oldest = ring->count - kept;
+        uint32_t count = (uint32_t)kept;
+
+        fwrite(&ring->tid, sizeof(uint32_t), 1, file);
+        fwrite(&count, sizeof(uint32_t), 1, file);
+        for (uint64_t k = oldest; k < ring->count; k++) {
+            fwrite(&ring->events[k & (EVENT_TRACE_CAPACITY - 1)], sizeof(Event), 1, file);
+        }
+    }
+    pthread_mutex_unlock(&event_tracer.lock);
+    fclose(file);
+}
+
+// After fork: the parent's events stay with the parent; the child's thread
+// is the only one left and gets a fresh ring.
+static void event_trace_forked() {
+    for (EventRing *ring = event_tracer.rings; ring != NULL; ring = ring->next) {
+        ring->count = 0;
+    }
+    event_tracer.pid = (uint32_t)getpid();
+    if (event_ring != NULL) {
+        event_ring->tid = (uint32_t)syscall(SYS_gettid);
+    }
+    size_t len = strlen(event_tracer.role);
+    if (len + 6 < sizeof(event_tracer.role) && strstr(event_tracer.role, " child") == NULL) {
+        strcpy(event_tracer.role + len, " child");
+    }
+}
+
+// Starts tracing this process (and any children it forks); `role` names
+// its track and `transports` the values of the events' transport field.
+bool EventTrace_open(const char *prefix, const char *role, const char *const *transports, int count) {
+    if (count > EVENT_TRACE_MAX_TRANSPORTS) {
+        fprintf(stderr, "EventTrace: at most %d transports\n", EVENT_TRACE_MAX_TRANSPORTS);
+        return false;
+    }
+    snprintf(event_tracer.prefix, sizeof(event_tracer.prefix), "%s", prefix);
+    snprintf(event_tracer.role, sizeof(event_tracer.role), "%s", role);
+    event_tracer.pid = (uint32_t)getpid();
+    event_tracer.transport_count = count;
+    for (int t = 0; t < count; t++) {
+        snprintf(event_tracer.transports[t], sizeof(event_tracer.transports[t]), "%s", transports[t]);
+    }
+
+    if (!event_tracer.enabled) {
+        pthread_atfork(NULL, NULL, event_trace_forked);
+        atexit(EventTrace_save);
+    }
+    event_tracer.enabled = true;
+    return true;
+}
+
+// The operation a thread is in the middle of, for the merged trace's slices.
+typedef struct {
+    bool open;
+    bool send;
+    uint8_t transport;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} EventSlice;
+
+static void event_slice_close(FILE *out, EventSlice *slice, const char (*transports)[16], uint32_t transport_count,
+                              uint32_t pid, uint32_t tid, uint64_t base_ns, bool *first) {
+    if (!slice->open) {
+        return;
+    }
+    fprintf(out, "%s\n{\"name\":\"%s %s\",\"cat\":\"ipc\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}",
+            *first ? "" : ",", slice->send ? "send" : "receive",
+            slice->transport < transport_count ? transports[slice->transport] : "?",
+            (double)(slice->start_ns - base_ns) / 1000.0, (double)(slice->end_ns - slice->start_ns) / 1000.0, pid, tid);
+    *first = false;
+    slice->open = false;
+}
+
+static bool event_read_header(FILE *in, const char *path, uint32_t *pid, char *role,
+                              char (*transports)[16], uint32_t *transport_count) {
+    char magic[8];
+    if (fread(magic, 1, 8, in) != 8 || memcmp(magic, EVENT_TRACE_MAGIC, 8) != 0 ||
+        fread(pid, sizeof(uint32_t), 1, in) != 1 || fread(role, 1, 32, in) != 32 ||
+        fread(transport_count, sizeof(uint32_t), 1, in) != 1 || *transport_count > EVENT_TRACE_MAX_TRANSPORTS ||
+        fread(transports, 16, *transport_count, in) != *transport_count) {
+        fprintf(stderr, "%s: not an event trace\n", path);
+        return false;
+    }
+    role[31] = '\0';
+    for (uint32_t t = 0; t < *transport_count; t++) {
+        transports[t][15] = '\0';
+    }
+    return true;
+}
+
+// Merges event files into Chrome trace JSON: every event as an instant on
+// its thread's row, plus a "send"/"receive" slice from the start of each
+// operation to its last event. Times are in microseconds from the earliest
+// event in any file.
+bool EventTrace_merge(const char *output, char *const *paths, int count) {
+    uint64_t base_ns = UINT64_MAX;
+
+    // First pass: the earliest timestamp, so every file shares one origin.
+    for (int f = 0; f < count; f++) {
+        FILE *in = fopen(paths[f], "rb");
+        uint32_t pid, transport_count, tid, events;
+        char role[32], transports[EVENT_TRACE_MAX_TRANSPORTS][16];
+        if (in == NULL) {
+            perror(paths[f]);
+            return false;
+        }
+        if (!event_read_header(in, paths[f], &pid, role, transports, &transport_count)) {
+            fclose(in);
+            return false;
+        }
+        while (fread(&tid, sizeof(uint32_t), 1, in) == 1 && fread(&events, sizeof(uint32_t), 1, in) == 1) {
+            Event event;
+            if (events > 0 && fread(&event, sizeof(Event), 1, in) == 1) {
+                base_ns = event.timestamp_ns < base_ns ? event.timestamp_ns : base_ns;
+                fseek(in, (long)(events - 1) * sizeof(Event), SEEK_CUR);
+            }
+        }
+        fclose(in);
+    }
+    if (base_ns == UINT64_MAX) {
+        base_ns = 0;
+    }
+
+    FILE *out = fopen(output, "w");
+    if (out == NULL) {
+        perror(output);
+        return false;
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    bool first = true;
+    uint64_t total = 0;
+
+    for (int f = 0; f < count; f++) {
+        FILE *in = fopen(paths[f], "rb");
+        uint32_t pid, transport_count, tid, events;
+        char role[32], transports[EVENT_TRACE_MAX_TRANSPORTS][16];
+        if (in == NULL || !event_read_header(in, paths[f], &pid, role, transports, &transport_count)) {
+            if (in != NULL) {
+                fclose(in);
+            }
+            fclose(out);
+            return false;
+        }
+        fprintf(out, "%s\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"%s (%u)\"}}",
+                first ? "" : ",", pid, role, pid);
+        first = false;
+
+        while (fread(&tid, sizeof(uint32_t), 1, in) == 1 && fread(&events, sizeof(uint32_t), 1, in) == 1) {
+            EventSlice slice = { false };
+            Event event;
+            for (uint32_t k = 0; k < events && fread(&event, sizeof(Event), 1, in) == 1; k++) {
+                const char *transport = event.transport < transport_count ? transports[event.transport] : "?";
+                bool send = event.kind <= EVENT_PUBLISHED;
+                bool start = event.kind == EVENT_SEND_START || event.kind == EVENT_RECEIVE_START;
+
+                if (start || !slice.open || slice.send != send || slice.transport != event.transport) {
+                    event_slice_close(out, &slice, transports, transport_count, pid, tid, base_ns, &first);
+                    slice = (EventSlice){ true, send, event.transport, event.timestamp_ns, event.timestamp_ns };
+                }
+                slice.end_ns = event.timestamp_ns;
+
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u}",
+                        event.kind < EVENT_KINDS ? EVENT_KIND_NAMES[event.kind] : "?", transport,
+                        (double)(event.timestamp_ns - base_ns) / 1000.0, pid, tid);
+                total++;
+            }
+            event_slice_close(out, &slice, transports, transport_count, pid, tid, base_ns, &first);
+        }
+        fclose(in);
+    }
+
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    printf("Merged %lu events from %d files into %s\n", total, count, output);
+    return true;
+}
+
+#endif
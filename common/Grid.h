@@ -0,0 +1,282 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A parameter grid set at run time, so a sweep needs no rebuild. Each
+// parameter has a list of values; the runner visits their Cartesian
+// product, last parameter fastest.
+//
+// Values come from the command line (--set name=v1,v2,...) or a config
+// file (--config path) with one "name = v1, v2, ..." per line and '#'
+// comments. A value "from..to*factor" expands to a geometric range and
+// numbers may carry a k/m/g suffix (powers of 1024): "64..64k*4" is
+// 64, 256, 1024, 4096, 16384, 65536.
+
+#define GRID_MAX_PARAMS 12
+#define GRID_MAX_VALUES 32
+#define GRID_VALUE_SIZE 32
+
+typedef struct {
+    char name[GRID_VALUE_SIZE];
+    char values[GRID_MAX_VALUES][GRID_VALUE_SIZE];
+    int count;
+    bool set;           // given on the command line or in a config file
+} GridParam;
+
+typedef struct {
+    GridParam params[GRID_MAX_PARAMS];
+    int count;
+    int index[GRID_MAX_PARAMS];
+    bool started;
+} Grid;
+
+void Grid_init(Grid *grid) {
+    memset(grid, 0, sizeof(*grid));
+}
+
+static GridParam *grid_find(Grid *grid, const char *name) {
+    for (int i = 0; i < grid->count; i++) {
+        if (strcmp(grid->params[i].name, name) == 0) {
+            return &grid->params[i];
+        }
+    }
+    return NULL;
+}
+
+static char *grid_trim(char *text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+// Parses a number with an optional k/m/g suffix; false if `text` is not one.
+bool Grid_parse_long(const char *text, long *value) {
+    char *end;
+    *value = strtol(text, &end, 10);
+    if (end == text) {
+        return false;
+    }
+
+    switch (tolower((unsigned char)*end)) {
+        case 'k': *value *= 1024; end++; break;
+        case 'm': *value *= 1024 * 1024; end++; break;
+        case 'g': *value *= 1024 * 1024 * 1024; end++; break;
+    }
+    return *end == '\0';
+}
+
+static bool grid_add_value(GridParam *param, const char *value) {
+    if (param->count == GRID_MAX_VALUES) {
+        fprintf(stderr, "Grid: too many values for '%s'\n", param->name);
+        return false;
+    }
+    snprintf(param->values[param->count++], GRID_VALUE_SIZE, "%s", value);
+    return true;
+}
+
+// Replaces the values of `param` with the comma-separated `list`.
+static bool grid_parse_values(GridParam *param, char *list) {
+    param->count = 0;
+
+    for (char *item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *value = grid_trim(item);
+        char *dots = strstr(value, "..");
+        char *star = dots ? strchr(dots, '*') : NULL;
+
+        if (dots == NULL || star == NULL) {
+            if (!grid_add_value(param, value)) {
+                return false;
+            }
+            continue;
+        }
+
+        long from, to, factor;
+        *dots = *star = '\0';
+        if (!Grid_parse_long(value, &from) || !Grid_parse_long(dots + 2, &to) || !Grid_parse_long(star + 1, &factor) ||
+            from <= 0 || factor < 2) {
+            fprintf(stderr, "Grid: bad range for '%s'\n", param->name);
+            return false;
+        }
+        for (long v = from; v <= to; v *= factor) {
+            char number[GRID_VALUE_SIZE];
+            snprintf(number, sizeof(number), "%ld", v);
+            if (!grid_add_value(param, number)) {
+                return false;
+            }
+        }
+    }
+    return param->count > 0;
+}
+
+// Declares a parameter and its default values.
+void Grid_define(Grid *grid, const char *name, const char *defaults) {
+    GridParam *param = &grid->params[grid->count++];
+    char list[GRID_MAX_VALUES * GRID_VALUE_SIZE];
+
+    snprintf(param->name, sizeof(param->name), "%s", name);
+    snprintf(list, sizeof(list), "%s", defaults);
+    grid_parse_values(param, list);
+}
+
+// Applies "name=v1,v2,..."; false (with a message) for unknown names or bad
+// values.
+bool Grid_set(Grid *grid, const char *assignment) {
+    char text[GRID_MAX_VALUES * GRID_VALUE_SIZE];
+    snprintf(text, sizeof(text), "%s", assignment);
+
+    char *equals = strchr(text, '=');
+    if (equals == NULL) {
+        fprintf(stderr, "Grid: expected name=values, got '%s'\n", assignment);
+        return false;
+    }
+    *equals = '\0';
+
+    GridParam *param = grid_find(grid, grid_trim(text));
+    if (param == NULL) {
+        fprintf(stderr, "Grid: unknown parameter '%s'; known:", grid_trim(text));
+        for (int i = 0; i < grid->count; i++) {
+            fprintf(stderr, " %s", grid->params[i].name);
+        }
+        fprintf(stderr, "\n");
+        return false;
+    }
+
+    param->set = true;
+    return grid_parse_values(param, equals + 1);
+}
+
+bool Grid_load(Grid *grid, const char *path) {
+    FILE *file = fopen(path, "r");
+    char line[GRID_MAX_VALUES * GRID_VALUE_SIZE];
+    bool ok = true;
+
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    while (ok && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "#\n")] = '\0';
+        if (*grid_trim(line) != '\0') {
+            ok = Grid_set(grid, grid_trim(line));
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+// Consumes --set name=values and --config path from argv (shifting the rest
+// down). Returns false on a bad option.
+bool Grid_parse_args(Grid *grid, int *argc, char *argv[]) {
+    int out = 1;
+
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "--set") == 0 && i + 1 < *argc) {
+            if (!Grid_set(grid, argv[++i])) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < *argc) {
+            if (!Grid_load(grid, argv[++i])) {
+                return false;
+            }
+        } else {
+            argv[out++] = argv[i];
+        }
+    }
+    *argc = out;
+    return true;
+}
+
+// True if any parameter was set away from its defaults.
+bool Grid_customized(const Grid *grid) {
+    for (int i = 0; i < grid->count; i++) {
+        if (grid->params[i].set) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t Grid_points(const Grid *grid) {
+    size_t points = 1;
+    for (int i = 0; i < grid->count; i++) {
+        points *= grid->params[i].count;
+    }
+    return points;
+}
+
+// Moves to the next point; the first call selects the first one. Returns
+// false once every point has been visited.
+bool Grid_next(Grid *grid) {
+    if (!grid->started) {
+        grid->started = true;
+        memset(grid->index, 0, sizeof(grid->index));
+        return true;
+    }
+    for (int i = grid->count - 1; i >= 0; i--) {
+        if (++grid->index[i] < grid->params[i].count) {
+            return true;
+        }
+        grid->index[i] = 0;
+    }
+    grid->started = false;
+    return false;
+}
+
+const char *Grid_get(const Grid *grid, const char *name) {
+    GridParam *param = grid_find((Grid *)grid, name);
+    return param ? param->values[grid->index[param - grid->params]] : NULL;
+}
+
+long Grid_get_long(const Grid *grid, const char *name) {
+    long value = 0;
+    const char *text = Grid_get(grid, name);
+    if (text == NULL || !Grid_parse_long(text, &value)) {
+        fprintf(stderr, "Grid: '%s' is not a number: %s\n", name, text ? text : "(unset)");
+        exit(1);
+    }
+    return value;
+}
+
+// Every value of `name` at once, for configs that use a parameter as a list
+// rather than a sweep axis; NULL for unknown names.
+const GridParam *Grid_param(const Grid *grid, const char *name) {
+    return grid_find((Grid *)grid, name);
+}
+
+static bool grid_listed(const char *list, const char *name) {
+    size_t len = strlen(name);
+    for (const char *item = list; item != NULL; item = strchr(item, ',')) {
+        item += *item == ',';
+        if (strncmp(item, name, len) == 0 && (item[len] == ',' || item[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// "name=value;name=value" for the current point, skipping the parameters in
+// the comma-separated `except` (may be NULL), e.g. to label results.
+void Grid_describe(const Grid *grid, const char *except, char *out, size_t len) {
+    size_t used = 0;
+    out[0] = '\0';
+
+    for (int i = 0; i < grid->count && used < len; i++) {
+        if (except != NULL && grid_listed(except, grid->params[i].name)) {
+            continue;
+        }
+        used += snprintf(out + used, len - used, "%s%s=%s", used ? ";" : "", grid->params[i].name,
+                         grid->params[i].values[grid->index[i]]);
+    }
+}
+
+#endif
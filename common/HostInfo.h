@@ -0,0 +1,224 @@
+#ifndef HOST_INFO_H
+#define HOST_INFO_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+// Identifies the machine a result came from and the settings that make
+// results noisy (frequency scaling, turbo, THP, CPU isolation, background
+// load), so runs from before and after a change can be told apart.
+// Settings the kernel does not expose are recorded as "n/a".
+typedef struct {
+    char hostname[65];
+    char kernel[160];
+    char machine[65];
+    char cpu_model[128];
+    char microcode[32];
+    long online_cpus;
+    char compiler[64];
+
+    char governor[32];         // cpufreq scaling governor of CPU 0
+    char turbo[16];            // "on", "off" (intel_pstate/no_turbo or cpufreq/boost)
+    char thp[16];              // transparent_hugepage/enabled selection
+    char isolcpus[64];         // /sys/devices/system/cpu/isolated
+    char nohz_full[64];
+    char irq_affinity[64];     // /proc/irq/default_smp_affinity
+    double load[3];            // /proc/loadavg
+    double memory_pressure;    // /proc/pressure/memory "some avg10" (%), -1 if absent
+} HostInfo;
+
+// Noisy-configuration thresholds: 1-minute load average per online CPU and
+// memory stall percentage over the last 10 s.
+#define HOST_LOAD_PER_CPU 0.5
+#define HOST_MEMORY_PRESSURE 1.0
+
+static void host_read_cpu_field(const char *field, char *value, size_t len) {
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    char line[256];
+
+    snprintf(value, len, "n/a");
+    if (cpuinfo == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), cpuinfo)) {
+        char *colon = strchr(line, ':');
+        if (colon != NULL && strncmp(line, field, strlen(field)) == 0) {
+            colon += 2;
+            colon[strcspn(colon, "\n")] = '\0';
+            snprintf(value, len, "%s", colon);
+            break;
+        }
+    }
+    fclose(cpuinfo);
+}
+
+// Reads the first line of a sysfs/procfs file: "n/a" if it does not exist,
+// "-" if it is empty.
+static bool host_read_line(const char *path, char *value, size_t len) {
+    FILE *file = fopen(path, "r");
+    char line[256];
+
+    snprintf(value, len, "n/a");
+    if (file == NULL) {
+        return false;
+    }
+    if (fgets(line, sizeof(line), file) == NULL) {
+        line[0] = '\0';
+    }
+    fclose(file);
+
+    line[strcspn(line, "\n")] = '\0';
+    snprintf(value, len, "%s", line[0] ? line : "-");
+    return true;
+}
+
+static void host_read_thp(char *value, size_t len) {
+    char line[128];
+
+    if (!host_read_line("/sys/kernel/mm/transparent_hugepage/enabled", line, sizeof(line))) {
+        snprintf(value, len, "n/a");
+        return;
+    }
+
+    // "always [madvise] never": the bracketed entry is the active mode. A
+    // line without one that does not fit `value` is not a mode we know.
+    char *start = strchr(line, '[');
+    char *end = start ? strchr(start, ']') : NULL;
+    if (start != NULL && end != NULL) {
+        snprintf(value, len, "%.*s", (int)(end - start - 1), start + 1);
+    } else if (snprintf(value, len, "%s", line) >= (int)len) {
+        snprintf(value, len, "n/a");
+    }
+}
+
+static void host_read_turbo(char *value, size_t len) {
+    char line[16];
+
+    if (host_read_line("/sys/devices/system/cpu/intel_pstate/no_turbo", line, sizeof(line))) {
+        snprintf(value, len, "%s", strcmp(line, "1") == 0 ? "off" : "on");
+    } else if (host_read_line("/sys/devices/system/cpu/cpufreq/boost", line, sizeof(line))) {
+        snprintf(value, len, "%s", strcmp(line, "1") == 0 ? "on" : "off");
+    } else {
+        snprintf(value, len, "n/a");
+    }
+}
+
+static double host_read_memory_pressure() {
+    FILE *file = fopen("/proc/pressure/memory", "r");
+    double avg10 = -1;
+
+    if (file != NULL) {
+        if (fscanf(file, "some avg10=%lf", &avg10) != 1) {
+            avg10 = -1;
+        }
+        fclose(file);
+    }
+    return avg10;
+}
+
+void HostInfo_collect(HostInfo *host) {
+    struct utsname name;
+
+    memset(host, 0, sizeof(*host));
+    if (uname(&name) == 0) {
+        snprintf(host->hostname, sizeof(host->hostname), "%s", name.nodename);
+        snprintf(host->kernel, sizeof(host->kernel), "%s %s", name.sysname, name.release);
+        snprintf(host->machine, sizeof(host->machine), "%s", name.machine);
+    }
+    host_read_cpu_field("model name", host->cpu_model, sizeof(host->cpu_model));
+    host_read_cpu_field("microcode", host->microcode, sizeof(host->microcode));
+    host->online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#if defined(__VERSION__)
+    snprintf(host->compiler, sizeof(host->compiler), "%s", __VERSION__);
+#endif
+
+    host_read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", host->governor, sizeof(host->governor));
+    host_read_turbo(host->turbo, sizeof(host->turbo));
+    host_read_thp(host->thp, sizeof(host->thp));
+    host_read_line("/sys/devices/system/cpu/isolated", host->isolcpus, sizeof(host->isolcpus));
+    host_read_line("/sys/devices/system/cpu/nohz_full", host->nohz_full, sizeof(host->nohz_full));
+    host_read_line("/proc/irq/default_smp_affinity", host->irq_affinity, sizeof(host->irq_affinity));
+
+    FILE *loadavg = fopen("/proc/loadavg", "r");
+    if (loadavg == NULL || fscanf(loadavg, "%lf %lf %lf", &host->load[0], &host->load[1], &host->load[2]) != 3) {
+        host->load[0] = host->load[1] = host->load[2] = -1;
+    }
+    if (loadavg != NULL) {
+        fclose(loadavg);
+    }
+    host->memory_pressure = host_read_memory_pressure();
+}
+
+// Writes the fingerprint as a JSON object (strings are plain ASCII from
+// uname and /proc, with quotes and backslashes dropped).
+void HostInfo_json(const HostInfo *host, FILE *out) {
+    const char *fields[][2] = {
+        { "hostname", host->hostname }, { "kernel", host->kernel }, { "machine", host->machine },
+        { "cpu_model", host->cpu_model }, { "microcode", host->microcode }, { "compiler", host->compiler },
+        { "governor", host->governor }, { "turbo", host->turbo }, { "thp", host->thp },
+        { "isolcpus", host->isolcpus }, { "nohz_full", host->nohz_full }, { "irq_affinity", host->irq_affinity },
+    };
+
+    fprintf(out, "{");
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        fprintf(out, "\"%s\":\"", fields[i][0]);
+        for (const char *c = fields[i][1]; *c; c++) {
+            if (*c != '"' && *c != '\\') {
+                fputc(*c, out);
+            }
+        }
+        fprintf(out, "\",");
+    }
+    fprintf(out, "\"online_cpus\":%ld,\"load\":[%.2f,%.2f,%.2f],\"memory_pressure\":%.2f}",
+            host->online_cpus, host->load[0], host->load[1], host->load[2], host->memory_pressure);
+}
+
+void HostInfo_print(const HostInfo *host) {
+    printf("Host: %s, %s %s, %s (microcode %s), %ld CPUs online\n", host->hostname, host->kernel, host->machine,
+           host->cpu_model, host->microcode, host->online_cpus);
+    printf("Governor: %s, turbo: %s, THP: %s, isolated: %s, nohz_full: %s, IRQ affinity: %s\n", host->governor,
+           host->turbo, host->thp, host->isolcpus, host->nohz_full, host->irq_affinity);
+    printf("Load: %.2f %.2f %.2f, memory pressure: %.2f%%\n", host->load[0], host->load[1], host->load[2],
+           host->memory_pressure);
+}
+
+static bool host_unset(const char *value) {
+    return value[0] == '-' || strcmp(value, "n/a") == 0;
+}
+
+// Prints a warning for each setting known to add noise and returns how many.
+int HostInfo_warn(const HostInfo *host) {
+    int warnings = 0;
+
+    if (!host_unset(host->governor) && strcmp(host->governor, "performance") != 0) {
+        printf("Warning: CPU governor is '%s'; frequency follows load (use 'performance')\n", host->governor);
+        warnings++;
+    }
+    if (strcmp(host->turbo, "on") == 0) {
+        printf("Warning: turbo is on; frequency depends on temperature and active cores\n");
+        warnings++;
+    }
+    if (strcmp(host->thp, "always") == 0) {
+        printf("Warning: THP is 'always'; huge page faults and khugepaged add latency spikes\n");
+        warnings++;
+    }
+    if (host_unset(host->isolcpus) && host_unset(host->nohz_full)) {
+        printf("Warning: no isolcpus or nohz_full CPUs; benchmark threads share CPUs with the tick and other tasks\n");
+        warnings++;
+    }
+    if (host->load[0] > HOST_LOAD_PER_CPU * (double)host->online_cpus) {
+        printf("Warning: load average %.2f on %ld CPUs; background work competes with the benchmark\n",
+               host->load[0], host->online_cpus);
+        warnings++;
+    }
+    if (host->memory_pressure > HOST_MEMORY_PRESSURE) {
+        printf("Warning: memory pressure %.2f%%; reclaim stalls will show up in the results\n", host->memory_pressure);
+        warnings++;
+    }
+    return warnings;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware performance counters for a benchmark region, read with
+// perf_event_open on the calling thread. When the kernel or hypervisor does
+// not expose the PMU, the set falls back to software events so every region
+// still reports something.
+
+#define PERF_MAX_EVENTS 8
+
+typedef struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} PerfEventSpec;
+
+#define PERF_CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static const PerfEventSpec PERF_HARDWARE_EVENTS[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1D misses", PERF_TYPE_HW_CACHE,
+      PERF_CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "dTLB misses", PERF_TYPE_HW_CACHE,
+      PERF_CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+#if defined(__x86_64__)
+    // MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM on Intel Skylake and later: loads
+    // served from a modified line in another core's cache.
+    { "snoop HITM", PERF_TYPE_RAW, 0x04d2 },
+#endif
+};
+
+static const PerfEventSpec PERF_SOFTWARE_EVENTS[] = {
+    { "task clock (ns)", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { "CPU migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+    { "page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+typedef struct {
+    int number_of_events;
+    bool hardware;
+    const PerfEventSpec *specs;
+    int fds[PERF_MAX_EVENTS];
+    double totals[PERF_MAX_EVENTS];
+} PerfCounters;
+
+static int perf_event_open_spec(const PerfEventSpec *spec) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec->type;
+    attr.config = spec->config;
+    attr.disabled = 1;
+    // Software events such as context switches happen in the kernel.
+    attr.exclude_kernel = spec->type != PERF_TYPE_SOFTWARE;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static bool perf_is_intel() {
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    char line[256];
+    bool intel = false;
+
+    if (cpuinfo == NULL) {
+        return false;
+    }
+    while (fgets(line, sizeof(line), cpuinfo)) {
+        if (strncmp(line, "vendor_id", 9) == 0) {
+            intel = strstr(line, "GenuineIntel") != NULL;
+            break;
+        }
+    }
+    fclose(cpuinfo);
+    return intel;
+}
+
+void PerfCounters_init(PerfCounters *counters) {
+    memset(counters, 0, sizeof(*counters));
+
+    int cycles = perf_event_open_spec(&PERF_HARDWARE_EVENTS[0]);
+    counters->hardware = cycles >= 0;
+
+    if (counters->hardware) {
+        counters->specs = PERF_HARDWARE_EVENTS;
+        counters->number_of_events = sizeof(PERF_HARDWARE_EVENTS) / sizeof(PERF_HARDWARE_EVENTS[0]);
+        counters->fds[0] = cycles;
+        bool intel = perf_is_intel();
+
+        for (int i = 1; i < counters->number_of_events; i++) {
+            bool raw = counters->specs[i].type == PERF_TYPE_RAW;
+            counters->fds[i] = (raw && !intel) ? -1 : perf_event_open_spec(&counters->specs[i]);
+        }
+    } else {
+        counters->specs = PERF_SOFTWARE_EVENTS;
+        counters->number_of_events = sizeof(PERF_SOFTWARE_EVENTS) / sizeof(PERF_SOFTWARE_EVENTS[0]);
+
+        for (int i = 0; i < counters->number_of_events; i++) {
+            counters->fds[i] = perf_event_open_spec(&counters->specs[i]);
+        }
+    }
+}
+
+void PerfCounters_start(PerfCounters *counters) {
+    for (int i = 0; i < counters->number_of_events; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+// Adds the counts since the last start to the totals, scaling each one up
+// when the kernel had to multiplex it with other events.
+void PerfCounters_stop(PerfCounters *counters) {
+    for (int i = 0; i < counters->number_of_events; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (int i = 0; i < counters->number_of_events; i++) {
+        uint64_t values[3];
+        if (counters->fds[i] < 0 || read(counters->fds[i], values, sizeof(values)) != sizeof(values)) {
+            continue;
+        }
+        double scale = values[2] ? (double)values[1] / (double)values[2] : 1.0;
+        counters->totals[i] += (double)values[0] * scale;
+    }
+}
+
+void PerfCounters_reset(PerfCounters *counters) {
+    memset(counters->totals, 0, sizeof(counters->totals));
+}
+
+void PerfCounters_close(PerfCounters *counters) {
+    for (int i = 0; i < counters->number_of_events; i++) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+        }
+    }
+}
+
+// Prints the accumulated totals and their value per `unit` (message,
+// element, ...), then clears the totals.
+void PerfCounters_print(PerfCounters *counters, const char *region, uint64_t units, const char *unit) {
+    printf("%s counters for %s (%lu %ss):\n", counters->hardware ? "Hardware" : "Software", region, units, unit);
+    printf("+------------------+--------------------+--------------------+\n");
+    printf("| Counter          |       Total        |  Per %-13s |\n", unit);
+    printf("+------------------+--------------------+--------------------+\n");
+
+    for (int i = 0; i < counters->number_of_events; i++) {
+        if (counters->fds[i] < 0) {
+            printf("| %-16s | %18s | %18s |\n", counters->specs[i].name, "n/a", "n/a");
+            continue;
+        }
+        printf("| %-16s | %18.0lf | %18.3lf |\n", counters->specs[i].name, counters->totals[i],
+               units ? counters->totals[i] / (double)units : 0);
+    }
+
+    printf("+------------------+--------------------+--------------------+\n");
+    PerfCounters_reset(counters);
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define REALTIME_PRIORITY 50
+
+// Moves the calling thread to SCHED_FIFO so ordinary tasks cannot preempt
+// it; threads and processes it creates afterwards inherit the policy. The
+// transports spin while they wait, and FIFO threads of equal priority
+// never yield to each other, so this needs more CPUs than spinning
+// threads: it refuses on a single CPU, and callers should drop back with
+// Realtime_disable() before starting more spinners than CPUs.
+bool Realtime_enable(int priority) {
+    struct sched_param param = { .sched_priority = priority };
+
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        printf("SCHED_FIFO not used: spinning peers would starve each other on one CPU\n");
+        return false;
+    }
+
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error) {
+        printf("SCHED_FIFO not used: %s\n", strerror(error));
+        return false;
+    }
+
+    printf("Benchmark threads run with SCHED_FIFO priority %d\n", priority);
+    return true;
+}
+
+void Realtime_disable() {
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef RESOURCE_USAGE_H
+#define RESOURCE_USAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Linux-specific; only declared by glibc under _GNU_SOURCE.
+#ifndef RUSAGE_THREAD
+#define RUSAGE_THREAD 1
+#endif
+
+// What a benchmark run cost the OS: CPU time, context switches and page
+// faults from getrusage, plus on-CPU and run-queue time from schedstat.
+// Spin-waiting transports show up here as a full core of user time.
+typedef struct {
+    double user_s;
+    double system_s;
+    long voluntary_switches;
+    long involuntary_switches;
+    long minor_faults;
+    long major_faults;
+    uint64_t run_ns;
+    uint64_t wait_ns;
+} ResourceUsage;
+
+// Bytes the current thread moved since the last ResourceUsage_take_moved().
+static _Thread_local uint64_t resource_bytes_moved;
+
+static void resource_from_rusage(ResourceUsage *usage, const struct rusage *ru) {
+    usage->user_s = (double)ru->ru_utime.tv_sec + (double)ru->ru_utime.tv_usec / 1000000.0;
+    usage->system_s = (double)ru->ru_stime.tv_sec + (double)ru->ru_stime.tv_usec / 1000000.0;
+    usage->voluntary_switches = ru->ru_nvcsw;
+    usage->involuntary_switches = ru->ru_nivcsw;
+    usage->minor_faults = ru->ru_minflt;
+    usage->major_faults = ru->ru_majflt;
+}
+
+// /proc/.../schedstat: time on the CPU, time waiting on a run queue (ns).
+static void resource_read_schedstat(ResourceUsage *usage, const char *path) {
+    FILE *schedstat = fopen(path, "r");
+    unsigned long long run_ns = 0, wait_ns = 0;
+
+    if (schedstat != NULL) {
+        if (fscanf(schedstat, "%llu %llu", &run_ns, &wait_ns) != 2) {
+            run_ns = wait_ns = 0;
+        }
+        fclose(schedstat);
+    }
+    usage->run_ns = run_ns;
+    usage->wait_ns = wait_ns;
+}
+
+// Totals for the calling thread so far.
+void ResourceUsage_thread(ResourceUsage *usage) {
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    resource_from_rusage(usage, &ru);
+    resource_read_schedstat(usage, "/proc/thread-self/schedstat");
+}
+
+// Reaps a child and returns its lifetime totals. The child is first waited
+// for without reaping, so its schedstat can still be read.
+pid_t ResourceUsage_wait(pid_t pid, ResourceUsage *usage) {
+    siginfo_t info;
+    char path[64];
+    struct rusage ru;
+
+    memset(usage, 0, sizeof(*usage));
+    if (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) == 0) {
+        snprintf(path, sizeof(path), "/proc/%d/schedstat", pid);
+        resource_read_schedstat(usage, path);
+    }
+
+    pid_t result = wait4(pid, NULL, 0, &ru);
+    if (result == pid) {
+        resource_from_rusage(usage, &ru);
+    }
+    return result;
+}
+
+void ResourceUsage_sub(ResourceUsage *delta, const ResourceUsage *end, const ResourceUsage *start) {
+    delta->user_s = end->user_s - start->user_s;
+    delta->system_s = end->system_s - start->system_s;
+    delta->voluntary_switches = end->voluntary_switches - start->voluntary_switches;
+    delta->involuntary_switches = end->involuntary_switches - start->involuntary_switches;
+    delta->minor_faults = end->minor_faults - start->minor_faults;
+    delta->major_faults = end->major_faults - start->major_faults;
+    delta->run_ns = end->run_ns - start->run_ns;
+    delta->wait_ns = end->wait_ns - start->wait_ns;
+}
+
+void ResourceUsage_add(ResourceUsage *total, const ResourceUsage *usage) {
+    total->user_s += usage->user_s;
+    total->system_s += usage->system_s;
+    total->voluntary_switches += usage->voluntary_switches;
+    total->involuntary_switches += usage->involuntary_switches;
+    total->minor_faults += usage->minor_faults;
+    total->major_faults += usage->major_faults;
+    total->run_ns += usage->run_ns;
+    total->wait_ns += usage->wait_ns;
+}
+
+void ResourceUsage_moved(uint64_t bytes) {
+    resource_bytes_moved += bytes;
+}
+
+uint64_t ResourceUsage_take_moved() {
+    uint64_t bytes = resource_bytes_moved;
+    resource_bytes_moved = 0;
+    return bytes;
+}
+
+// User plus system time of both sides for every GB moved.
+double ResourceUsage_cpu_per_gb(const ResourceUsage *self, const ResourceUsage *peer, uint64_t bytes) {
+    double cpu = self->user_s + self->system_s;
+    if (peer != NULL) {
+        cpu += peer->user_s + peer->system_s;
+    }
+    return bytes ? cpu / ((double)bytes / (1024.0 * 1024.0 * 1024.0)) : 0;
+}
+
+static void resource_print_row(const char *side, const ResourceUsage *usage) {
+    printf("| %-6s | %10.3lf | %10.3lf | %10ld | %10ld | %10ld | %8ld | %10.3lf | %10.3lf |\n", side,
+           usage->user_s, usage->system_s, usage->voluntary_switches, usage->involuntary_switches,
+           usage->minor_faults, usage->major_faults,
+           (double)usage->run_ns / 1000000000.0, (double)usage->wait_ns / 1000000000.0);
+}
+
+// Prints one row per side (peer may be NULL) and the CPU-seconds per GB.
+void ResourceUsage_print(const char *region, const ResourceUsage *self, const ResourceUsage *peer, uint64_t bytes) {
+    printf("Resource usage for %s (%.1lf MB moved):\n", region, (double)bytes / (1024.0 * 1024.0));
+    printf("+--------+------------+------------+------------+------------+------------+----------+------------+------------+\n");
+    printf("| Side   |  User (s)  |  Sys (s)   |  Vol. cs   | Invol. cs  | Minor flt  | Major flt|   Run (s)  |  Queue (s) |\n");
+    printf("+--------+------------+------------+------------+------------+------------+----------+------------+------------+\n");
+    resource_print_row("self", self);
+    if (peer != NULL) {
+        resource_print_row("peer", peer);
+    }
+    printf("+--------+------------+------------+------------+------------+------------+----------+------------+------------+\n");
+    printf("CPU-seconds per GB moved: %f\n", ResourceUsage_cpu_per_gb(self, peer, bytes));
+}
+
+#endif
@@ -0,0 +1,431 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "HostInfo.h"
+
+// Machine-readable results next to the printed tables. Every record carries
+// its full distribution, the run's configuration and the host fingerprint.
+//
+// JSON lines (any path not ending in .csv): one object per benchmark metric.
+// CSV: "# suite/run/host/config" comment lines, then one row per sample:
+// benchmark,variant,metric,unit,better,index,value.
+//
+// Results_compare() reads two such files and flags metrics whose samples
+// moved significantly for the worse (two-sided Mann-Whitney U test).
+
+#define RESULTS_ALPHA 0.01
+#define RESULTS_MAX_LINE (1 << 24)
+#define RESULTS_POINT_SIZE 1024    // as long as a Grid_describe() label
+
+typedef struct {
+    FILE *file;
+    bool csv;
+    const char *suite;
+    const char *config_json;
+    char run_id[32];
+    char point[RESULTS_POINT_SIZE];
+    HostInfo host;
+} ResultsWriter;
+
+static ResultsWriter results_writer;
+
+// Samples reported by the benchmark since the last Results_record().
+static _Thread_local double *results_pending;
+static _Thread_local size_t results_pending_count;
+static _Thread_local size_t results_pending_capacity;
+
+bool Results_enabled() {
+    return results_writer.file != NULL;
+}
+
+// `config_json` is a JSON object describing how the suite was configured.
+bool Results_open(const char *path, const char *suite, const char *config_json) {
+    size_t len = strlen(path);
+    results_writer.file = fopen(path, "w");
+    if (results_writer.file == NULL) {
+        perror("Results_open");
+        return false;
+    }
+
+    results_writer.csv = len > 4 && strcmp(path + len - 4, ".csv") == 0;
+    results_writer.suite = suite;
+    results_writer.config_json = config_json;
+    snprintf(results_writer.run_id, sizeof(results_writer.run_id), "%lx-%x", (unsigned long)time(NULL), (unsigned)getpid());
+    HostInfo_collect(&results_writer.host);
+
+    if (results_writer.csv) {
+        FILE *out = results_writer.file;
+        fprintf(out, "# suite: %s\n# run: %s\n# host: ", suite, results_writer.run_id);
+        HostInfo_json(&results_writer.host, out);
+        fprintf(out, "\n# config: %s\nbenchmark,variant,metric,unit,better,index,value\n", config_json);
+        fflush(out);
+    }
+    return true;
+}
+
+void Results_close() {
+    if (results_writer.file != NULL) {
+        fclose(results_writer.file);
+        results_writer.file = NULL;
+    }
+}
+
+// Labels the records that follow with a sweep point ("name=value;..."),
+// appended to their variant so compare mode keeps points apart; "" clears it.
+void Results_set_point(const char *point) {
+    if (snprintf(results_writer.point, sizeof(results_writer.point), "%s", point) >= (int)sizeof(results_writer.point)) {
+        fprintf(stderr, "Sweep point label truncated to %zu bytes: %s\n", sizeof(results_writer.point) - 1, point);
+    }
+}
+
+void Results_sample(double value) {
+    if (!Results_enabled()) {
+        return;
+    }
+    if (results_pending_count == results_pending_capacity) {
+        results_pending_capacity = results_pending_capacity ? results_pending_capacity * 2 : 1024;
+        results_pending = (double *)realloc(results_pending, results_pending_capacity * sizeof(double));
+    }
+    results_pending[results_pending_count++] = value;
+}
+
+static int results_compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double results_quantile(const double *sorted, size_t n, double quantile) {
+    size_t rank = (size_t)(quantile * (double)n);
+    return n ? sorted[rank < n ? rank : n - 1] : 0;
+}
+
+// Writes one metric with the given samples. `lower_is_better` tells the
+// compare mode which direction is a regression.
+void Results_record_values(const char *benchmark, const char *variant, const char *metric, const char *unit,
+                           bool lower_is_better, const double *values, size_t n) {
+    if (!Results_enabled()) {
+        return;
+    }
+
+    FILE *out = results_writer.file;
+    const char *better = lower_is_better ? "lower" : "higher";
+    char labeled[RESULTS_POINT_SIZE + 256];
+    if (results_writer.point[0]) {
+        snprintf(labeled, sizeof(labeled), "%s;%s", variant, results_writer.point);
+        variant = labeled;
+    }
+
+    if (results_writer.csv) {
+        for (size_t i = 0; i < n; i++) {
+            fprintf(out, "%s,%s,%s,%s,%s,%zu,%.9g\n", benchmark, variant, metric, unit, better, i, values[i]);
+        }
+        fflush(out);
+        return;
+    }
+
+    double *sorted = (double *)malloc((n ? n : 1) * sizeof(double));
+    double total = 0;
+    memcpy(sorted, values, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), results_compare_doubles);
+    for (size_t i = 0; i < n; i++) {
+        total += values[i];
+    }
+
+    fprintf(out, "{\"suite\":\"%s\",\"run\":\"%s\",\"time\":%ld,\"host\":", results_writer.suite, results_writer.run_id, (long)time(NULL));
+    HostInfo_json(&results_writer.host, out);
+    fprintf(out, ",\"config\":%s,\"benchmark\":\"%s\",\"variant\":\"%s\",\"metric\":\"%s\",\"unit\":\"%s\",\"better\":\"%s\"",
+            results_writer.config_json, benchmark, variant, metric, unit, better);
+    fprintf(out, ",\"n\":%zu,\"mean\":%.9g,\"min\":%.9g,\"p50\":%.9g,\"p99\":%.9g,\"max\":%.9g,\"samples\":[",
+            n, n ? total / (double)n : 0, results_quantile(sorted, n, 0), results_quantile(sorted, n, 0.5),
+            results_quantile(sorted, n, 0.99), results_quantile(sorted, n, 1.0));
+    for (size_t i = 0; i < n; i++) {
+        fprintf(out, i ? ",%.9g" : "%.9g", values[i]);
+    }
+    fprintf(out, "]}\n");
+    fflush(out);
+
+    free(sorted);
+}
+
+// Writes the samples collected with Results_sample() and clears them.
+void Results_record(const char *benchmark, const char *variant, const char *metric, const char *unit, bool lower_is_better) {
+    Results_record_values(benchmark, variant, metric, unit, lower_is_better, results_pending, results_pending_count);
+    results_pending_count = 0;
+}
+
+// Records entry `column` of each of `n` result arrays, one per repetition,
+// as the samples of one metric. Returns their mean.
+double Results_record_column(const char *benchmark, const char *variant, const char *metric, const char *unit,
+                             bool lower_is_better, double *const *rows, size_t n, int column) {
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+        Results_sample(rows[i][column]);
+        total += rows[i][column];
+    }
+    Results_record(benchmark, variant, metric, unit, lower_is_better);
+    return n ? total / (double)n : 0;
+}
+
+typedef struct {
+    char key[384];
+    char unit[16];
+    bool lower_is_better;
+    double *values;
+    size_t count;
+    size_t capacity;
+} ResultsSeries;
+
+typedef struct {
+    ResultsSeries *series;
+    size_t count;
+} ResultsFile;
+
+static ResultsSeries *results_series(ResultsFile *file, const char *key, const char *unit, bool lower_is_better) {
+    for (size_t i = 0; i < file->count; i++) {
+        if (strcmp(file->series[i].key, key) == 0) {
+            return &file->series[i];
+        }
+    }
+
+    file->series = (ResultsSeries *)realloc(file->series, (file->count + 1) * sizeof(ResultsSeries));
+    ResultsSeries *series = &file->series[file->count++];
+    memset(series, 0, sizeof(*series));
+    snprintf(series->key, sizeof(series->key), "%s", key);
+    snprintf(series->unit, sizeof(series->unit), "%s", unit);
+    series->lower_is_better = lower_is_better;
+    return series;
+}
+
+static void results_series_add(ResultsSeries *series, double value) {
+    if (series->count == series->capacity) {
+        series->capacity = series->capacity ? series->capacity * 2 : 64;
+        series->values = (double *)realloc(series->values, series->capacity * sizeof(double));
+    }
+    series->values[series->count++] = value;
+}
+
+// Copies the string value of "key":"..." in a JSON line into `out`.
+static bool results_json_string(const char *line, const char *key, char *out, size_t len) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+
+    const char *start = strstr(line, pattern);
+    if (start == NULL) {
+        return false;
+    }
+    start += strlen(pattern);
+    const char *end = strchr(start, '"');
+    if (end == NULL) {
+        return false;
+    }
+    snprintf(out, len, "%.*s", (int)(end - start), start);
+    return true;
+}
+
+static void results_parse_json_line(ResultsFile *file, const char *line) {
+    char benchmark[64], variant[256], metric[48], unit[16], better[8], key[384];
+
+    if (!results_json_string(line, "benchmark", benchmark, sizeof(benchmark)) ||
+        !results_json_string(line, "variant", variant, sizeof(variant)) ||
+        !results_json_string(line, "metric", metric, sizeof(metric)) ||
+        !results_json_string(line, "unit", unit, sizeof(unit)) ||
+        !results_json_string(line, "better", better, sizeof(better))) {
+        return;
+    }
+
+    const char *samples = strstr(line, "\"samples\":[");
+    if (samples == NULL) {
+        return;
+    }
+    samples += strlen("\"samples\":[");
+
+    snprintf(key, sizeof(key), "%s/%s/%s", benchmark, variant, metric);
+    ResultsSeries *series = results_series(file, key, unit, strcmp(better, "lower") == 0);
+
+    char *end;
+    while (*samples != ']' && *samples != '\0') {
+        double value = strtod(samples, &end);
+        if (end == samples) {
+            break;
+        }
+        results_series_add(series, value);
+        samples = *end == ',' ? end + 1 : end;
+    }
+}
+
+static void results_parse_csv_line(ResultsFile *file, char *line) {
+    char *fields[7];
+    int count = 0;
+    char key[384];
+
+    if (line[0] == '#' || strncmp(line, "benchmark,", 10) == 0) {
+        return;
+    }
+    for (char *field = strtok(line, ",\n"); field != NULL && count < 7; field = strtok(NULL, ",\n")) {
+        fields[count++] = field;
+    }
+    if (count < 7) {
+        return;
+    }
+
+    snprintf(key, sizeof(key), "%s/%s/%s", fields[0], fields[1], fields[2]);
+    ResultsSeries *series = results_series(file, key, fields[3], strcmp(fields[4], "lower") == 0);
+    results_series_add(series, strtod(fields[6], NULL));
+}
+
+bool ResultsFile_load(ResultsFile *file, const char *path) {
+    FILE *in = fopen(path, "r");
+    size_t len = strlen(path);
+    bool csv = len > 4 && strcmp(path + len - 4, ".csv") == 0;
+
+    file->series = NULL;
+    file->count = 0;
+    if (in == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char *line = (char *)malloc(RESULTS_MAX_LINE);
+    while (fgets(line, RESULTS_MAX_LINE, in)) {
+        if (csv) {
+            results_parse_csv_line(file, line);
+        } else {
+            results_parse_json_line(file, line);
+        }
+    }
+
+    free(line);
+    fclose(in);
+    return true;
+}
+
+void ResultsFile_free(ResultsFile *file) {
+    for (size_t i = 0; i < file->count; i++) {
+        free(file->series[i].values);
+    }
+    free(file->series);
+}
+
+typedef struct {
+    double value;
+    int group;
+} ResultsRanked;
+
+static int results_compare_ranked(const void *a, const void *b) {
+    double x = ((const ResultsRanked *)a)->value, y = ((const ResultsRanked *)b)->value;
+    return (x > y) - (x < y);
+}
+
+// Two-sided p-value of the Mann-Whitney U test (normal approximation with
+// tie and continuity corrections).
+double Results_mann_whitney(const double *a, size_t n1, const double *b, size_t n2) {
+    size_t n = n1 + n2;
+    ResultsRanked *ranked = (ResultsRanked *)malloc(n * sizeof(ResultsRanked));
+    double rank_sum = 0, ties = 0;
+
+    for (size_t i = 0; i < n1; i++) {
+        ranked[i].value = a[i];
+        ranked[i].group = 0;
+    }
+    for (size_t i = 0; i < n2; i++) {
+        ranked[n1 + i].value = b[i];
+        ranked[n1 + i].group = 1;
+    }
+    qsort(ranked, n, sizeof(ResultsRanked), results_compare_ranked);
+
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && ranked[j].value == ranked[i].value) {
+            j++;
+        }
+        double rank = (double)(i + j + 1) / 2.0;
+        double tied = (double)(j - i);
+        ties += tied * tied * tied - tied;
+        for (size_t k = i; k < j; k++) {
+            if (ranked[k].group == 0) {
+                rank_sum += rank;
+            }
+        }
+        i = j;
+    }
+    free(ranked);
+
+    double u = rank_sum - (double)n1 * (double)(n1 + 1) / 2.0;
+    double mean = (double)n1 * (double)n2 / 2.0;
+    double variance = (double)n1 * (double)n2 / 12.0 * ((double)(n + 1) - ties / ((double)n * (double)(n - 1)));
+    if (variance <= 0) {
+        return 1.0;
+    }
+
+    double z = (fabs(u - mean) - 0.5) / sqrt(variance);
+    return erfc((z > 0 ? z : 0) / sqrt(2.0));
+}
+
+static double results_median(double *values, size_t n) {
+    qsort(values, n, sizeof(double), results_compare_doubles);
+    return results_quantile(values, n, 0.5);
+}
+
+// Prints every metric present in both files and returns the number of
+// significant regressions (candidate worse than baseline at RESULTS_ALPHA).
+int Results_compare(const char *baseline_path, const char *candidate_path) {
+    ResultsFile baseline, candidate;
+    int regressions = 0;
+
+    if (!ResultsFile_load(&baseline, baseline_path) || !ResultsFile_load(&candidate, candidate_path)) {
+        return -1;
+    }
+
+    printf("Comparing %s (baseline) with %s (candidate), alpha = %.2f\n", baseline_path, candidate_path, RESULTS_ALPHA);
+    printf("+--------------------------------------------------+------------------+------------------+-----------+-----------+-------------+\n");
+    printf("| Benchmark / variant / metric                     | Baseline median  | Candidate median |  Change   |  p-value  |   Verdict   |\n");
+    printf("+--------------------------------------------------+------------------+------------------+-----------+-----------+-------------+\n");
+
+    for (size_t i = 0; i < baseline.count; i++) {
+        ResultsSeries *base = &baseline.series[i];
+        ResultsSeries *cand = NULL;
+        for (size_t j = 0; j < candidate.count; j++) {
+            if (strcmp(candidate.series[j].key, base->key) == 0) {
+                cand = &candidate.series[j];
+            }
+        }
+        if (cand == NULL || base->count == 0 || cand->count == 0) {
+            continue;
+        }
+
+        double p = (base->count >= 2 && cand->count >= 2)
+                   ? Results_mann_whitney(base->values, base->count, cand->values, cand->count) : NAN;
+        double base_median = results_median(base->values, base->count);
+        double cand_median = results_median(cand->values, cand->count);
+        double change = base_median != 0 ? 100.0 * (cand_median - base_median) / fabs(base_median) : 0;
+        bool worse = base->lower_is_better ? cand_median > base_median : cand_median < base_median;
+        const char *verdict = "same";
+
+        if (isnan(p)) {
+            verdict = "too few";
+        } else if (p < RESULTS_ALPHA) {
+            verdict = worse ? "REGRESSION" : "improved";
+            regressions += worse;
+        }
+
+        printf("| %-48.48s | %16.6g | %16.6g | %+8.2f%% | %9.2g | %-11s |\n",
+               base->key, base_median, cand_median, change, p, verdict);
+    }
+
+    printf("+--------------------------------------------------+------------------+------------------+-----------+-----------+-------------+\n");
+    printf("Regressions: %d\n", regressions);
+
+    ResultsFile_free(&baseline);
+    ResultsFile_free(&candidate);
+    return regressions;
+}
+
+#endif
@@ -0,0 +1,381 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <math.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "PerfCounters.h"
+
+#ifndef RUSAGE_THREAD
+#define RUSAGE_THREAD 1
+#endif
+
+// Runs a benchmark until its median is known well enough instead of for a
+// fixed number of iterations:
+//  - warm-up: samples from the first RUNNER_WARMUP_MS are discarded,
+//  - calibration: in batch mode the batch size doubles until one timed batch
+//    takes RUNNER_MIN_BATCH_US, so clock overhead stays negligible,
+//  - measurement: samples are taken until the 95% confidence interval of the
+//    median is within RUNNER_TARGET_ERROR of it, or RUNNER_MAX_SAMPLES or
+//    RUNNER_MAX_MS is reached; never fewer than RUNNER_MIN_SAMPLES.
+//
+// Batch mode times the caller's loop itself:
+//
+//     for (uint64_t n; (n = Runner_batch(&runner)) > 0;) {
+//         for (uint64_t k = 0; k < n; k++) { ... }   // Runner_pause/resume
+//     }                                            // around untimed work
+//
+// Bodies that time themselves report each run with Runner_add() and loop
+// while !Runner_done().
+//
+// A run is flagged as noisy when its median drifts between the first and
+// second half (frequency scaling, thermal throttling), when many samples
+// are far outliers, when the thread migrated between CPUs or was preempted
+// often, or when the interval never got narrow enough.
+
+#ifndef RUNNER_WARMUP_MS
+#define RUNNER_WARMUP_MS 200
+#endif
+#ifndef RUNNER_MIN_BATCH_US
+#define RUNNER_MIN_BATCH_US 20
+#endif
+#ifndef RUNNER_TARGET_ERROR
+#define RUNNER_TARGET_ERROR 0.01
+#endif
+#ifndef RUNNER_MIN_SAMPLES
+#define RUNNER_MIN_SAMPLES 10
+#endif
+#ifndef RUNNER_MAX_SAMPLES
+#define RUNNER_MAX_SAMPLES 100000
+#endif
+#ifndef RUNNER_MAX_MS
+#define RUNNER_MAX_MS 10000
+#endif
+
+// Interference thresholds: relative drift of the median between halves,
+// share of samples beyond RUNNER_OUTLIER_MADS median absolute deviations,
+// and involuntary context switches per sample.
+#define RUNNER_DRIFT 0.05
+#define RUNNER_OUTLIER_MADS 10.0
+#define RUNNER_OUTLIER_SHARE 0.05
+#define RUNNER_PREEMPTIONS 0.1
+
+typedef enum {
+    RUNNER_NOISY_DRIFT = 1 << 0,
+    RUNNER_NOISY_OUTLIERS = 1 << 1,
+    RUNNER_NOISY_MIGRATED = 1 << 2,
+    RUNNER_NOISY_PREEMPTED = 1 << 3,
+    RUNNER_NOISY_UNCONVERGED = 1 << 4,
+} RunnerNoise;
+
+typedef struct {
+    double median;
+    double ci_low;
+    double ci_high;
+    double mean;             // of the samples left after outlier rejection
+    double relative_error;   // CI half-width over the median
+    double drift;
+    size_t samples;
+    size_t outliers;
+    uint64_t batch;
+    uint64_t iterations;
+    int migrations;
+    long preemptions;
+    int noise;               // RunnerNoise flags
+} RunnerResult;
+
+typedef struct {
+    const char *name;
+    PerfCounters *counters;
+
+    uint64_t batch;
+    bool calibrated;
+    bool in_batch;
+    bool done;
+    uint64_t first_ns;
+    uint64_t measure_ns;
+    uint64_t batch_start_ns;
+    uint64_t paused_ns;
+    uint64_t pause_start_ns;
+
+    double *samples;
+    size_t count;
+    size_t capacity;
+    size_t next_check;
+    double relative_error;
+
+    int cpu;
+    int migrations;
+    long start_preemptions;
+
+    RunnerResult result;
+} Runner;
+
+static uint64_t runner_now() {
+    struct timespec tms;
+    clock_gettime(CLOCK_MONOTONIC, &tms);
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
+}
+
+static long runner_preemptions() {
+    struct rusage usage;
+    return getrusage(RUSAGE_THREAD, &usage) == 0 ? usage.ru_nivcsw : 0;
+}
+
+// `counters` (may be NULL) are started and stopped around every timed batch
+// after warm-up, so they cover exactly what the samples do.
+void Runner_init(Runner *runner, const char *name, PerfCounters *counters) {
+    memset(runner, 0, sizeof(*runner));
+    runner->name = name;
+    runner->counters = counters;
+    runner->batch = 1;
+    runner->cpu = sched_getcpu();
+    runner->relative_error = INFINITY;
+    runner->next_check = RUNNER_MIN_SAMPLES;
+}
+
+void Runner_free(Runner *runner) {
+    free(runner->samples);
+    runner->samples = NULL;
+}
+
+static int runner_compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double runner_median(double *sorted, size_t n) {
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+// Distribution-free 95% interval for the median from order statistics:
+// ranks n/2 -+ 1.96 * sqrt(n) / 2.
+static void runner_median_ci(const double *sorted, size_t n, double *low, double *high) {
+    double half_width = 1.96 * sqrt((double)n) / 2.0;
+    long lo = (long)floor((double)n / 2.0 - half_width);
+    long hi = (long)ceil((double)n / 2.0 + half_width);
+
+    *low = sorted[lo < 0 ? 0 : lo];
+    *high = sorted[hi >= (long)n ? (long)n - 1 : hi];
+}
+
+static double runner_relative_error(Runner *runner) {
+    size_t n = runner->count;
+    double *sorted = (double *)malloc(n * sizeof(double));
+    double low, high;
+
+    memcpy(sorted, runner->samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), runner_compare_doubles);
+    double median = runner_median(sorted, n);
+    runner_median_ci(sorted, n, &low, &high);
+    free(sorted);
+
+    return median > 0 ? (high - low) / 2.0 / median : INFINITY;
+}
+
+static void runner_check_cpu(Runner *runner) {
+    int cpu = sched_getcpu();
+    if (cpu != runner->cpu) {
+        runner->migrations += runner->measure_ns != 0;
+        runner->cpu = cpu;
+    }
+}
+
+// Adds one sample (ns per operation). Samples within the warm-up period are
+// dropped. Returns true once enough samples have been taken.
+bool Runner_add(Runner *runner, double value_ns) {
+    uint64_t now = runner_now();
+
+    if (runner->first_ns == 0) {
+        runner->first_ns = now;
+    }
+    runner_check_cpu(runner);
+
+    if (runner->measure_ns == 0) {
+        if (now - runner->first_ns < RUNNER_WARMUP_MS * 1000000ull) {
+            return false;
+        }
+        runner->measure_ns = now;
+        runner->start_preemptions = runner_preemptions();
+        return false;
+    }
+
+    if (runner->count == runner->capacity) {
+        runner->capacity = runner->capacity ? runner->capacity * 2 : 256;
+        runner->samples = (double *)realloc(runner->samples, runner->capacity * sizeof(double));
+    }
+    runner->samples[runner->count++] = value_ns;
+    runner->result.iterations += runner->batch;
+
+    // Sorting every sample would cost more than the benchmark; recheck the
+    // interval each time the sample count grows by a tenth.
+    if (runner->count >= runner->next_check) {
+        runner->relative_error = runner_relative_error(runner);
+        runner->next_check = runner->count + runner->count / 10 + 1;
+    }
+
+    runner->done = runner->count >= RUNNER_MIN_SAMPLES &&
+                   (runner->relative_error <= RUNNER_TARGET_ERROR ||
+                    runner->count >= RUNNER_MAX_SAMPLES ||
+                    now - runner->measure_ns >= RUNNER_MAX_MS * 1000000ull);
+    if (runner->done) {
+        runner->result.preemptions = runner_preemptions() - runner->start_preemptions;
+    }
+    return runner->done;
+}
+
+bool Runner_done(const Runner *runner) {
+    return runner->done;
+}
+
+static void runner_end_batch(Runner *runner) {
+    uint64_t elapsed = runner_now() - runner->batch_start_ns - runner->paused_ns;
+
+    if (runner->measure_ns != 0 && runner->counters) {
+        PerfCounters_stop(runner->counters);
+    }
+    runner->in_batch = false;
+
+    if (!runner->calibrated) {
+        if (elapsed < RUNNER_MIN_BATCH_US * 1000ull) {
+            runner->batch *= 2;
+            return;
+        }
+        runner->calibrated = true;
+    }
+    Runner_add(runner, (double)elapsed / (double)runner->batch);
+}
+
+// Closes the batch in flight and returns how many operations to run in the
+// next one, or 0 when done.
+uint64_t Runner_batch(Runner *runner) {
+    if (runner->in_batch) {
+        runner_end_batch(runner);
+    }
+    if (runner->done) {
+        return 0;
+    }
+
+    if (runner->first_ns == 0) {
+        runner->first_ns = runner_now();
+    }
+    runner->in_batch = true;
+    runner->paused_ns = 0;
+    if (runner->measure_ns != 0 && runner->counters) {
+        PerfCounters_start(runner->counters);
+    }
+    runner->batch_start_ns = runner_now();
+    return runner->batch;
+}
+
+// Excludes work between pause and resume (e.g. verification) from the batch.
+void Runner_pause(Runner *runner) {
+    runner->pause_start_ns = runner_now();
+    if (runner->measure_ns != 0 && runner->counters) {
+        PerfCounters_stop(runner->counters);
+    }
+}
+
+void Runner_resume(Runner *runner) {
+    if (runner->measure_ns != 0 && runner->counters) {
+        PerfCounters_start(runner->counters);
+    }
+    runner->paused_ns += runner_now() - runner->pause_start_ns;
+}
+
+// Summarises the samples: median with its 95% interval, outlier-rejected
+// mean, and the interference flags.
+RunnerResult *Runner_result(Runner *runner) {
+    RunnerResult *result = &runner->result;
+    size_t n = runner->count;
+
+    result->samples = n;
+    result->batch = runner->batch;
+    result->migrations = runner->migrations;
+    if (!runner->done) {
+        result->preemptions = runner->measure_ns ? runner_preemptions() - runner->start_preemptions : 0;
+    }
+    result->noise = 0;
+    if (n == 0) {
+        result->noise = RUNNER_NOISY_UNCONVERGED;
+        return result;
+    }
+
+    double *sorted = (double *)malloc(n * sizeof(double));
+    double *deviations = (double *)malloc(n * sizeof(double));
+
+    memcpy(sorted, runner->samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), runner_compare_doubles);
+    result->median = runner_median(sorted, n);
+    runner_median_ci(sorted, n, &result->ci_low, &result->ci_high);
+    result->relative_error = result->median > 0 ? (result->ci_high - result->ci_low) / 2.0 / result->median : INFINITY;
+
+    for (size_t i = 0; i < n; i++) {
+        deviations[i] = fabs(runner->samples[i] - result->median);
+    }
+    qsort(deviations, n, sizeof(double), runner_compare_doubles);
+    double mad = runner_median(deviations, n);
+
+    double total = 0;
+    size_t kept = 0;
+    result->outliers = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (mad > 0 && fabs(runner->samples[i] - result->median) > RUNNER_OUTLIER_MADS * mad) {
+            result->outliers++;
+        } else {
+            total += runner->samples[i];
+            kept++;
+        }
+    }
+    result->mean = kept ? total / (double)kept : result->median;
+
+    // Medians of the first and second half in sample order.
+    size_t half = n / 2;
+    result->drift = 0;
+    if (half >= RUNNER_MIN_SAMPLES / 2) {
+        memcpy(deviations, runner->samples, half * sizeof(double));
+        qsort(deviations, half, sizeof(double), runner_compare_doubles);
+        double first = runner_median(deviations, half);
+        memcpy(deviations, runner->samples + half, (n - half) * sizeof(double));
+        qsort(deviations, n - half, sizeof(double), runner_compare_doubles);
+        double second = runner_median(deviations, n - half);
+        result->drift = result->median > 0 ? (second - first) / result->median : 0;
+    }
+
+    if (fabs(result->drift) > RUNNER_DRIFT) result->noise |= RUNNER_NOISY_DRIFT;
+    if ((double)result->outliers > RUNNER_OUTLIER_SHARE * (double)n) result->noise |= RUNNER_NOISY_OUTLIERS;
+    if (result->migrations > 0) result->noise |= RUNNER_NOISY_MIGRATED;
+    if ((double)result->preemptions > RUNNER_PREEMPTIONS * (double)n) result->noise |= RUNNER_NOISY_PREEMPTED;
+    if (result->relative_error > RUNNER_TARGET_ERROR) result->noise |= RUNNER_NOISY_UNCONVERGED;
+
+    free(deviations);
+    free(sorted);
+    return result;
+}
+
+// Prints the summary with values scaled by `scale` (e.g. 1e-9 for seconds).
+void Runner_print(Runner *runner, double scale, const char *unit) {
+    RunnerResult *result = Runner_result(runner);
+
+    printf("%s: median %g %s, 95%% CI [%g, %g] (+-%.2f%%), %zu samples x %lu iterations, %zu outliers\n",
+           runner->name, result->median * scale, unit, result->ci_low * scale, result->ci_high * scale,
+           100.0 * result->relative_error, result->samples, result->batch, result->outliers);
+
+    if (result->noise) {
+        printf("%s: interference suspected:", runner->name);
+        if (result->noise & RUNNER_NOISY_DRIFT) printf(" median drifted %+.1f%%;", 100.0 * result->drift);
+        if (result->noise & RUNNER_NOISY_OUTLIERS) printf(" %zu outliers;", result->outliers);
+        if (result->noise & RUNNER_NOISY_MIGRATED) printf(" %d CPU migrations;", result->migrations);
+        if (result->noise & RUNNER_NOISY_PREEMPTED) printf(" %ld preemptions;", result->preemptions);
+        if (result->noise & RUNNER_NOISY_UNCONVERGED) printf(" did not reach +-%.1f%%;", 100.0 * RUNNER_TARGET_ERROR);
+        printf("\n");
+    }
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// A growable array of raw measurements (usually nanoseconds) with exact
+// quantiles, for distributions too small or too important to bucket.
+typedef struct {
+    uint64_t *values;
+    size_t count;
+    size_t capacity;
+    bool sorted;
+} Samples;
+
+void Samples_init(Samples *samples, size_t capacity) {
+    samples->capacity = capacity ? capacity : 16;
+    samples->values = (uint64_t *)malloc(samples->capacity * sizeof(uint64_t));
+    samples->count = 0;
+    samples->sorted = true;
+}
+
+void Samples_free(Samples *samples) {
+    free(samples->values);
+    samples->values = NULL;
+    samples->count = samples->capacity = 0;
+}
+
+void Samples_clear(Samples *samples) {
+    samples->count = 0;
+    samples->sorted = true;
+}
+
+void Samples_add(Samples *samples, uint64_t value) {
+    if (samples->count == samples->capacity) {
+        samples->capacity *= 2;
+        samples->values = (uint64_t *)realloc(samples->values, samples->capacity * sizeof(uint64_t));
+    }
+    samples->values[samples->count++] = value;
+    samples->sorted = false;
+}
+
+static int samples_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank quantile, 0 <= quantile <= 1. Sorts the samples on first use.
+uint64_t Samples_quantile(Samples *samples, double quantile) {
+    if (samples->count == 0) {
+        return 0;
+    }
+    if (!samples->sorted) {
+        qsort(samples->values, samples->count, sizeof(uint64_t), samples_compare);
+        samples->sorted = true;
+    }
+
+    size_t rank = (size_t)(quantile * (double)samples->count);
+    return samples->values[rank < samples->count ? rank : samples->count - 1];
+}
+
+double Samples_mean(const Samples *samples) {
+    double total = 0;
+    for (size_t i = 0; i < samples->count; i++) {
+        total += (double)samples->values[i];
+    }
+    return samples->count ? total / (double)samples->count : 0;
+}
+
+#endif
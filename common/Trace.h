@@ -0,0 +1,180 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Message traces recorded from a real service and replayed against the
+// benchmark transports.
+//
+// File format: the 8-byte magic TRACE_MAGIC, then one record per message,
+// each two LEB128 varints: the time since the previous record (ns), and
+// size << 1 | direction. Timestamps are relative to the first record.
+
+#define TRACE_MAGIC "IPCTRC01"
+
+typedef enum {
+    TRACE_REQUEST = 0,   // into the recorded service
+    TRACE_RESPONSE = 1,  // out of it
+} TraceDirection;
+
+typedef struct {
+    uint64_t timestamp_ns;
+    uint32_t size;
+    TraceDirection direction;
+} TraceRecord;
+
+typedef struct {
+    TraceRecord *records;
+    size_t count;
+} Trace;
+
+typedef struct {
+    FILE *file;
+    pthread_mutex_t lock;
+    bool started;
+    uint64_t start_ns;
+    uint64_t last_ns;
+} TraceRecorder;
+
+static uint64_t trace_now() {
+    struct timespec tms;
+    clock_gettime(CLOCK_MONOTONIC, &tms);
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
+}
+
+static void trace_put_varint(FILE *file, uint64_t value) {
+    uint8_t bytes[10];
+    int len = 0;
+
+    do {
+        bytes[len] = value & 0x7F;
+        value >>= 7;
+        bytes[len] |= value ? 0x80 : 0;
+        len++;
+    } while (value);
+
+    fwrite(bytes, 1, len, file);
+}
+
+static bool trace_get_varint(FILE *file, uint64_t *value) {
+    *value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF) {
+            return false;
+        }
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceRecorder_open(TraceRecorder *recorder, const char *path) {
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL) {
+        perror("TraceRecorder_open");
+        return false;
+    }
+
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), recorder->file);
+    pthread_mutex_init(&recorder->lock, NULL);
+    recorder->started = false;
+    recorder->start_ns = recorder->last_ns = 0;
+    return true;
+}
+
+// Records a message at the given CLOCK_MONOTONIC time. Safe to call from
+// several threads; records must arrive in time order.
+void TraceRecorder_record_at(TraceRecorder *recorder, uint64_t now_ns, TraceDirection direction, uint32_t size) {
+    pthread_mutex_lock(&recorder->lock);
+
+    if (!recorder->started) {
+        recorder->started = true;
+        recorder->start_ns = recorder->last_ns = now_ns;
+    }
+    if (now_ns < recorder->last_ns) {
+        now_ns = recorder->last_ns;
+    }
+
+    trace_put_varint(recorder->file, now_ns - recorder->last_ns);
+    trace_put_varint(recorder->file, ((uint64_t)size << 1) | direction);
+    recorder->last_ns = now_ns;
+
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+void TraceRecorder_record(TraceRecorder *recorder, TraceDirection direction, uint32_t size) {
+    TraceRecorder_record_at(recorder, trace_now(), direction, size);
+}
+
+void TraceRecorder_close(TraceRecorder *recorder) {
+    fclose(recorder->file);
+    pthread_mutex_destroy(&recorder->lock);
+}
+
+bool Trace_load(Trace *trace, const char *path) {
+    FILE *file = fopen(path, "rb");
+    char magic[sizeof(TRACE_MAGIC)] = { 0 };
+    size_t capacity = 1024;
+    uint64_t timestamp = 0;
+
+    trace->records = NULL;
+    trace->count = 0;
+
+    if (file == NULL) {
+        perror("Trace_load");
+        return false;
+    }
+    if (fread(magic, 1, strlen(TRACE_MAGIC), file) != strlen(TRACE_MAGIC) || strcmp(magic, TRACE_MAGIC) != 0) {
+        fprintf(stderr, "Trace_load: %s is not a trace file\n", path);
+        fclose(file);
+        return false;
+    }
+
+    trace->records = (TraceRecord *)malloc(capacity * sizeof(TraceRecord));
+
+    uint64_t delta, size_and_direction;
+    while (trace_get_varint(file, &delta) && trace_get_varint(file, &size_and_direction)) {
+        if (trace->count == capacity) {
+            capacity *= 2;
+            trace->records = (TraceRecord *)realloc(trace->records, capacity * sizeof(TraceRecord));
+        }
+
+        timestamp += delta;
+        TraceRecord *record = &trace->records[trace->count++];
+        record->timestamp_ns = timestamp;
+        record->size = (uint32_t)(size_and_direction >> 1);
+        record->direction = (TraceDirection)(size_and_direction & 1);
+    }
+
+    fclose(file);
+    return true;
+}
+
+void Trace_free(Trace *trace) {
+    free(trace->records);
+    trace->records = NULL;
+    trace->count = 0;
+}
+
+// When a record is due during replay: its timestamp divided by `speed`
+// after `start_ns`. A speed of 0 replays as fast as possible.
+uint64_t Trace_due(const TraceRecord *record, uint64_t start_ns, double speed) {
+    return speed > 0 ? start_ns + (uint64_t)((double)record->timestamp_ns / speed) : trace_now();
+}
+
+void Trace_sleep_until(uint64_t deadline_ns) {
+    struct timespec tms = { (time_t)(deadline_ns / 1000000000ull), (long)(deadline_ns % 1000000000ull) };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tms, NULL);
+}
+
+#endif
@@ -0,0 +1,300 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "PhaseStats.h"
+#include "../common/PerfCounters.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Results.h"
+
+#define BROADCAST_SLOT_SIZE 256
+#define BROADCAST_MAX_READERS 64
+
+// One message slot. `seq` is 2 * n while message n is published and
+// 2 * n - 1 while the writer is overwriting the slot with message n.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t seq;
+    int len;
+    uint8_t data[BROADCAST_SLOT_SIZE];
+} BroadcastSlot;
+
+typedef struct {
+    _Alignas(64) uint64_t received;
+    uint64_t lost;
+    uint64_t total_latency_ns;
+    uint64_t max_latency_ns;
+} BroadcastReaderStats;
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t write_seq;
+    int slots;
+    _Atomic int closed;
+    _Atomic int ready_readers;
+    BroadcastReaderStats stats[BROADCAST_MAX_READERS];
+    BroadcastSlot ring[];
+} BroadcastRegion;
+
+typedef struct {
+    BroadcastRegion *region;
+    uint64_t seq;
+} BroadcastWriter;
+
+typedef struct {
+    BroadcastRegion *region;
+    uint64_t cursor;
+    uint64_t lost;
+    bool closed;
+} BroadcastReader;
+
+size_t BroadcastRing_region_size(int slots) {
+    return sizeof(BroadcastRegion) + (size_t)slots * sizeof(BroadcastSlot);
+}
+
+void BroadcastWriter_init(BroadcastWriter *writer, uint8_t *ptr, int slots) {
+    BroadcastRegion *region = (BroadcastRegion *)ptr;
+    memset(region, 0, BroadcastRing_region_size(slots));
+    region->slots = slots;
+
+    writer->region = region;
+    writer->seq = 0;
+}
+
+void BroadcastWriter_close(BroadcastWriter *writer) {
+    atomic_store_explicit(&writer->region->closed, 1, memory_order_release);
+}
+
+// The writer never waits for readers: a reader that falls more than
+// `slots` messages behind finds its slot overwritten and reports a gap.
+void BroadcastWriter_publish(BroadcastWriter *writer, const uint8_t *bytes, int len) {
+    BroadcastRegion *region = writer->region;
+    uint64_t seq = ++writer->seq;
+    BroadcastSlot *slot = &region->ring[(seq - 1) % region->slots];
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
+
+    atomic_store_explicit(&slot->seq, 2 * seq - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(slot->data, bytes, len);
+    slot->len = len;
+    PhaseTimer_mark(&timer, PHASE_BROADCAST, PHASE_COPY);
+
+    atomic_store_explicit(&slot->seq, 2 * seq, memory_order_release);
+    atomic_store_explicit(&region->write_seq, seq, memory_order_release);
+    PhaseTimer_mark(&timer, PHASE_BROADCAST, PHASE_PUBLISH);
+}
+
+void BroadcastReader_init(BroadcastReader *reader, uint8_t *ptr) {
+    reader->region = (BroadcastRegion *)ptr;
+    reader->cursor = atomic_load_explicit(&reader->region->write_seq, memory_order_acquire) + 1;
+    reader->lost = 0;
+    reader->closed = false;
+}
+
+// Skips to the oldest message still held by the ring after an overrun.
+static void BroadcastReader_resync(BroadcastReader *reader) {
+    BroadcastRegion *region = reader->region;
+    uint64_t head = atomic_load_explicit(&region->write_seq, memory_order_acquire);
+    uint64_t oldest = head >= (uint64_t)region->slots ? head - region->slots + 2 : 1;
+
+    if (oldest > reader->cursor) {
+        reader->lost += oldest - reader->cursor;
+        reader->cursor = oldest;
+    }
+}
+
+int BroadcastReader_read(BroadcastReader *reader, uint8_t *out_data, int max_size) {
+    if (reader->closed) {
+        return -1;
+    }
+
+    BroadcastRegion *region = reader->region;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+    while (true) {
+        BroadcastSlot *slot = &region->ring[(reader->cursor - 1) % region->slots];
+        uint64_t expected = 2 * reader->cursor;
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        if (seq < expected) {
+            if (atomic_load_explicit(&region->closed, memory_order_acquire) &&
+                atomic_load_explicit(&region->write_seq, memory_order_acquire) < reader->cursor) {
+                reader->closed = true;
+                return -1;
+            }
+            continue;
+        }
+
+        if (seq > expected) {
+            BroadcastReader_resync(reader);
+            continue;
+        }
+
+        PhaseTimer_mark(&timer, PHASE_BROADCAST, PHASE_WAIT);
+
+        int len = slot->len;
+        if (len > max_size) {
+            len = max_size;
+        }
+        memcpy(out_data, slot->data, len);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != expected) {
+            BroadcastReader_resync(reader);
+            continue;
+        }
+
+        PhaseTimer_mark(&timer, PHASE_BROADCAST, PHASE_COPY);
+        reader->cursor++;
+        return len;
+    }
+}
+
+static void broadcast_reader_process(uint8_t *ptr, int id) {
+    BroadcastRegion *region = (BroadcastRegion *)ptr;
+    BroadcastReaderStats *stats = &region->stats[id];
+    BroadcastReader reader;
+    uint8_t data[BROADCAST_SLOT_SIZE];
+
+    BroadcastReader_init(&reader, ptr);
+    atomic_fetch_add(&region->ready_readers, 1);
+
+    while (BroadcastReader_read(&reader, data, sizeof(data)) > 0) {
+        uint64_t sent;
+        memcpy(&sent, data, sizeof(sent));
+        uint64_t latency = getCurTimeNs() - sent;
+
+        stats->received++;
+        stats->total_latency_ns += latency;
+        if (latency > stats->max_latency_ns) {
+            stats->max_latency_ns = latency;
+        }
+    }
+
+    stats->lost = reader.lost;
+
+    if (id == 0) {
+        PhaseStats_dump("broadcast reader 0");
+    }
+}
+
+// Publishes `number_of_messages` timestamped messages to `readers` forked
+// subscribers. result: average latency (s), max latency (s),
+// delivered messages per second over all readers, lost messages (%),
+// CPU-seconds per GB delivered.
+double* compute_fanout_Broadcast(uint8_t *ptr, int slots, int readers, uint64_t number_of_messages) {
+    double *result = (double *)malloc(5 * sizeof(double));
+    BroadcastWriter writer;
+    BroadcastWriter_init(&writer, ptr, slots);
+    BroadcastRegion *region = writer.region;
+
+    ResourceUsage start, end, self, peers = { 0 };
+    ResourceUsage_thread(&start);
+
+    pid_t *children = (pid_t *)malloc(readers * sizeof(pid_t));
+    fflush(stdout);
+    for (int r = 0; r < readers; r++) {
+        children[r] = fork();
+        if (children[r] == 0) {
+            broadcast_reader_process(ptr, r);
+            exit(0);
+        }
+    }
+
+    while (atomic_load(&region->ready_readers) < readers) {}
+
+    uint8_t data[128];
+    for (uint64_t i = 0; i < sizeof(data); i++) {
+        data[i] = i;
+    }
+
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    PerfCounters_start(&counters);
+
+    uint64_t startTime = getCurTimeNs();
+    for (uint64_t k = 0; k < number_of_messages; k++) {
+        uint64_t now = getCurTimeNs();
+        memcpy(data, &now, sizeof(now));
+        BroadcastWriter_publish(&writer, data, sizeof(data));
+    }
+    BroadcastWriter_close(&writer);
+    PerfCounters_stop(&counters);
+
+    for (int r = 0; r < readers; r++) {
+        ResourceUsage child;
+        ResourceUsage_wait(children[r], &child);
+        ResourceUsage_add(&peers, &child);
+    }
+    uint64_t endTime = getCurTimeNs();
+    ResourceUsage_thread(&end);
+    ResourceUsage_sub(&self, &end, &start);
+    PhaseStats_dump("broadcast writer");
+    PerfCounters_print(&counters, "broadcast writer", number_of_messages, "message");
+    PerfCounters_close(&counters);
+
+    uint64_t received = 0, lost = 0, total_latency = 0, max_latency = 0;
+    for (int r = 0; r < readers; r++) {
+        received += region->stats[r].received;
+        lost += region->stats[r].lost;
+        total_latency += region->stats[r].total_latency_ns;
+        if (region->stats[r].max_latency_ns > max_latency) {
+            max_latency = region->stats[r].max_latency_ns;
+        }
+    }
+
+    result[0] = received ? (double)total_latency / (double)received / 1000000000.0 : 0;
+    result[1] = (double)max_latency / 1000000000.0;
+    result[2] = (double)received / ((double)(endTime - startTime) / 1000000000.0);
+    result[3] = 100.0 * (double)lost / (double)(number_of_messages * readers);
+    result[4] = ResourceUsage_cpu_per_gb(&self, &peers, received * sizeof(data));
+
+    printf("Readers: %d, Latency: %f s, Fan-out: %f msg/s, Lost: %f %%\n", readers, result[0], result[2], result[3]);
+    ResourceUsage_print("broadcast writer and readers", &self, &peers, received * sizeof(data));
+
+    free(children);
+    return result;
+}
+
+// Each reader count runs NUMBER_OF_EXPERIMENTS times with 10000 messages,
+// one sample per run; the table shows the mean of the runs.
+void run_benchmark_Broadcast(const char *name, uint8_t *ptr, int slots, const int *reader_counts, int number_of_counts) {
+    printf("Starting benchmark for method: %s\n", name);
+
+    double *results[number_of_counts][NUMBER_OF_EXPERIMENTS];
+    for (int i = 0; i < number_of_counts; i++) {
+        for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+            results[i][e] = compute_fanout_Broadcast(ptr, slots, reader_counts[i], 10000);
+        }
+    }
+
+    printf("Mean of %d experiments\n", NUMBER_OF_EXPERIMENTS);
+    printf("+---------+--------------+--------------+--------------------+----------+------------+\n");
+    printf("| Readers | Latency (us) | Max lat (us) | Fan-out (msg/s)    | Lost (%%) | CPU s / GB |\n");
+    printf("+---------+--------------+--------------+--------------------+----------+------------+\n");
+    for (int i = 0; i < number_of_counts; i++) {
+        char variant[32];
+        double mean[5];
+        snprintf(variant, sizeof(variant), "readers=%d", reader_counts[i]);
+        mean[0] = Results_record_column(name, variant, "latency", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 0);
+        mean[1] = Results_record_column(name, variant, "max_latency", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 1);
+        mean[2] = Results_record_column(name, variant, "fanout", "msg/s", false, results[i], NUMBER_OF_EXPERIMENTS, 2);
+        mean[3] = Results_record_column(name, variant, "lost", "%", true, results[i], NUMBER_OF_EXPERIMENTS, 3);
+        mean[4] = Results_record_column(name, variant, "cpu_per_gb", "s/GB", true, results[i], NUMBER_OF_EXPERIMENTS, 4);
+
+        printf("| %7d | %12.3lf | %12.3lf | %18.1lf | %8.3lf | %10.3lf |\n", reader_counts[i],
+               mean[0] * 1000000.0, mean[1] * 1000000.0, mean[2], mean[3], mean[4]);
+        for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+            free(results[i][e]);
+        }
+    }
+    printf("+---------+--------------+--------------+--------------------+----------+------------+\n");
+}
@@ -0,0 +1,249 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Settings.h"
+#include "EchoPeer.h"
+#include "../common/HostInfo.h"
+#include "../common/Samples.h"
+
+// A transport profile of this host: latency and throughput by message size
+// for every channel kind, measured by a quick sweep (lab2 --calibrate) and
+// saved as CSV. Channel_open reads it to pick the transport for a message
+// size and latency budget, so the choice follows the hardware instead of a
+// table someone read once. The profile names the host it was taken on and
+// loading it elsewhere prints a warning to recalibrate.
+
+#define PROFILE_MAX_ENTRIES 256
+
+typedef struct {
+    char transport[32];
+    int size;
+    double latency;       // s, one way (half the median round trip)
+    double throughput;    // MB/s, both directions, as in the benchmarks
+} ProfileEntry;
+
+typedef struct {
+    char host[512];          // holds any profile_host_id() and any "# host=" line
+    ProfileEntry entries[PROFILE_MAX_ENTRIES];
+    int count;
+} Profile;
+
+// What identifies the machine for the profile: a change of CPU, CPU count
+// or kernel invalidates it.
+static void profile_host_id(char *out, size_t len) {
+    HostInfo host;
+    HostInfo_collect(&host);
+    snprintf(out, len, "%s; %s; %ld CPUs; %s", host.hostname, host.cpu_model, host.online_cpus, host.kernel);
+    out[strcspn(out, "\n")] = '\0';
+}
+
+void Profile_init(Profile *profile) {
+    memset(profile, 0, sizeof(*profile));
+    profile_host_id(profile->host, sizeof(profile->host));
+}
+
+static void profile_add(Profile *profile, const ProfileEntry *entry) {
+    if (profile->count < PROFILE_MAX_ENTRIES) {
+        profile->entries[profile->count++] = *entry;
+    }
+}
+
+bool Profile_save(const Profile *profile, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return false;
+    }
+
+    fprintf(out, "# lab2 transport profile\n# host=%s\ntransport,size,latency_s,throughput_mb_s\n", profile->host);
+    for (int i = 0; i < profile->count; i++) {
+        const ProfileEntry *entry = &profile->entries[i];
+        fprintf(out, "%s,%d,%.9f,%.3f\n", entry->transport, entry->size, entry->latency, entry->throughput);
+    }
+    fclose(out);
+    return true;
+}
+
+bool Profile_load(Profile *profile, const char *path) {
+    FILE *in = fopen(path, "r");
+    char line[512];
+
+    memset(profile, 0, sizeof(*profile));
+    if (in == NULL) {
+        perror(path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), in)) {
+        ProfileEntry entry;
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "# host=", 7) == 0) {
+            snprintf(profile->host, sizeof(profile->host), "%s", line + 7);
+        } else if (sscanf(line, "%31[^,],%d,%lf,%lf", entry.transport, &entry.size, &entry.latency, &entry.throughput) == 4) {
+            profile_add(profile, &entry);
+        }
+    }
+    fclose(in);
+
+    if (profile->count == 0) {
+        fprintf(stderr, "%s: no profile entries\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool Profile_matches_host(const Profile *profile) {
+    char host[sizeof(profile->host)];
+    profile_host_id(host, sizeof(host));
+    return strcmp(host, profile->host) == 0;
+}
+
+// Latency and throughput of `transport` at `size`, interpolated on a log
+// scale between the calibrated sizes and clamped outside them. False if
+// the profile has nothing for it.
+bool Profile_estimate(const Profile *profile, const char *transport, int size, double *latency, double *throughput) {
+    const ProfileEntry *below = NULL, *above = NULL;
+
+    for (int i = 0; i < profile->count; i++) {
+        const ProfileEntry *entry = &profile->entries[i];
+        if (strcmp(entry->transport, transport) != 0) {
+            continue;
+        }
+        if (entry->size <= size && (below == NULL || entry->size > below->size)) {
+            below = entry;
+        }
+        if (entry->size >= size && (above == NULL || entry->size < above->size)) {
+            above = entry;
+        }
+    }
+    if (below == NULL && above == NULL) {
+        return false;
+    }
+    if (below == NULL || above == NULL || below->size == above->size) {
+        const ProfileEntry *entry = below ? below : above;
+        *latency = entry->latency;
+        *throughput = entry->throughput;
+        return true;
+    }
+
+    double t = (log((double)size) - log((double)below->size)) / (log((double)above->size) - log((double)below->size));
+    *latency = below->latency + t * (above->latency - below->latency);
+    *throughput = below->throughput + t * (above->throughput - below->throughput);
+    return true;
+}
+
+// The transport for messages of `size` bytes: the highest-throughput one
+// whose latency stays within `latency_budget` seconds, or the lowest-latency
+// one if none does or the budget is 0. NULL for an empty profile.
+const char *Profile_choose(const Profile *profile, int size, double latency_budget) {
+    const char *fastest = NULL, *widest = NULL;
+    double best_latency = 0, best_throughput = 0;
+
+    for (int k = 0; k < CHANNEL_KIND_COUNT; k++) {
+        double latency, throughput;
+        if (!Profile_estimate(profile, CHANNEL_KINDS[k].name, size, &latency, &throughput)) {
+            continue;
+        }
+        if (fastest == NULL || latency < best_latency) {
+            fastest = CHANNEL_KINDS[k].name;
+            best_latency = latency;
+        }
+        if (latency_budget > 0 && latency <= latency_budget && (widest == NULL || throughput > best_throughput)) {
+            widest = CHANNEL_KINDS[k].name;
+            best_throughput = throughput;
+        }
+    }
+    return widest ? widest : fastest;
+}
+
+// Opens the channel the profile recommends for `size` and `latency_budget`
+// (see Profile_choose). False if the profile has no usable transport.
+bool Channel_open(Channel *channel, const Profile *profile, int size, double latency_budget) {
+    const char *name = Profile_choose(profile, size, latency_budget);
+    const ChannelKind *kind = name ? ChannelKind_find(name) : NULL;
+    return kind != NULL && Channel_open_kind(channel, kind, size);
+}
+
+// Times round trips of `size` bytes on an open channel with a running peer
+// for up to CALIBRATION_MS each for latency and for throughput.
+static void calibrate_channel(Channel *channel, int size, ProfileEntry *entry) {
+    Transport *transport = &channel->transport;
+    uint8_t *data = (uint8_t *)calloc(size, 1);
+    uint8_t *response = (uint8_t *)malloc(size);
+    uint64_t budget = CALIBRATION_MS * 1000000ull;
+    Samples round_trips;
+    Samples_init(&round_trips, CALIBRATION_ROUND_TRIPS);
+
+    for (int k = 0; k < CALIBRATION_WARMUP; k++) {
+        transport->write(transport->io, data, size);
+        transport->read(transport->io, response, size);
+    }
+
+    uint64_t startTime = getCurTimeNs();
+    for (int k = 0; k < CALIBRATION_ROUND_TRIPS && (k < 10 || getCurTimeNs() - startTime < budget); k++) {
+        uint64_t sent = getCurTimeNs();
+        transport->write(transport->io, data, size);
+        transport->read(transport->io, response, size);
+        Samples_add(&round_trips, getCurTimeNs() - sent);
+    }
+
+    uint64_t messages = 0;
+    startTime = getCurTimeNs();
+    while (messages < 10 || getCurTimeNs() - startTime < budget) {
+        transport->write(transport->io, data, size);
+        transport->read(transport->io, response, size);
+        messages++;
+    }
+    double seconds = (double)(getCurTimeNs() - startTime) / 1000000000.0;
+
+    snprintf(entry->transport, sizeof(entry->transport), "%s", channel->kind->name);
+    entry->size = size;
+    entry->latency = (double)Samples_quantile(&round_trips, 0.5) / 2 / 1000000000.0;
+    entry->throughput = 2.0 * (double)messages * size / (1024.0 * 1024.0) / seconds;
+
+    Samples_free(&round_trips);
+    free(response);
+    free(data);
+}
+
+// Runs the sweep over every channel kind and CALIBRATION_SIZES with forked
+// echo peers. Kinds that cannot open on this host are left out.
+void Profile_calibrate(Profile *profile) {
+    const int sizes[] = CALIBRATION_SIZES;
+    const int number_of_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    int packet_size = settings.packet_size;
+
+    Profile_init(profile);
+    printf("Calibrating on %s\n", profile->host);
+    printf("+----------------+------------+--------------+-------------------+\n");
+    printf("| Transport      |  Size (B)  | Latency (us) | Throughput (MB/s) |\n");
+    printf("+----------------+------------+--------------+-------------------+\n");
+
+    for (int k = 0; k < CHANNEL_KIND_COUNT; k++) {
+        for (int s = 0; s < number_of_sizes; s++) {
+            Channel channel;
+            EchoPeer peer;
+            ProfileEntry entry;
+
+            settings.packet_size = sizes[s];
+            if (!Channel_open_kind(&channel, &CHANNEL_KINDS[k], sizes[s])) {
+                printf("| %-14s | %10s | %12s | %17s |\n", CHANNEL_KINDS[k].name, "-", "unavailable", "-");
+                break;
+            }
+            EchoPeer_start(&peer, EXEC_PROCESS, channel.echo, channel.peer_io);
+            calibrate_channel(&channel, sizes[s], &entry);
+            channel.transport.close(channel.transport.io);
+            EchoPeer_join(&peer);
+            Channel_close(&channel);
+
+            profile_add(profile, &entry);
+            printf("| %-14s | %10d | %12.3lf | %17.1lf |\n", entry.transport, entry.size, entry.latency * 1000000.0,
+                   entry.throughput);
+            fflush(stdout);
+        }
+    }
+    printf("+----------------+------------+--------------+-------------------+\n");
+    settings.packet_size = packet_size;
+}
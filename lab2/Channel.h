@@ -0,0 +1,261 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "Transport.h"
+
+// Every request/response transport behind one open/close pair, so code that
+// only needs "a channel to a peer" can be handed whichever transport is
+// fastest on this host (see Calibration.h). A channel is both ends in this
+// process: `transport` is this side; `peer_io` and `echo` are for the peer,
+// which is started with EchoPeer_start after the channel is opened and must
+// be joined before Channel_close.
+
+#define CHANNEL_FILE "channel.txt"
+
+typedef struct Channel Channel;
+
+typedef struct {
+    const char *name;                             // as in the sweep and the profile
+    bool (*open)(Channel *channel);   // false if unavailable on this host
+    void (*close)(Channel *channel);
+} ChannelKind;
+
+struct Channel {
+    const ChannelKind *kind;
+    Transport transport;
+    void *peer_io;
+    void *(*echo)(void *);
+    void *state;
+};
+
+typedef struct {
+    FileIO ends[2];
+} FileChannel;
+
+typedef struct {
+    MmapIO ends[2];
+    uint8_t *ptr;
+    size_t size;
+} MmapChannel;
+
+typedef struct {
+    SharedIO ends[2];
+    shm_t *shm;
+} SharedChannel;
+
+typedef struct {
+    CmaIO ends[2];
+    uint8_t *control;
+} CmaChannel;
+
+typedef struct {
+    PipeIO ends[2];
+} PipeChannel;
+
+typedef struct {
+    SocketIO ends[2];
+} SocketChannel;
+
+// Shared with a forked peer without a name to clean up afterwards.
+static uint8_t *channel_map(size_t size) {
+    uint8_t *ptr = (uint8_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    return ptr;
+}
+
+static bool channel_open_file(Channel *channel) {
+    FileChannel *state = (FileChannel *)malloc(sizeof(FileChannel));
+    FileIO_open(&state->ends[0], CHANNEL_FILE, 1);
+    FileIO_open(&state->ends[1], CHANNEL_FILE, 2);
+    channel->transport = FileIO_transport(channel->kind->name, &state->ends[0]);
+    channel->peer_io = &state->ends[1];
+    channel->echo = echo_fileIO;
+    channel->state = state;
+    return true;
+}
+
+static void channel_close_file(Channel *channel) {
+    FileChannel *state = (FileChannel *)channel->state;
+    fclose(state->ends[0].file);
+    fclose(state->ends[1].file);
+    unlink(CHANNEL_FILE);
+    free(state);
+}
+
+static bool channel_open_mmap(Channel *channel) {
+    MmapChannel *state = (MmapChannel *)malloc(sizeof(MmapChannel));
+    state->size = sizeof(int) * 2 + message_capacity();
+    if ((state->ptr = channel_map(state->size)) == NULL) {
+        free(state);
+        return false;
+    }
+    MmapIO_init(&state->ends[0], state->ptr, 1);
+    MmapIO_init(&state->ends[1], state->ptr, 2);
+    channel->transport = MmapIO_transport(channel->kind->name, &state->ends[0]);
+    channel->peer_io = &state->ends[1];
+    channel->echo = echo_MmapIO;
+    channel->state = state;
+    return true;
+}
+
+static void channel_close_mmap(Channel *channel) {
+    MmapChannel *state = (MmapChannel *)channel->state;
+    munmap(state->ptr, state->size);
+    free(state);
+}
+
+static bool channel_open_shared(Channel *channel) {
+    SharedChannel *state = (SharedChannel *)malloc(sizeof(SharedChannel));
+    if ((state->shm = shm_new(message_capacity() + 8)) == NULL) {
+        free(state);
+        return false;
+    }
+    SharedIO_init(&state->ends[0], state->shm, 1);
+    SharedIO_init(&state->ends[1], state->shm, 2);
+    // The segment goes away with its last attachment, forked peer included.
+    shmctl(state->shm->id, IPC_RMID, NULL);
+    channel->transport = SharedIO_transport(channel->kind->name, &state->ends[0]);
+    channel->peer_io = &state->ends[1];
+    channel->echo = echo_SharedIO;
+    channel->state = state;
+    return true;
+}
+
+static void channel_close_shared(Channel *channel) {
+    SharedChannel *state = (SharedChannel *)channel->state;
+    shmdt(state->ends[0].shm_data);
+    shmdt(state->ends[1].shm_data);
+    shm_del(state->shm);
+    free(state);
+}
+
+static bool channel_open_cma(Channel *channel) {
+    if (!CmaIO_available()) {
+        return false;
+    }
+    CmaChannel *state = (CmaChannel *)malloc(sizeof(CmaChannel));
+    if ((state->control = channel_map(4096)) == NULL) {
+        free(state);
+        return false;
+    }
+    CmaIO_init(&state->ends[0], state->control, 1);
+    CmaIO_init(&state->ends[1], state->control, 2);
+    channel->transport = CmaIO_transport(channel->kind->name, &state->ends[0]);
+    channel->peer_io = &state->ends[1];
+    channel->echo = echo_CmaIO;
+    channel->state = state;
+    return true;
+}
+
+static void channel_close_cma(Channel *channel) {
+    CmaChannel *state = (CmaChannel *)channel->state;
+    munmap(state->control, 4096);
+    free(state);
+}
+
+static bool channel_open_pipe(Channel *channel) {
+    PipeChannel *state = (PipeChannel *)malloc(sizeof(PipeChannel));
+    if (!PipeIO_init_pair(&state->ends[0], &state->ends[1])) {
+        free(state);
+        return false;
+    }
+    channel->transport = PipeIO_transport(channel->kind->name, &state->ends[0]);
+    channel->peer_io = &state->ends[1];
+    channel->echo = echo_PipeIO;
+    channel->state = state;
+    return true;
+}
+
+static void channel_close_pipe(Channel *channel) {
+    PipeChannel *state = (PipeChannel *)channel->state;
+    PipeIO_release(&state->ends[0]);
+    PipeIO_release(&state->ends[1]);
+    free(state);
+}
+
+static bool channel_open_socket(Channel *channel, SocketKind kind) {
+    SocketChannel *state = (SocketChannel *)malloc(sizeof(SocketChannel));
+    if (!SocketIO_open_pair(&state->ends[0], &state->ends[1], kind)) {
+        free(state);
+        return false;
+    }
+    channel->transport = SocketIO_transport(channel->kind->name, &state->ends[0]);
+    channel->peer_io = &state->ends[1];
+    channel->echo = echo_SocketIO;
+    channel->state = state;
+    return true;
+}
+
+static bool channel_open_socketpair(Channel *channel) {
+    return channel_open_socket(channel, SOCKET_PAIR);
+}
+
+static bool channel_open_unix_stream(Channel *channel) {
+    return channel_open_socket(channel, SOCKET_UNIX_STREAM);
+}
+
+static bool channel_open_unix_seqpacket(Channel *channel) {
+    return channel_open_socket(channel, SOCKET_UNIX_SEQPACKET);
+}
+
+static bool channel_open_tcp(Channel *channel) {
+    return channel_open_socket(channel, SOCKET_TCP);
+}
+
+static void channel_close_socket(Channel *channel) {
+    SocketChannel *state = (SocketChannel *)channel->state;
+    SocketIO_release(&state->ends[0]);
+    SocketIO_release(&state->ends[1]);
+    free(state);
+}
+
+static const ChannelKind CHANNEL_KINDS[] = {
+    { "file_io", channel_open_file, channel_close_file },
+    { "mmap_io", channel_open_mmap, channel_close_mmap },
+    { "shares_io", channel_open_shared, channel_close_shared },
+    { "cma_io", channel_open_cma, channel_close_cma },
+    { "pipe_io", channel_open_pipe, channel_close_pipe },
+    { "socketpair", channel_open_socketpair, channel_close_socket },
+    { "unix_stream", channel_open_unix_stream, channel_close_socket },
+    { "unix_seqpacket", channel_open_unix_seqpacket, channel_close_socket },
+    { "tcp_loopback", channel_open_tcp, channel_close_socket },
+};
+
+#define CHANNEL_KIND_COUNT (int)(sizeof(CHANNEL_KINDS) / sizeof(CHANNEL_KINDS[0]))
+
+const ChannelKind *ChannelKind_find(const char *name) {
+    for (int k = 0; k < CHANNEL_KIND_COUNT; k++) {
+        if (strcmp(CHANNEL_KINDS[k].name, name) == 0) {
+            return &CHANNEL_KINDS[k];
+        }
+    }
+    return NULL;
+}
+
+// Opens a channel for messages of up to `capacity` bytes. The channels and
+// the echo peers size their buffers by message_capacity(), which follows
+// PACKET_SIZE, so a `capacity` above it is refused.
+bool Channel_open_kind(Channel *channel, const ChannelKind *kind, int capacity) {
+    if (capacity > message_capacity()) {
+        fprintf(stderr, "%s: %d-byte messages do not fit a %d-byte packet_size\n", kind->name, capacity, PACKET_SIZE);
+        return false;
+    }
+    memset(channel, 0, sizeof(*channel));
+    channel->kind = kind;
+    return kind->open(channel);
+}
+
+void Channel_close(Channel *channel) {
+    channel->kind->close(channel);
+    channel->state = NULL;
+}
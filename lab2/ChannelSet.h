@@ -0,0 +1,351 @@
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "PhaseStats.h"
+#include "../common/PerfCounters.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Results.h"
+
+#define CHANNEL_SLOT_SIZE 64
+#define CHANNEL_SPIN_SCANS 100
+
+typedef enum {
+    CHANNELSET_DOORBELL,
+    CHANNELSET_POLL,
+} ChannelSetMode;
+
+typedef struct {
+    _Alignas(64) _Atomic int full;
+    int len;
+    uint8_t data[CHANNEL_SLOT_SIZE];
+} ChannelSlot;
+
+typedef struct {
+    uint64_t received;
+    uint64_t average_latency_ns;
+    uint64_t p99_latency_ns;
+    uint64_t max_latency_ns;
+    uint64_t cpu_ns;
+    uint64_t wall_ns;
+} ChannelSetStats;
+
+// A set of single-slot channels sharing one doorbell bitmap. Producers set
+// their channel's bit and only issue a futex wake when the consumer has
+// announced that it is parked.
+typedef struct {
+    _Alignas(64) _Atomic uint32_t futex;
+    _Atomic int parked;
+    _Atomic int closed;
+    int channels;
+    int words;
+    ChannelSetStats stats;
+    _Alignas(64) _Atomic uint64_t doorbell[];
+} ChannelSetRegion;
+
+typedef struct {
+    ChannelSetRegion *region;
+    ChannelSlot *slots;
+} ChannelSet;
+
+static size_t channelset_doorbell_size(int channels) {
+    size_t words = (channels + 63) / 64;
+    return (words * sizeof(uint64_t) + 63) & ~(size_t)63;
+}
+
+size_t ChannelSet_region_size(int channels) {
+    return sizeof(ChannelSetRegion) + channelset_doorbell_size(channels) + (size_t)channels * sizeof(ChannelSlot);
+}
+
+void ChannelSet_attach(ChannelSet *set, uint8_t *ptr) {
+    set->region = (ChannelSetRegion *)ptr;
+    set->slots = (ChannelSlot *)(ptr + sizeof(ChannelSetRegion) + channelset_doorbell_size(set->region->channels));
+}
+
+void ChannelSet_init(ChannelSet *set, uint8_t *ptr, int channels) {
+    memset(ptr, 0, ChannelSet_region_size(channels));
+    ChannelSetRegion *region = (ChannelSetRegion *)ptr;
+    region->channels = channels;
+    region->words = (channels + 63) / 64;
+    ChannelSet_attach(set, ptr);
+}
+
+static void channelset_wake(ChannelSetRegion *region) {
+    if (atomic_load(&region->parked)) {
+        atomic_fetch_add(&region->futex, 1);
+        syscall(SYS_futex, &region->futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+// Waits for the channel's previous message to be consumed, then publishes.
+void ChannelSet_send(ChannelSet *set, int channel, const uint8_t *bytes, int len) {
+    ChannelSlot *slot = &set->slots[channel];
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
+
+    while (atomic_load_explicit(&slot->full, memory_order_acquire)) {}
+    PhaseTimer_mark(&timer, PHASE_CHANNELSET, PHASE_WAIT);
+
+    memcpy(slot->data, bytes, len);
+    slot->len = len;
+    PhaseTimer_mark(&timer, PHASE_CHANNELSET, PHASE_COPY);
+
+    atomic_store_explicit(&slot->full, 1, memory_order_release);
+    atomic_fetch_or(&set->region->doorbell[channel / 64], 1ull << (channel % 64));
+    channelset_wake(set->region);
+    PhaseTimer_mark(&timer, PHASE_CHANNELSET, PHASE_PUBLISH);
+}
+
+void ChannelSet_close(ChannelSet *set) {
+    atomic_store(&set->region->closed, 1);
+    atomic_fetch_add(&set->region->futex, 1);
+    syscall(SYS_futex, &set->region->futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+int ChannelSet_receive(ChannelSet *set, int channel, uint8_t *out_data, int max_size) {
+    ChannelSlot *slot = &set->slots[channel];
+    int len = slot->len < max_size ? slot->len : max_size;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+    memcpy(out_data, slot->data, len);
+    PhaseTimer_mark(&timer, PHASE_CHANNELSET, PHASE_COPY);
+
+    atomic_store_explicit(&slot->full, 0, memory_order_release);
+    PhaseTimer_mark(&timer, PHASE_CHANNELSET, PHASE_PUBLISH);
+
+    return len;
+}
+
+// Collects up to `max_ready` channels whose doorbell bit is set, clearing
+// the bits it takes.
+int ChannelSet_poll(ChannelSet *set, int *ready, int max_ready) {
+    ChannelSetRegion *region = set->region;
+    int count = 0;
+
+    for (int w = 0; w < region->words && count < max_ready; w++) {
+        if (!atomic_load_explicit(&region->doorbell[w], memory_order_relaxed)) {
+            continue;
+        }
+
+        uint64_t bits = atomic_exchange(&region->doorbell[w], 0);
+        while (bits) {
+            int bit = __builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            if (count < max_ready) {
+                ready[count++] = w * 64 + bit;
+            } else {
+                atomic_fetch_or(&region->doorbell[w], 1ull << bit);
+            }
+        }
+    }
+
+    return count;
+}
+
+// Spins for a few scans, then parks on the futex until a producer rings.
+// Returns the number of ready channels, or -1 once the set is closed.
+int ChannelSet_wait(ChannelSet *set, int *ready, int max_ready) {
+    ChannelSetRegion *region = set->region;
+
+    while (true) {
+        for (int spin = 0; spin < CHANNEL_SPIN_SCANS; spin++) {
+            int count = ChannelSet_poll(set, ready, max_ready);
+            if (count > 0) {
+                return count;
+            }
+            if (atomic_load(&region->closed)) {
+                return -1;
+            }
+        }
+
+        uint32_t futex = atomic_load(&region->futex);
+        atomic_store(&region->parked, 1);
+
+        int count = ChannelSet_poll(set, ready, max_ready);
+        if (count > 0 || atomic_load(&region->closed)) {
+            atomic_store(&region->parked, 0);
+            return count > 0 ? count : -1;
+        }
+
+        syscall(SYS_futex, &region->futex, FUTEX_WAIT, futex, NULL, NULL, 0);
+        atomic_store(&region->parked, 0);
+    }
+}
+
+static int channelset_compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t channelset_cpu_time_ns() {
+    struct timespec tms;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tms);
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
+}
+
+static void channelset_consumer_process(ChannelSet *set, ChannelSetMode mode, uint64_t number_of_messages) {
+    ChannelSetRegion *region = set->region;
+    uint64_t *latencies = (uint64_t *)malloc(number_of_messages * sizeof(uint64_t));
+    int *ready = (int *)malloc(region->channels * sizeof(int));
+    uint8_t data[CHANNEL_SLOT_SIZE];
+    uint64_t received = 0;
+
+    uint64_t startCpu = channelset_cpu_time_ns();
+    uint64_t startTime = getCurTimeNs();
+
+    while (received < number_of_messages) {
+        int count = 0;
+
+        if (mode == CHANNELSET_DOORBELL) {
+            count = ChannelSet_wait(set, ready, region->channels);
+        } else {
+            for (int c = 0; c < region->channels; c++) {
+                if (atomic_load_explicit(&set->slots[c].full, memory_order_acquire)) {
+                    ready[count++] = c;
+                }
+            }
+            if (count == 0 && atomic_load(&region->closed)) {
+                count = -1;
+            }
+        }
+
+        if (count < 0) {
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            ChannelSet_receive(set, ready[i], data, sizeof(data));
+            uint64_t sent;
+            memcpy(&sent, data, sizeof(sent));
+            latencies[received++] = getCurTimeNs() - sent;
+        }
+    }
+
+    region->stats.wall_ns = getCurTimeNs() - startTime;
+    region->stats.cpu_ns = channelset_cpu_time_ns() - startCpu;
+    region->stats.received = received;
+
+    if (received > 0) {
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < received; i++) {
+            total += latencies[i];
+        }
+        qsort(latencies, received, sizeof(uint64_t), channelset_compare_u64);
+        region->stats.average_latency_ns = total / received;
+        region->stats.p99_latency_ns = latencies[received * 99 / 100];
+        region->stats.max_latency_ns = latencies[received - 1];
+    }
+
+    free(ready);
+    free(latencies);
+    PhaseStats_dump("channel set consumer");
+}
+
+// One producer sends `number_of_messages` timestamped messages to scattered
+// channels, pausing `gap_us` between them so the consumer goes idle.
+// result: average, p99 and max wake-up latency (s), consumer CPU use (%),
+// CPU-seconds per GB delivered.
+double* compute_wakeup_ChannelSet(uint8_t *ptr, int channels, ChannelSetMode mode, uint64_t number_of_messages, int gap_us) {
+    double *result = (double *)malloc(5 * sizeof(double));
+    ChannelSet set;
+    ChannelSet_init(&set, ptr, channels);
+    ResourceUsage start, end, self, consumer;
+    ResourceUsage_thread(&start);
+
+    fflush(stdout);
+    int p = fork();
+
+    if (p == 0) {
+        channelset_consumer_process(&set, mode, number_of_messages);
+        exit(0);
+    }
+
+    uint8_t data[CHANNEL_SLOT_SIZE];
+    memset(data, 0, sizeof(data));
+    struct timespec gap = { 0, gap_us * 1000L };
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+
+    for (uint64_t k = 0; k < number_of_messages; k++) {
+        nanosleep(&gap, NULL);
+        PerfCounters_start(&counters);
+        uint64_t now = getCurTimeNs();
+        memcpy(data, &now, sizeof(now));
+        ChannelSet_send(&set, (int)((k * 7919) % channels), data, sizeof(data));
+        PerfCounters_stop(&counters);
+    }
+
+    ChannelSet_close(&set);
+    ResourceUsage_wait(p, &consumer);
+    ResourceUsage_thread(&end);
+    ResourceUsage_sub(&self, &end, &start);
+    PhaseStats_dump("channel set producer");
+    PerfCounters_print(&counters, "channel set producer", number_of_messages, "message");
+    PerfCounters_close(&counters);
+
+    ChannelSetStats *stats = &set.region->stats;
+    result[0] = (double)stats->average_latency_ns / 1000000000.0;
+    result[1] = (double)stats->p99_latency_ns / 1000000000.0;
+    result[2] = (double)stats->max_latency_ns / 1000000000.0;
+    result[3] = stats->wall_ns ? 100.0 * (double)stats->cpu_ns / (double)stats->wall_ns : 0;
+    result[4] = ResourceUsage_cpu_per_gb(&self, &consumer, stats->received * CHANNEL_SLOT_SIZE);
+
+    printf("Channels: %d, Mode: %s, Latency: %f s, Consumer CPU: %f %%\n", channels,
+           mode == CHANNELSET_DOORBELL ? "doorbell" : "poll", result[0], result[3]);
+    ResourceUsage_print("channel set producer and consumer", &self, &consumer, stats->received * CHANNEL_SLOT_SIZE);
+
+    return result;
+}
+
+// Each configuration runs NUMBER_OF_EXPERIMENTS times with 1000 messages,
+// one sample per run; the table shows the mean of the runs.
+void run_benchmark_ChannelSet(const char *name, uint8_t *ptr, const int *channel_counts, int number_of_counts) {
+    printf("Starting benchmark for method: %s\n", name);
+
+    const ChannelSetMode modes[] = { CHANNELSET_DOORBELL, CHANNELSET_POLL };
+    double *results[number_of_counts][2][NUMBER_OF_EXPERIMENTS];
+
+    for (int i = 0; i < number_of_counts; i++) {
+        for (int m = 0; m < 2; m++) {
+            for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+                results[i][m][e] = compute_wakeup_ChannelSet(ptr, channel_counts[i], modes[m], 1000, 50);
+            }
+        }
+    }
+
+    printf("Mean of %d experiments\n", NUMBER_OF_EXPERIMENTS);
+    printf("+----------+----------+--------------+--------------+--------------+------------------+------------+\n");
+    printf("| Channels |   Mode   | Latency (us) |   p99 (us)   |   Max (us)   | Consumer CPU (%%) | CPU s / GB |\n");
+    printf("+----------+----------+--------------+--------------+--------------+------------------+------------+\n");
+    for (int i = 0; i < number_of_counts; i++) {
+        for (int m = 0; m < 2; m++) {
+            char variant[32];
+            double mean[5];
+            double *const *runs = results[i][m];
+            snprintf(variant, sizeof(variant), "%s/channels=%d", modes[m] == CHANNELSET_DOORBELL ? "doorbell" : "poll", channel_counts[i]);
+            mean[0] = Results_record_column(name, variant, "latency", "s", true, runs, NUMBER_OF_EXPERIMENTS, 0);
+            mean[1] = Results_record_column(name, variant, "p99_latency", "s", true, runs, NUMBER_OF_EXPERIMENTS, 1);
+            mean[2] = Results_record_column(name, variant, "max_latency", "s", true, runs, NUMBER_OF_EXPERIMENTS, 2);
+            mean[3] = Results_record_column(name, variant, "consumer_cpu", "%", true, runs, NUMBER_OF_EXPERIMENTS, 3);
+            mean[4] = Results_record_column(name, variant, "cpu_per_gb", "s/GB", true, runs, NUMBER_OF_EXPERIMENTS, 4);
+
+            printf("| %8d | %-8s | %12.3lf | %12.3lf | %12.3lf | %16.2lf | %10.1lf |\n", channel_counts[i],
+                   modes[m] == CHANNELSET_DOORBELL ? "doorbell" : "poll",
+                   mean[0] * 1000000.0, mean[1] * 1000000.0, mean[2] * 1000000.0, mean[3], mean[4]);
+            for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+                free(runs[e]);
+            }
+        }
+        printf("+----------+----------+--------------+--------------+--------------+------------------+------------+\n");
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// CRC32C (Castagnoli). Uses the SSE4.2 crc32 instruction, eight bytes at a
+// time, when the CPU has it and a table-driven fallback otherwise.
+static uint32_t crc32c_table[256];
+static bool crc32c_table_ready = false;
+
+static void crc32c_init_table() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+        }
+        crc32c_table[i] = crc;
+    }
+    crc32c_table_ready = true;
+}
+
+static uint32_t crc32c_software(uint32_t crc, const uint8_t *data, size_t len) {
+    if (!crc32c_table_ready) {
+        crc32c_init_table();
+    }
+    for (size_t i = 0; i < len; i++) {
+        crc = crc32c_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hardware(uint32_t crc, const uint8_t *data, size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        data += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len > 0) {
+        crc = __builtin_ia32_crc32qi(crc, *data);
+        data++;
+        len--;
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(const uint8_t *data, size_t len) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ~crc32c_hardware(~0u, data, len);
+    }
+#endif
+    return ~crc32c_software(~0u, data, len);
+}
+
+// A test message generated once, outside any timed region: the usual
+// data[i] = i pattern with its CRC32C carried in the last four bytes. The
+// first `header` bytes are left out of the checksum, so the transports may
+// rewrite them (see OneWay.h).
+typedef struct {
+    uint8_t *data;
+    int len;
+    int header;
+} TestPattern;
+
+void TestPattern_init_header(TestPattern *pattern, int len, int header) {
+    if (header < 0 || len < header + (int)sizeof(uint32_t)) {
+        fprintf(stderr, "A %d-byte test pattern cannot hold a %d-byte header and its CRC32C\n", len, header);
+        exit(1);
+    }
+
+    pattern->data = (uint8_t *)malloc(len);
+    pattern->len = len;
+    pattern->header = header;
+
+    for (int i = 0; i < len; i++) {
+        pattern->data[i] = i;
+    }
+
+    uint32_t crc = crc32c(pattern->data + header, len - header - sizeof(crc));
+    memcpy(pattern->data + len - sizeof(crc), &crc, sizeof(crc));
+}
+
+void TestPattern_init(TestPattern *pattern, int len) {
+    TestPattern_init_header(pattern, len, 0);
+}
+
+void TestPattern_free(TestPattern *pattern) {
+    free(pattern->data);
+}
+
+bool TestPattern_verify(const TestPattern *pattern, const uint8_t *response, int response_size) {
+    if (response_size != pattern->len) {
+        return false;
+    }
+
+    uint32_t crc;
+    memcpy(&crc, response + response_size - sizeof(crc), sizeof(crc));
+    return crc == crc32c(response + pattern->header, response_size - pattern->header - sizeof(crc));
+}
+
+#endif
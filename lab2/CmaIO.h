@@ -0,0 +1,157 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "EchoBenchmark.h"
+#include "EchoPeer.h"
+#include "OneWay.h"
+#include "PhaseStats.h"
+#include "Transport.h"
+
+// What travels through the control channel: where the payload lives in the
+// sender's address space. The payload itself is pulled with one
+// process_vm_readv call, so it is copied once instead of twice.
+typedef struct {
+    pid_t pid;
+    uint64_t addr;
+    int len;
+} CmaMessage;
+
+typedef struct {
+    MmapIO control;
+    bool closed;
+} CmaIO;
+
+// With Yama ptrace_scope=1 a child may not read its parent's memory unless
+// the parent opts in, so allow any process of the same user to attach.
+void CmaIO_init(CmaIO *cma_io, uint8_t *control_ptr, int sender) {
+    MmapIO_init(&cma_io->control, control_ptr, sender);
+    cma_io->closed = false;
+    prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
+}
+
+// Yama, LSMs and seccomp only restrict reads of another process, so the
+// probe has a forked child read its parent, as the echo peer will.
+bool CmaIO_available() {
+    uint8_t source[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    pid_t parent = getpid();
+    int status;
+
+    prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        uint8_t target[8] = { 0 };
+        struct iovec local = { target, sizeof(target) };
+        struct iovec remote = { source, sizeof(source) };
+        bool ok = process_vm_readv(parent, &local, 1, &remote, 1, 0) == sizeof(source) &&
+                  memcmp(source, target, sizeof(source)) == 0;
+        _exit(ok ? 0 : 1);
+    }
+
+    return child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void CmaIO_close(CmaIO *cma_io) {
+    cma_io->closed = true;
+    MmapIO_close(&cma_io->control);
+}
+
+// `bytes` must stay valid until the peer has read the message, which in the
+// echo benchmark is guaranteed by waiting for the reply.
+void CmaIO_write_bytes(CmaIO *cma_io, const uint8_t *bytes, int len) {
+    if (cma_io->closed) {
+        return;
+    }
+
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
+
+    CmaMessage message = { getpid(), (uint64_t)(uintptr_t)bytes, len };
+    MmapIO_write_bytes(&cma_io->control, (const uint8_t *)&message, sizeof(message));
+    PhaseTimer_mark(&timer, PHASE_CMAIO, PHASE_PUBLISH);
+
+    if (cma_io->control.closed) {
+        cma_io->closed = true;
+    }
+}
+
+int CmaIO_read_bytes(CmaIO *cma_io, uint8_t *out_data, int max_size) {
+    if (cma_io->closed) {
+        return -1;
+    }
+
+    CmaMessage message;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+    if (MmapIO_read_bytes(&cma_io->control, (uint8_t *)&message, sizeof(message)) < 0) {
+        cma_io->closed = true;
+        return -1;
+    }
+
+    PhaseTimer_mark(&timer, PHASE_CMAIO, PHASE_WAIT);
+
+    int len = message.len < max_size ? message.len : max_size;
+    struct iovec local = { out_data, (size_t)len };
+    struct iovec remote = { (void *)(uintptr_t)message.addr, (size_t)len };
+
+    if (process_vm_readv(message.pid, &local, 1, &remote, 1, 0) != len) {
+        perror("process_vm_readv");
+        CmaIO_close(cma_io);
+        return -1;
+    }
+
+    PhaseTimer_mark(&timer, PHASE_CMAIO, PHASE_COPY);
+
+    return len;
+}
+
+void *echo_CmaIO(void *arg) {
+    CmaIO *io = (CmaIO *)arg;
+    uint8_t *data = (uint8_t *)malloc(message_capacity());
+    int data_size;
+
+    do {
+        data_size = CmaIO_read_bytes(io, data, message_capacity());
+
+        if (data_size > 0) {
+            OneWay_echo(data, data_size);
+            CmaIO_write_bytes(io, data, data_size);
+        }
+    } while (data_size > 0);
+
+    free(data);
+    PhaseStats_dump("echo peer");
+    return NULL;
+}
+
+static void CmaIO_transport_write(void *io, const uint8_t *bytes, int len) {
+    CmaIO_write_bytes((CmaIO *)io, bytes, len);
+}
+
+static int CmaIO_transport_read(void *io, uint8_t *out_data, int max_size) {
+    return CmaIO_read_bytes((CmaIO *)io, out_data, max_size);
+}
+
+static void CmaIO_transport_close(void *io) {
+    CmaIO_close((CmaIO *)io);
+}
+
+Transport CmaIO_transport(const char *name, CmaIO *cma_io) {
+    Transport transport = { name, cma_io, CmaIO_transport_write, CmaIO_transport_read, CmaIO_transport_close };
+    return transport;
+}
+
+double* run_benchmark_CmaIO(const char *name, CmaIO *io_first, CmaIO *io_second, ExecMode mode) {
+    Transport transport = CmaIO_transport(name, io_first);
+    return run_benchmark(&transport, echo_CmaIO, io_second, mode);
+}
@@ -0,0 +1,312 @@
+#ifndef ECHO_BENCHMARK_H
+#define ECHO_BENCHMARK_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Settings.h"
+#include "EchoPeer.h"
+#include "Checksum.h"
+#include "OneWay.h"
+#include "PhaseStats.h"
+#include "Transport.h"
+#include "OpenLoop.h"
+#include "../common/PerfCounters.h"
+#include "../common/Results.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Runner.h"
+
+// The latency, throughput and capacity benchmarks of the transport headers,
+// run through a Transport so a new transport does not need its own copy.
+// Each returns -1 once the channel closes under it.
+
+// Microseconds, for the throughput and capacity regions.
+static uint64_t echo_benchmark_now() {
+    struct timespec tms;
+    clock_gettime(CLOCK_MONOTONIC, &tms);
+    return tms.tv_sec * 1000000ull + tms.tv_nsec / 1000;
+}
+
+double compute_latency(Transport *transport) {
+    uint64_t failures = 0;
+    uint64_t messages = 0;
+    uint8_t data[128];
+    OneWayLog responses;
+    char region[64];
+    bool closed = false;
+    TestPattern pattern;
+    TestPattern_init_header(&pattern, sizeof(data), sizeof(OneWayStamp));
+    uint8_t *message = MEASURE_ONLY ? pattern.data : data;
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    Runner runner;
+    snprintf(region, sizeof(region), "%s latency", transport->name);
+    Runner_init(&runner, region, &counters);
+    OneWay_init(&oneway_stats);
+    OneWayLog_init(&responses, sizeof(data));
+
+    for (uint64_t n; !closed && (n = Runner_batch(&runner)) > 0;) {
+        OneWay_batch(&oneway_stats, runner.count > 0);
+        OneWayLog_reset(&responses, n);
+        for (uint64_t k = 0; k < n; k++) {
+            if (!MEASURE_ONLY) {
+                for (uint64_t i = 0; i < sizeof(data); i++) {
+                    data[i] = i;
+                }
+            }
+
+            OneWay_stamp(message);
+            uint8_t *response = OneWayLog_next(&responses);
+            transport->write(transport->io, message, sizeof(data));
+            int response_size = transport->read(transport->io, response, sizeof(data));
+            OneWayLog_add(&responses, response_size, phase_now());
+            messages++;
+            if ((closed = response_size < 0)) {
+                break;
+            }
+
+            if (!MEASURE_ONLY) {
+                for (uint64_t i = sizeof(OneWayStamp); i < sizeof(data); i++) {
+                    assert(data[i] == response[i]);
+                }
+            }
+        }
+
+        // One pause per batch: the stamps and test patterns of all its
+        // responses are checked together.
+        Runner_pause(&runner);
+        for (uint64_t k = 0; k < responses.count; k++) {
+            uint8_t *response = OneWayLog_response(&responses, k);
+            OneWay_add(&oneway_stats, response, responses.sizes[k], responses.received_ns[k]);
+            failures += MEASURE_ONLY && !TestPattern_verify(&pattern, response, responses.sizes[k]);
+        }
+        Runner_resume(&runner);
+    }
+
+    double latency = -1;
+    if (closed) {
+        printf("%s: the channel closed after %lu messages\n", region, messages);
+    } else {
+        // Samples are ns per round trip, averaged over each batch.
+        OneWay_batch(&oneway_stats, runner.count > 0);
+        RunnerResult *stats = Runner_result(&runner);
+        latency = stats->median / 2 / 1000000000.0;
+        for (size_t i = 0; i < runner.count; i++) {
+            Results_sample(runner.samples[i] / 2 / 1000000000.0);
+        }
+
+        ResourceUsage_moved(2 * messages * sizeof(data));
+        if (failures) printf("Corrupted responses: %lu of %lu\n", failures, messages);
+        printf("Latency: %f s\n", latency);
+        Runner_print(&runner, 0.5 / 1000000000.0, "s");
+        OneWay_print(&oneway_stats, transport->name);
+        PerfCounters_print(&counters, region, stats->iterations, "message");
+    }
+    PerfCounters_close(&counters);
+
+    OneWayLog_free(&responses);
+    Runner_free(&runner);
+    TestPattern_free(&pattern);
+    return latency;
+}
+
+double compute_throughput(Transport *transport, uint64_t number_of_experiments) {
+    double throughput = 0;
+    uint64_t failures = 0;
+    char region[64];
+    TestPattern pattern;
+    TestPattern_init(&pattern, PACKET_SIZE);
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    uint64_t messages = 0;
+    uint8_t *data = (uint8_t *)malloc(PACKET_SIZE);
+    uint8_t *response = (uint8_t *)malloc(PACKET_SIZE);
+    const uint8_t *message = MEASURE_ONLY ? pattern.data : data;
+    uint64_t mega_bytes = 128;
+    bool closed = false;
+
+    for (uint64_t n = 0; n < number_of_experiments; n++) {
+        uint64_t cpuStart = EchoPeer_cpu_ns();
+        PerfCounters_start(&counters);
+        uint64_t startTime = echo_benchmark_now();
+
+        if (!MEASURE_ONLY) {
+            for (int i = 0; i < PACKET_SIZE; i++) {
+                data[i] = i;
+            }
+        }
+
+        for (uint64_t k = 0; k < mega_bytes * 1024 * 1024 / PACKET_SIZE; k++) {
+            transport->write(transport->io, message, PACKET_SIZE);
+            int response_size = transport->read(transport->io, response, PACKET_SIZE);
+            messages++;
+            if ((closed = response_size < 0)) {
+                break;
+            }
+
+            if (MEASURE_ONLY) {
+                failures += response_size != PACKET_SIZE;
+            } else {
+                for (int i = 0; i < PACKET_SIZE; i++) {
+                    assert(data[i] == response[i]);
+                }
+            }
+        }
+
+        uint64_t endTime = echo_benchmark_now();
+        PerfCounters_stop(&counters);
+        if (closed) {
+            break;
+        }
+        // The payload is checked once the region is over, on the last response.
+        failures += MEASURE_ONLY && !TestPattern_verify(&pattern, response, PACKET_SIZE);
+        throughput += (double)mega_bytes / ((double)(endTime - startTime) / 1000000.0) * 2;
+        Results_sample((double)mega_bytes / ((double)(endTime - startTime) / 1000000.0) * 2);
+        EchoPeer_sample_cpu(EchoPeer_cpu_ns() - cpuStart, 2 * mega_bytes * 1024 * 1024);
+    }
+
+    snprintf(region, sizeof(region), "%s throughput", transport->name);
+    if (closed) {
+        printf("%s: the channel closed after %lu messages\n", region, messages);
+        throughput = -1;
+    } else {
+        ResourceUsage_moved(2 * messages * PACKET_SIZE);
+        if (failures) printf("Corrupted responses: %lu\n", failures);
+        throughput /= (double)number_of_experiments;
+        printf("Throughput: %f MB/s\n", throughput);
+        PerfCounters_print(&counters, region, messages, "message");
+    }
+    PerfCounters_close(&counters);
+
+    free(response);
+    free(data);
+    TestPattern_free(&pattern);
+    return throughput;
+}
+
+double compute_capacity(Transport *transport, uint64_t number_of_experiments) {
+    double total_max_throughput = 0;
+    uint64_t failures = 0;
+    char region[64];
+    TestPattern pattern;
+    TestPattern_init(&pattern, PACKET_SIZE);
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    uint64_t messages = 0;
+    uint8_t *data = (uint8_t *)malloc(PACKET_SIZE);
+    uint8_t *response = (uint8_t *)malloc(PACKET_SIZE);
+    const uint8_t *message = MEASURE_ONLY ? pattern.data : data;
+    uint64_t mega_bytes = 128;
+    bool closed = false;
+
+    for (uint64_t n = 0; n < number_of_experiments; n++) {
+        double max_throughput = 0;
+
+        for (int k = 0; k < 10; k++) {
+            PerfCounters_start(&counters);
+            uint64_t startTime = echo_benchmark_now();
+
+            if (!MEASURE_ONLY) {
+                for (int i = 0; i < PACKET_SIZE; i++) {
+                    data[i] = i;
+                }
+            }
+
+            for (uint64_t k = 0; k < mega_bytes * 1024 * 1024 / PACKET_SIZE; k++) {
+                transport->write(transport->io, message, PACKET_SIZE);
+                int response_size = transport->read(transport->io, response, PACKET_SIZE);
+                messages++;
+                if ((closed = response_size < 0)) {
+                    break;
+                }
+
+                if (MEASURE_ONLY) {
+                    failures += response_size != PACKET_SIZE;
+                } else {
+                    for (int i = 0; i < PACKET_SIZE; i++) {
+                        assert(data[i] == response[i]);
+                    }
+                }
+            }
+
+            uint64_t endTime = echo_benchmark_now();
+            PerfCounters_stop(&counters);
+            if (closed) {
+                break;
+            }
+            // The payload is checked once the region is over, on the last response.
+            failures += MEASURE_ONLY && !TestPattern_verify(&pattern, response, PACKET_SIZE);
+            double throughput = (double)mega_bytes / ((double)(endTime - startTime) / 1000000.0) * 2;
+            max_throughput = (max_throughput < throughput) ? throughput : max_throughput;
+        }
+        if (closed) {
+            break;
+        }
+        total_max_throughput += max_throughput;
+        Results_sample(max_throughput);
+    }
+
+    snprintf(region, sizeof(region), "%s capacity", transport->name);
+    double capacity = -1;
+    if (closed) {
+        printf("%s: the channel closed after %lu messages\n", region, messages);
+    } else {
+        ResourceUsage_moved(2 * messages * PACKET_SIZE);
+        if (failures) printf("Corrupted responses: %lu\n", failures);
+        capacity = total_max_throughput / (double)number_of_experiments;
+        printf("Capacity: %f MB/s\n", capacity);
+        PerfCounters_print(&counters, region, messages, "message");
+    }
+    PerfCounters_close(&counters);
+
+    free(response);
+    free(data);
+    TestPattern_free(&pattern);
+    return capacity;
+}
+
+// Runs every benchmark against an echo peer serving `peer_io` and closes
+// `transport`. result: latency (s), throughput and capacity (MB/s), CPU
+// seconds per GB of the throughput experiments and the open-loop knee
+// (msg/s); the ones after the channel closed are -1.
+double* run_benchmark(Transport *transport, void *(*echo)(void *), void *peer_io, ExecMode mode) {
+    double *result = (double *)malloc(5 * sizeof(double));
+    const char *variant = ExecMode_name(mode);
+
+    printf("Starting benchmark for method: %s (%s)\n", transport->name, variant);
+
+    EchoPeer peer;
+    ResourceUsage start, end, self;
+    ResourceUsage_take_moved();
+    ResourceUsage_thread(&start);
+    EchoPeer_start(&peer, mode, echo, peer_io);
+
+    result[0] = compute_latency(transport);
+    Results_record(transport->name, variant, "latency", "s", true);
+    OneWay_record(&oneway_stats, transport->name, variant);
+    OneWay_free(&oneway_stats);
+    result[1] = result[0] < 0 ? -1 : compute_throughput(transport, NUMBER_OF_EXPERIMENTS);
+    Results_record(transport->name, variant, "throughput", "MB/s", false);
+    result[2] = result[1] < 0 ? -1 : compute_capacity(transport, NUMBER_OF_EXPERIMENTS);
+    Results_record(transport->name, variant, "capacity", "MB/s", false);
+    result[4] = result[2] < 0 ? -1 : compute_knee(transport, OPENLOOP_ARRIVALS);
+    Results_record(transport->name, variant, "knee", "msg/s", false);
+
+    transport->close(transport->io);
+    EchoPeer_join(&peer);
+    ResourceUsage_thread(&end);
+    ResourceUsage_sub(&self, &end, &start);
+    PhaseStats_dump(transport->name);
+
+    uint64_t bytes = ResourceUsage_take_moved();
+    ResourceUsage_print(transport->name, &self, &peer.usage, bytes);
+    double cpu_per_gb = EchoPeer_record_cpu(transport->name, variant);
+    result[3] = result[4] < 0 ? -1 : cpu_per_gb;
+
+    return result;
+}
+
+#endif
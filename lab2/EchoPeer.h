@@ -0,0 +1,137 @@
+#ifndef ECHO_PEER_H
+#define ECHO_PEER_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Results.h"
+#include "../common/Samples.h"
+
+// How the echo side of a benchmark runs: as a forked child with its own
+// address space, or as a thread sharing the parent's page tables and TLB.
+typedef enum {
+    EXEC_PROCESS,
+    EXEC_THREAD,
+} ExecMode;
+
+typedef struct {
+    ExecMode mode;
+    pid_t pid;
+    pthread_t thread;
+    void *(*echo)(void *);
+    void *io;
+    ResourceUsage usage;
+} EchoPeer;
+
+// The peer of the benchmark in progress, whose CPU clock is read while it
+// runs, and the CPU nanoseconds per GB of each throughput experiment, both
+// sides together, until run_benchmark_* records them as cpu_per_gb.
+static EchoPeer *echo_peer_running;
+static Samples echo_cpu_per_gb;
+
+const char *ExecMode_name(ExecMode mode) {
+    return mode == EXEC_THREAD ? "thread" : "process";
+}
+
+// Runs the echo loop on the peer thread and keeps that thread's usage.
+static void *echo_peer_thread(void *arg) {
+    EchoPeer *peer = (EchoPeer *)arg;
+    ResourceUsage start, end;
+
+    Placement_apply(true);
+    ResourceUsage_thread(&start);
+    peer->echo(peer->io);
+    ResourceUsage_thread(&end);
+    ResourceUsage_sub(&peer->usage, &end, &start);
+    return NULL;
+}
+
+// Both sides are pinned according to settings.placement first.
+void EchoPeer_start(EchoPeer *peer, ExecMode mode, void *(*echo)(void *), void *io) {
+    peer->mode = mode;
+    peer->echo = echo;
+    peer->io = io;
+    memset(&peer->usage, 0, sizeof(peer->usage));
+    Placement_apply(false);
+    echo_peer_running = peer;
+    Samples_free(&echo_cpu_per_gb);
+    Samples_init(&echo_cpu_per_gb, 0);
+
+    if (mode == EXEC_THREAD) {
+        if (pthread_create(&peer->thread, NULL, echo_peer_thread, peer) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+        return;
+    }
+
+    fflush(stdout);
+    peer->pid = fork();
+
+    if (peer->pid == 0) {
+        Placement_apply(true);
+        echo(io);
+        exit(0);
+    }
+}
+
+// Waits for the peer and fills peer->usage with what it consumed.
+void EchoPeer_join(EchoPeer *peer) {
+    if (peer->mode == EXEC_THREAD) {
+        pthread_join(peer->thread, NULL);
+    } else {
+        ResourceUsage_wait(peer->pid, &peer->usage);
+    }
+    echo_peer_running = NULL;
+}
+
+static uint64_t echo_cpu_clock_ns(clockid_t clock) {
+    struct timespec tms;
+    if (clock_gettime(clock, &tms) != 0) {
+        return 0;
+    }
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
+}
+
+// CPU time used so far by the calling thread plus the running peer (ns).
+uint64_t EchoPeer_cpu_ns() {
+    EchoPeer *peer = echo_peer_running;
+    uint64_t total = echo_cpu_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    clockid_t clock;
+
+    if (peer != NULL) {
+        int error = peer->mode == EXEC_THREAD ? pthread_getcpuclockid(peer->thread, &clock)
+                                               : clock_getcpuclockid(peer->pid, &clock);
+        if (error == 0) {
+            total += echo_cpu_clock_ns(clock);
+        }
+    }
+    return total;
+}
+
+// Charges `cpu_ns` of both sides to `bytes` moved in one experiment.
+void EchoPeer_sample_cpu(uint64_t cpu_ns, uint64_t bytes) {
+    if (echo_cpu_per_gb.values != NULL && bytes > 0) {
+        Samples_add(&echo_cpu_per_gb, (uint64_t)((double)cpu_ns / ((double)bytes / (1024.0 * 1024.0 * 1024.0))));
+    }
+}
+
+// Records the per-experiment CPU seconds per GB and returns their mean.
+double EchoPeer_record_cpu(const char *benchmark, const char *variant) {
+    double total = 0;
+    for (size_t i = 0; i < echo_cpu_per_gb.count; i++) {
+        Results_sample(echo_cpu_per_gb.values[i] / 1000000000.0);
+        total += echo_cpu_per_gb.values[i] / 1000000000.0;
+    }
+    Results_record(benchmark, variant, "cpu_per_gb", "s/GB", true);
+    return echo_cpu_per_gb.count ? total / (double)echo_cpu_per_gb.count : 0;
+}
+
+#endif
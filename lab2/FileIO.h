@@ -1,4 +1,3 @@
-#include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -7,11 +6,12 @@
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
-#include "config.h"
-
-#define read_bytes FileIO_read_bytes
-#define write_bytes FileIO_write_bytes
-#define DEBUG 0
+#include "Settings.h"
+#include "EchoPeer.h"
+#include "OneWay.h"
+#include "PhaseStats.h"
+#include "Transport.h"
+#include "EchoBenchmark.h"
 
 static uint64_t getCurTime() {
     struct timespec tms;
@@ -21,6 +21,14 @@ static uint64_t getCurTime() {
     return tms.tv_sec * 1000000 + tms.tv_nsec / 1000;
 }
 
+static uint64_t getCurTimeNs() {
+    struct timespec tms;
+    if (clock_gettime(CLOCK_MONOTONIC, &tms)) {
+        return -1;
+    }
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
+}
+
 typedef struct {
     FILE *file;
     bool closed;
@@ -54,9 +62,12 @@ void FileIO_write_bytes(FileIO *file_io, const uint8_t *bytes, int len) {
 
     int other = 0;
     int prev = 0;
-    uint64_t startTime2 = getCurTime();
+    uint64_t polls = 0;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
     
     do {
+        wait_retry(&polls);
         fseek(file_io->file, 0, SEEK_SET);
         fread(&other, sizeof(int), 1, file_io->file);
         fread(&prev, sizeof(int), 1, file_io->file);
@@ -67,19 +78,17 @@ void FileIO_write_bytes(FileIO *file_io, const uint8_t *bytes, int len) {
         }       
     } while (prev != 0);
 
-    uint64_t endTime2 = getCurTime();
-    if (DEBUG) printf("WAITING WRITE TIME: %f\n", (double)(endTime2 - startTime2)/1000000.0);
+    PhaseTimer_mark(&timer, PHASE_FILEIO, PHASE_WAIT);
 
-    uint64_t startTime3 = getCurTime();
     fseek(file_io->file, sizeof(int) * 2, SEEK_SET);
     fwrite(bytes, sizeof(uint8_t), len, file_io->file);
+    PhaseTimer_mark(&timer, PHASE_FILEIO, PHASE_COPY);
+
     fseek(file_io->file, 0, SEEK_SET);
     fwrite(&(file_io->sender), sizeof(int), 1, file_io->file);
     fwrite(&len, sizeof(int), 1, file_io->file);
     fflush(file_io->file);
-    uint64_t endTime3 = getCurTime();
-
-    if (DEBUG) printf("        WRITE TIME: %f\n", (double)(endTime3 - startTime3)/1000000.0);
+    PhaseTimer_mark(&timer, PHASE_FILEIO, PHASE_PUBLISH);
 }
 
 int FileIO_read_bytes(FileIO *file_io, uint8_t *out_data, int max_size) {
@@ -89,169 +98,78 @@ int FileIO_read_bytes(FileIO *file_io, uint8_t *out_data, int max_size) {
 
     int other = 0;
     int size = 0;
-
-    int64_t startTime2 = getCurTime();
+    uint64_t polls = 0;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
 
     while (!size || other == file_io->sender) {
+        wait_retry(&polls);
         fflush(file_io->file);        
         fseek(file_io->file, 0, SEEK_SET);
         fread(&other, sizeof(int), 1, file_io->file);
         fread(&size, sizeof(int), 1, file_io->file);        
     }
 
-    uint64_t endTime2 = getCurTime();
-    if (DEBUG) printf("WAITING READ TIME: %f\n", (double)(endTime2 - startTime2)/1000000.0);
+    PhaseTimer_mark(&timer, PHASE_FILEIO, PHASE_WAIT);
 
     if (size == -1) {
         file_io->closed = true;
         return -1;
     }
 
-    uint64_t startTime3 = getCurTime();
+    // A message longer than max_size is cut short; the rest is dropped
+    // when the file is handed back.
+    size = size < max_size ? size : max_size;
     fread(out_data, sizeof(uint8_t), size, file_io->file);
+    PhaseTimer_mark(&timer, PHASE_FILEIO, PHASE_COPY);
 
     int temp = 0;
     fseek(file_io->file, 0, SEEK_SET);
     fwrite(&(file_io->sender), sizeof(int), 1, file_io->file);
     fwrite(&temp, sizeof(int), 1, file_io->file);
     fflush(file_io->file);
-    uint64_t endTime3 = getCurTime();
-
-    if (DEBUG) printf("        READ TIME: %f\n", (double)(endTime3 - startTime3)/1000000.0);
+    PhaseTimer_mark(&timer, PHASE_FILEIO, PHASE_PUBLISH);
 
     return size;
 }
 
-double compute_latency_FileIO(FileIO *file_io, uint64_t number_of_experiments) {
-    double total_latency = 0;
-    uint8_t data[128];
-    uint8_t response[128];
-
-    for (uint64_t k = 0; k < number_of_experiments; k++) {
-        uint64_t startTime = getCurTime();
-
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            data[i] = i;
-        }
-
-        uint64_t startTime2 = getCurTime();
-        write_bytes(file_io, data, sizeof(data));
-        uint64_t endTime2 = getCurTime();    
-
-        if (DEBUG) printf("WRITE TIME: %f\n", (double)(endTime2 - startTime2)/1000000.0);
+void *echo_fileIO(void *arg) {
+    FileIO *io = (FileIO *)arg;
+    uint8_t *data = (uint8_t *)malloc(message_capacity());
+    int data_size;
 
-        uint64_t startTime3 = getCurTime();
-        int response_size = read_bytes(file_io, response, sizeof(response));
-        uint64_t endTime3 = getCurTime();    
-
-        if (DEBUG) printf("READ  TIME: %f\n", (double)(endTime3 - startTime3)/1000000.0);
+    do {
+        data_size = FileIO_read_bytes(io, data, message_capacity());
 
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            assert(data[i] == response[i]);
+        if (data_size > 0) {
+            OneWay_echo(data, data_size);
+            FileIO_write_bytes(io, data, data_size);
         }
+    } while (data_size > 0);
 
-        uint64_t endTime = getCurTime();
-        total_latency += ((double)(endTime - startTime)/1000000.0) / 2;
-    }
-
-    printf("Latency: %f s\n", total_latency / (double)number_of_experiments);
-
-    return total_latency / (double)number_of_experiments;
+    free(data);
+    PhaseStats_dump("echo peer");
+    return NULL;
 }
 
-double compute_throughput_FileIO(FileIO *file_io, uint64_t number_of_experiments) {
-    double throughput = 0;
-
-    for(uint64_t n = 0; n < number_of_experiments; n++){
-        uint64_t startTime = getCurTime();
-        uint8_t data[PACKET_SIZE];
-        uint8_t response[PACKET_SIZE];
-        uint64_t mega_bytes = 128;
-
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            data[i] = i;
-        }
-
-        for (uint64_t k = 0; k < mega_bytes * 1024 * 1024 / PACKET_SIZE; k++) {
-            write_bytes(file_io, data, sizeof(data));
-            int response_size = read_bytes(file_io, response, sizeof(response));
-
-            for (uint64_t i = 0; i < sizeof(data); i++) {
-                assert(data[i] == response[i]);
-            }
-        }
-
-        uint64_t endTime = getCurTime();
-        throughput += (double)mega_bytes / ((double)(endTime - startTime)/1000000.0) * 2;
-    }
-
-    printf("Throughput: %f MB/s\n", throughput/(double)number_of_experiments);
-
-    return throughput/(double)number_of_experiments;
+static void FileIO_transport_write(void *io, const uint8_t *bytes, int len) {
+    FileIO_write_bytes((FileIO *)io, bytes, len);
 }
 
-double compute_capacity_FileIO(FileIO *file_io, uint64_t number_of_experiments) {
-    double total_max_throughput = 0;
-
-    for(uint64_t n = 0; n < number_of_experiments; n++){
-        double max_throughput = 0;
-        uint8_t data[PACKET_SIZE];
-        uint8_t response[PACKET_SIZE];
-        uint64_t mega_bytes = 128;
-
-        for (int k = 0; k < 10; k++) {
-            uint64_t startTime = getCurTime();
-
-            for (uint64_t i = 0; i < sizeof(data); i++) {
-                data[i] = i;
-            }
-
-            for (uint64_t k = 0; k < mega_bytes * 1024 * 1024 / PACKET_SIZE; k++) {
-                write_bytes(file_io, data, sizeof(data));
-                int response_size = read_bytes(file_io, response, sizeof(response));
-                for (uint64_t i = 0; i < sizeof(data); i++) {
-                    assert(data[i] == response[i]);
-                }
-            }
-
-            uint64_t endTime = getCurTime();
-            double throughput = (double)mega_bytes / ((double)(endTime - startTime)/1000000.0) * 2;
-            max_throughput = (max_throughput < throughput) ? throughput : max_throughput;
-        }
-
-        total_max_throughput += max_throughput;
-    }
-
-    printf("Capacity: %f MB/s\n", total_max_throughput/(double)number_of_experiments);
-
-    return total_max_throughput/(double)number_of_experiments;
+static int FileIO_transport_read(void *io, uint8_t *out_data, int max_size) {
+    return FileIO_read_bytes((FileIO *)io, out_data, max_size);
 }
 
-double* run_benchmark_fileIO(const char *name, FileIO *file1, FileIO *file2) {
-    double *result = (double *)malloc(3 * sizeof(double));
-
-    printf("Starting benchmark for method: %s\n", name);
-
-    int p = fork();
-
-    if (p == 0) {
-        uint8_t data[PACKET_SIZE];
-        int data_size;
+static void FileIO_transport_close(void *io) {
+    FileIO_close((FileIO *)io);
+}
 
-        do {
-            data_size = read_bytes(file2, data, sizeof(data));
-            if (data_size > 0) {
-                write_bytes(file2, data, data_size);
-            }
-        } while (data_size > 0);
+Transport FileIO_transport(const char *name, FileIO *file_io) {
+    Transport transport = { name, file_io, FileIO_transport_write, FileIO_transport_read, FileIO_transport_close };
+    return transport;
+}
 
-        exit(0);
-    } else {
-        result[0] = compute_latency_FileIO(file1, NUMBER_OF_EXPERIMENTS*10000);
-        result[1] = compute_throughput_FileIO(file1, NUMBER_OF_EXPERIMENTS);
-        result[2] = compute_capacity_FileIO(file1, NUMBER_OF_EXPERIMENTS);
-        FileIO_close(file1);
-    }
-    
-    return result;
+double* run_benchmark_fileIO(const char *name, FileIO *file1, FileIO *file2, ExecMode mode) {
+    Transport transport = FileIO_transport(name, file1);
+    return run_benchmark(&transport, echo_fileIO, file2, mode);
 }
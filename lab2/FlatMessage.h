@@ -0,0 +1,229 @@
+#ifndef FLAT_MESSAGE_H
+#define FLAT_MESSAGE_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// An offset-based message layout that is read where it lies: no parse step,
+// no copy into a native struct. A schema lists the fields; a message is a
+// header with one offset per field, followed by the field values, each
+// aligned to FLAT_ALIGN:
+//
+//   [size u32][schema id u16][field count u16][offset u32 x fields][values...]
+//
+// Scalars are stored as is. A string is its length (u32), its bytes and a
+// NUL; a vector is its element count (u32), padding, and the elements. An
+// offset of 0 marks a field that was not set. Offsets are from the start of
+// the message, so it can be built straight into a shared-memory slot and
+// read from another process at a different address.
+
+#define FLAT_ALIGN 8
+
+typedef enum {
+    FLAT_U32,
+    FLAT_U64,
+    FLAT_F64,
+    FLAT_STRING,
+    FLAT_VECTOR,
+} FlatType;
+
+typedef struct {
+    const char *name;
+    FlatType type;
+    int element_size;       // FLAT_VECTOR only
+} FlatField;
+
+typedef struct {
+    uint16_t id;
+    int count;
+    const FlatField *fields;
+} FlatSchema;
+
+typedef struct {
+    uint32_t size;
+    uint16_t schema;
+    uint16_t fields;
+    uint32_t offsets[];
+} FlatHeader;
+
+typedef struct {
+    const FlatSchema *schema;
+    uint8_t *base;
+    uint32_t capacity;
+    uint32_t used;
+    bool overflow;
+} FlatBuilder;
+
+typedef struct {
+    const FlatSchema *schema;
+    const uint8_t *base;
+    uint32_t size;
+} FlatMessage;
+
+static uint32_t flat_align(uint32_t size) {
+    return (size + FLAT_ALIGN - 1) & ~(uint32_t)(FLAT_ALIGN - 1);
+}
+
+static uint32_t flat_header_size(const FlatSchema *schema) {
+    return flat_align(sizeof(FlatHeader) + schema->count * sizeof(uint32_t));
+}
+
+// Starts a message in `buffer`, which must be FLAT_ALIGN-aligned.
+void FlatBuilder_init(FlatBuilder *builder, const FlatSchema *schema, uint8_t *buffer, int capacity) {
+    builder->schema = schema;
+    builder->base = buffer;
+    builder->capacity = capacity;
+    builder->used = flat_header_size(schema);
+    builder->overflow = builder->used > builder->capacity;
+
+    if (!builder->overflow) {
+        memset(buffer, 0, builder->used);
+        FlatHeader *header = (FlatHeader *)buffer;
+        header->schema = schema->id;
+        header->fields = schema->count;
+    }
+}
+
+// Room for `size` bytes of `field`; NULL (and the message fails) if it does
+// not fit.
+static uint8_t *flat_alloc(FlatBuilder *builder, int field, FlatType type, uint32_t size) {
+    assert(field >= 0 && field < builder->schema->count && builder->schema->fields[field].type == type);
+
+    uint32_t offset = flat_align(builder->used);
+    if (builder->overflow || size > builder->capacity || offset > builder->capacity - size) {
+        builder->overflow = true;
+        return NULL;
+    }
+    ((FlatHeader *)builder->base)->offsets[field] = offset;
+    builder->used = offset + size;
+    return builder->base + offset;
+}
+
+void FlatBuilder_u32(FlatBuilder *builder, int field, uint32_t value) {
+    uint8_t *slot = flat_alloc(builder, field, FLAT_U32, sizeof(value));
+    if (slot) memcpy(slot, &value, sizeof(value));
+}
+
+void FlatBuilder_u64(FlatBuilder *builder, int field, uint64_t value) {
+    uint8_t *slot = flat_alloc(builder, field, FLAT_U64, sizeof(value));
+    if (slot) memcpy(slot, &value, sizeof(value));
+}
+
+void FlatBuilder_f64(FlatBuilder *builder, int field, double value) {
+    uint8_t *slot = flat_alloc(builder, field, FLAT_F64, sizeof(value));
+    if (slot) memcpy(slot, &value, sizeof(value));
+}
+
+void FlatBuilder_string(FlatBuilder *builder, int field, const char *text, uint32_t len) {
+    uint8_t *slot = flat_alloc(builder, field, FLAT_STRING, sizeof(uint32_t) + len + 1);
+    if (slot) {
+        memcpy(slot, &len, sizeof(len));
+        memcpy(slot + sizeof(uint32_t), text, len);
+        slot[sizeof(uint32_t) + len] = '\0';
+    }
+}
+
+// Reserves a vector of `count` elements and returns them for the caller to
+// fill in place, or NULL if they do not fit.
+void *FlatBuilder_vector(FlatBuilder *builder, int field, uint32_t count) {
+    uint64_t bytes = (uint64_t)count * builder->schema->fields[field].element_size;
+    uint8_t *slot = flat_alloc(builder, field, FLAT_VECTOR, bytes > UINT32_MAX - FLAT_ALIGN ? UINT32_MAX : FLAT_ALIGN + bytes);
+    if (slot == NULL) {
+        return NULL;
+    }
+    memcpy(slot, &count, sizeof(count));
+    return slot + FLAT_ALIGN;
+}
+
+// Seals the message; returns its size, or -1 if it did not fit.
+int FlatBuilder_finish(FlatBuilder *builder) {
+    if (builder->overflow) {
+        return -1;
+    }
+    ((FlatHeader *)builder->base)->size = builder->used;
+    return (int)builder->used;
+}
+
+// Checks the header of the `size` bytes at `bytes`; fields are checked as
+// they are read, so a damaged message yields missing fields, not crashes.
+bool FlatMessage_init(FlatMessage *message, const FlatSchema *schema, const uint8_t *bytes, int size) {
+    const FlatHeader *header = (const FlatHeader *)bytes;
+
+    message->schema = schema;
+    message->base = bytes;
+    message->size = 0;
+    if (size < (int)flat_header_size(schema) || header->schema != schema->id || header->fields != schema->count ||
+        header->size > (uint32_t)size || header->size < flat_header_size(schema)) {
+        return false;
+    }
+    message->size = header->size;
+    return true;
+}
+
+// The value of `field` if it is set and its first `size` bytes lie inside
+// the message, NULL otherwise.
+static const uint8_t *flat_field(const FlatMessage *message, int field, FlatType type, uint32_t size) {
+    assert(field >= 0 && field < message->schema->count && message->schema->fields[field].type == type);
+
+    if (message->size == 0) {
+        return NULL;
+    }
+    uint32_t offset = ((const FlatHeader *)message->base)->offsets[field];
+    if (offset < flat_header_size(message->schema) || offset > message->size || size > message->size - offset) {
+        return NULL;
+    }
+    return message->base + offset;
+}
+
+uint32_t FlatMessage_u32(const FlatMessage *message, int field, uint32_t missing) {
+    const uint8_t *value = flat_field(message, field, FLAT_U32, sizeof(uint32_t));
+    uint32_t result = missing;
+    if (value) memcpy(&result, value, sizeof(result));
+    return result;
+}
+
+uint64_t FlatMessage_u64(const FlatMessage *message, int field, uint64_t missing) {
+    const uint8_t *value = flat_field(message, field, FLAT_U64, sizeof(uint64_t));
+    uint64_t result = missing;
+    if (value) memcpy(&result, value, sizeof(result));
+    return result;
+}
+
+double FlatMessage_f64(const FlatMessage *message, int field, double missing) {
+    const uint8_t *value = flat_field(message, field, FLAT_F64, sizeof(double));
+    double result = missing;
+    if (value) memcpy(&result, value, sizeof(result));
+    return result;
+}
+
+// The NUL-terminated string in place, or NULL if it is missing.
+const char *FlatMessage_string(const FlatMessage *message, int field, uint32_t *len) {
+    const uint8_t *value = flat_field(message, field, FLAT_STRING, sizeof(uint32_t));
+    if (value == NULL) {
+        return NULL;
+    }
+    memcpy(len, value, sizeof(*len));
+    uint32_t room = message->size - (uint32_t)(value - message->base) - sizeof(uint32_t);
+    if (*len >= room || value[sizeof(uint32_t) + *len] != '\0') {
+        return NULL;
+    }
+    return (const char *)value + sizeof(uint32_t);
+}
+
+// The vector's elements in place, or NULL if it is missing.
+const void *FlatMessage_vector(const FlatMessage *message, int field, uint32_t *count) {
+    const uint8_t *value = flat_field(message, field, FLAT_VECTOR, FLAT_ALIGN);
+    if (value == NULL) {
+        return NULL;
+    }
+    memcpy(count, value, sizeof(*count));
+    uint32_t room = message->size - (uint32_t)(value - message->base) - FLAT_ALIGN;
+    if ((uint64_t)*count * message->schema->fields[field].element_size > room) {
+        return NULL;
+    }
+    return value + FLAT_ALIGN;
+}
+
+#endif
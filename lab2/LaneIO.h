@@ -0,0 +1,399 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "PhaseStats.h"
+#include "../common/PerfCounters.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Results.h"
+
+// Lanes of a LaneIO channel: small latency-critical control messages and
+// bulk transfers.
+#define LANE_CONTROL 0
+#define LANE_BULK 1
+#define LANE_COUNT 2
+
+#define LANE_CONTROL_SIZE 128
+#define LANE_CONTROL_SLOTS 64
+#define LANE_BULK_SLOTS 4
+
+// How the consumer picks the next message.
+typedef enum {
+    LANES_OFF,        // one FIFO ring shared by all producers: control waits behind bulk
+    LANES_STRICT,     // always drain the control lane first
+    LANES_WEIGHTED,   // deficit round robin, LANE_WEIGHTS quanta of PACKET_SIZE bytes per round
+} LanePolicy;
+
+static const char *LANE_POLICY_NAMES[] = { "off", "strict", "weighted" };
+static const int LANE_WEIGHTS[LANE_COUNT] = { 1, 1 };
+
+// A single-producer ring, unless producers share it (LANES_OFF), in which
+// case they hold a ticket lock for the whole send. The ticket lock is FIFO,
+// so a control message waits for the bulk sends ahead of it, but is never
+// starved by a bulk producer that re-acquires the lock straight away.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t head;   // next slot the producer fills
+    _Alignas(64) _Atomic uint64_t tail;   // next slot the consumer takes
+    _Alignas(64) _Atomic uint32_t next_ticket;
+    _Atomic uint32_t now_serving;
+    int slots;
+    int slot_size;
+    size_t stride;
+    size_t offset;                        // of slot 0 from the region start
+} Lane;
+
+typedef struct {
+    uint64_t control_received;
+    uint64_t average_latency_ns;
+    uint64_t p99_latency_ns;
+    uint64_t max_latency_ns;
+    uint64_t bulk_bytes;
+    uint64_t wall_ns;
+} LaneStats;
+
+typedef struct {
+    _Alignas(64) _Atomic int closed;
+    LanePolicy policy;
+    int lanes;
+    LaneStats stats;
+    Lane lane[LANE_COUNT];
+} LaneRegion;
+
+typedef struct {
+    LaneRegion *region;
+    uint8_t *base;
+    int64_t deficit[LANE_COUNT];   // consumer side, LANES_WEIGHTED
+    int next;                      // lane the next weighted round starts with
+} LaneIO;
+
+static size_t lane_stride(int slot_size) {
+    return (sizeof(int) + slot_size + 63) & ~(size_t)63;
+}
+
+static size_t lane_header_size() {
+    return (sizeof(LaneRegion) + 63) & ~(size_t)63;
+}
+
+// The shared ring carries both kinds of message.
+static int lane_shared_slot_size(int packet_size) {
+    return packet_size > LANE_CONTROL_SIZE ? packet_size : LANE_CONTROL_SIZE;
+}
+
+// Large enough for either layout with `packet_size` bulk messages.
+size_t LaneIO_region_size(int packet_size) {
+    size_t shared = LANE_BULK_SLOTS * lane_stride(lane_shared_slot_size(packet_size));
+    size_t lanes = LANE_CONTROL_SLOTS * lane_stride(LANE_CONTROL_SIZE) + LANE_BULK_SLOTS * lane_stride(packet_size);
+    return lane_header_size() + (shared > lanes ? shared : lanes);
+}
+
+static void lane_layout(Lane *lane, int slots, int slot_size, size_t *offset) {
+    lane->slots = slots;
+    lane->slot_size = slot_size;
+    lane->stride = lane_stride(slot_size);
+    lane->offset = *offset;
+    *offset += (size_t)slots * lane->stride;
+}
+
+void LaneIO_attach(LaneIO *io, uint8_t *ptr) {
+    io->region = (LaneRegion *)ptr;
+    io->base = ptr;
+    memset(io->deficit, 0, sizeof(io->deficit));
+    io->next = 0;
+}
+
+void LaneIO_init(LaneIO *io, uint8_t *ptr, LanePolicy policy, int packet_size) {
+    LaneRegion *region = (LaneRegion *)ptr;
+    size_t offset = lane_header_size();
+
+    memset(region, 0, sizeof(*region));
+    region->policy = policy;
+    if (policy == LANES_OFF) {
+        region->lanes = 1;
+        lane_layout(&region->lane[0], LANE_BULK_SLOTS, lane_shared_slot_size(packet_size), &offset);
+    } else {
+        region->lanes = LANE_COUNT;
+        lane_layout(&region->lane[LANE_CONTROL], LANE_CONTROL_SLOTS, LANE_CONTROL_SIZE, &offset);
+        lane_layout(&region->lane[LANE_BULK], LANE_BULK_SLOTS, packet_size, &offset);
+    }
+    LaneIO_attach(io, ptr);
+}
+
+static uint8_t *lane_slot(LaneIO *io, Lane *lane, uint64_t index) {
+    return io->base + lane->offset + (index % lane->slots) * lane->stride;
+}
+
+// Sends on `lane`; with LANES_OFF every lane maps to the one shared ring.
+void LaneIO_send(LaneIO *io, int lane_index, const uint8_t *bytes, int len) {
+    bool shared = io->region->lanes == 1;
+    Lane *lane = &io->region->lane[shared ? 0 : lane_index];
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
+
+    if (shared) {
+        uint32_t ticket = atomic_fetch_add(&lane->next_ticket, 1);
+        while (atomic_load_explicit(&lane->now_serving, memory_order_acquire) != ticket) {
+            wait_relax();
+        }
+    }
+
+    uint64_t head = atomic_load_explicit(&lane->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&lane->tail, memory_order_acquire) == (uint64_t)lane->slots) {
+        wait_relax();
+    }
+    PhaseTimer_mark(&timer, PHASE_LANEIO, PHASE_WAIT);
+
+    uint8_t *slot = lane_slot(io, lane, head);
+    memcpy(slot, &len, sizeof(len));
+    memcpy(slot + sizeof(int), bytes, len);
+    PhaseTimer_mark(&timer, PHASE_LANEIO, PHASE_COPY);
+
+    atomic_store_explicit(&lane->head, head + 1, memory_order_release);
+    if (shared) {
+        atomic_fetch_add_explicit(&lane->now_serving, 1, memory_order_release);
+    }
+    PhaseTimer_mark(&timer, PHASE_LANEIO, PHASE_PUBLISH);
+}
+
+void LaneIO_close(LaneIO *io) {
+    atomic_store(&io->region->closed, 1);
+}
+
+static int lane_length(LaneIO *io, Lane *lane) {
+    uint64_t tail = atomic_load_explicit(&lane->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&lane->head, memory_order_acquire)) {
+        return -1;
+    }
+    int len;
+    memcpy(&len, lane_slot(io, lane, tail), sizeof(len));
+    return len;
+}
+
+static int lane_take(LaneIO *io, Lane *lane, uint8_t *out_data, int max_size) {
+    uint64_t tail = atomic_load_explicit(&lane->tail, memory_order_relaxed);
+    uint8_t *slot = lane_slot(io, lane, tail);
+    int len;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+    memcpy(&len, slot, sizeof(len));
+    len = len < max_size ? len : max_size;
+    memcpy(out_data, slot + sizeof(int), len);
+    PhaseTimer_mark(&timer, PHASE_LANEIO, PHASE_COPY);
+
+    atomic_store_explicit(&lane->tail, tail + 1, memory_order_release);
+    PhaseTimer_mark(&timer, PHASE_LANEIO, PHASE_PUBLISH);
+    return len;
+}
+
+// Picks a lane with a message under the region's policy, or -1.
+static int lane_pick(LaneIO *io) {
+    LaneRegion *region = io->region;
+
+    if (region->policy != LANES_WEIGHTED) {
+        for (int l = 0; l < region->lanes; l++) {
+            if (lane_length(io, &region->lane[l]) >= 0) {
+                return l;
+            }
+        }
+        return -1;
+    }
+
+    // Deficit round robin: a lane may send while its head message fits in
+    // the credit it has left this round; an empty lane keeps no credit.
+    for (int visited = 0; visited <= region->lanes; visited++) {
+        int l = io->next;
+        int len = lane_length(io, &region->lane[l]);
+
+        if (len < 0) {
+            io->deficit[l] = 0;
+        } else if (len <= io->deficit[l]) {
+            io->deficit[l] -= len;
+            return l;
+        }
+        io->next = (l + 1) % region->lanes;
+        io->deficit[io->next] += (int64_t)LANE_WEIGHTS[io->next] * PACKET_SIZE;
+    }
+    return -1;
+}
+
+// Waits for the next message; returns its length and lane, or -1 once the
+// channel is closed and drained.
+int LaneIO_receive(LaneIO *io, uint8_t *out_data, int max_size, int *lane) {
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+    while (true) {
+        int l = lane_pick(io);
+        if (l >= 0) {
+            PhaseTimer_mark(&timer, PHASE_LANEIO, PHASE_WAIT);
+            *lane = l;
+            return lane_take(io, &io->region->lane[l], out_data, max_size);
+        }
+        if (atomic_load(&io->region->closed)) {
+            return -1;
+        }
+        wait_relax();
+    }
+}
+
+static int lane_compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Control messages carry their send time in the first eight bytes; bulk
+// messages carry zero there, which tells them apart on the shared ring.
+static void lane_consumer_process(LaneIO *io, uint64_t control_messages) {
+    uint64_t *latencies = (uint64_t *)malloc(control_messages * sizeof(uint64_t));
+    uint8_t *data = (uint8_t *)malloc(PACKET_SIZE);
+    LaneStats *stats = &io->region->stats;
+    uint64_t received = 0;
+    int len, lane;
+
+    uint64_t startTime = getCurTimeNs();
+    while ((len = LaneIO_receive(io, data, PACKET_SIZE, &lane)) >= 0) {
+        uint64_t sent;
+        memcpy(&sent, data, sizeof(sent));
+        if (sent == 0) {
+            stats->bulk_bytes += len;
+        } else if (received < control_messages) {
+            latencies[received++] = getCurTimeNs() - sent;
+        }
+    }
+    stats->wall_ns = getCurTimeNs() - startTime;
+    stats->control_received = received;
+
+    if (received > 0) {
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < received; i++) {
+            total += latencies[i];
+        }
+        qsort(latencies, received, sizeof(uint64_t), lane_compare_u64);
+        stats->average_latency_ns = total / received;
+        stats->p99_latency_ns = latencies[received * 99 / 100];
+        stats->max_latency_ns = latencies[received - 1];
+    }
+
+    free(data);
+    free(latencies);
+    PhaseStats_dump("lane consumer");
+}
+
+typedef struct {
+    LaneIO *io;
+    _Atomic int stop;
+    uint64_t sent;
+} LaneBulkProducer;
+
+// Keeps the bulk lane full until told to stop.
+static void *lane_bulk_producer(void *arg) {
+    LaneBulkProducer *producer = (LaneBulkProducer *)arg;
+    uint8_t *data = (uint8_t *)calloc(PACKET_SIZE, 1);
+
+    while (!atomic_load(&producer->stop)) {
+        LaneIO_send(producer->io, LANE_BULK, data, PACKET_SIZE);
+        producer->sent++;
+    }
+
+    free(data);
+    return NULL;
+}
+
+// A bulk producer thread streams PACKET_SIZE messages while the calling
+// thread sends `control_messages` timestamped 128-byte messages, `gap_us`
+// apart, to a consumer process.
+// result: average, p99 and max control latency (s), bulk throughput (MB/s).
+double* compute_mixed_LaneIO(uint8_t *ptr, LanePolicy policy, uint64_t control_messages, int gap_us) {
+    double *result = (double *)malloc(4 * sizeof(double));
+    LaneIO io;
+    LaneIO_init(&io, ptr, policy, PACKET_SIZE);
+
+    fflush(stdout);
+    int p = fork();
+
+    if (p == 0) {
+        lane_consumer_process(&io, control_messages);
+        exit(0);
+    }
+
+    LaneBulkProducer producer = { &io, 0, 0 };
+    pthread_t bulk;
+    pthread_create(&bulk, NULL, lane_bulk_producer, &producer);
+
+    uint8_t data[LANE_CONTROL_SIZE];
+    memset(data, 0, sizeof(data));
+    struct timespec gap = { 0, gap_us * 1000L };
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+
+    for (uint64_t k = 0; k < control_messages; k++) {
+        nanosleep(&gap, NULL);
+        PerfCounters_start(&counters);
+        uint64_t now = getCurTimeNs();
+        memcpy(data, &now, sizeof(now));
+        LaneIO_send(&io, LANE_CONTROL, data, sizeof(data));
+        PerfCounters_stop(&counters);
+    }
+
+    atomic_store(&producer.stop, 1);
+    pthread_join(bulk, NULL);
+    LaneIO_close(&io);
+    waitpid(p, NULL, 0);
+    PhaseStats_dump("lane producers");
+    PerfCounters_print(&counters, "lane control producer", control_messages, "message");
+    PerfCounters_close(&counters);
+
+    LaneStats *stats = &io.region->stats;
+    result[0] = (double)stats->average_latency_ns / 1000000000.0;
+    result[1] = (double)stats->p99_latency_ns / 1000000000.0;
+    result[2] = (double)stats->max_latency_ns / 1000000000.0;
+    result[3] = stats->wall_ns ? (double)stats->bulk_bytes / (1024.0 * 1024.0) / ((double)stats->wall_ns / 1000000000.0) : 0;
+
+    printf("Lanes: %s, Control latency: %f s (p99 %f s), Bulk: %f MB/s\n", LANE_POLICY_NAMES[policy], result[0],
+           result[1], result[3]);
+    return result;
+}
+
+// Each policy runs NUMBER_OF_EXPERIMENTS times with 1000 control messages,
+// one sample per run; the table shows the mean of the runs.
+void run_benchmark_LaneIO(const char *name, uint8_t *ptr) {
+    printf("Starting benchmark for method: %s\n", name);
+
+    const LanePolicy policies[] = { LANES_OFF, LANES_STRICT, LANES_WEIGHTED };
+    const int number_of_policies = sizeof(policies) / sizeof(policies[0]);
+    double *results[number_of_policies][NUMBER_OF_EXPERIMENTS];
+
+    for (int i = 0; i < number_of_policies; i++) {
+        for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+            results[i][e] = compute_mixed_LaneIO(ptr, policies[i], 1000, 50);
+        }
+    }
+
+    printf("Bulk message size: %d B, control message size: %d B, mean of %d experiments\n", PACKET_SIZE,
+           LANE_CONTROL_SIZE, NUMBER_OF_EXPERIMENTS);
+    printf("+----------+--------------+--------------+--------------+-------------------+\n");
+    printf("|  Lanes   | Control (us) |   p99 (us)   |   Max (us)   | Bulk (MB/s)       |\n");
+    printf("+----------+--------------+--------------+--------------+-------------------+\n");
+    for (int i = 0; i < number_of_policies; i++) {
+        const char *variant = LANE_POLICY_NAMES[policies[i]];
+        double mean[4];
+        mean[0] = Results_record_column(name, variant, "control_latency", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 0);
+        mean[1] = Results_record_column(name, variant, "control_p99", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 1);
+        mean[2] = Results_record_column(name, variant, "control_max", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 2);
+        mean[3] = Results_record_column(name, variant, "bulk_throughput", "MB/s", false, results[i], NUMBER_OF_EXPERIMENTS, 3);
+
+        printf("| %-8s | %12.3lf | %12.3lf | %12.3lf | %17.1lf |\n", variant, mean[0] * 1000000.0,
+               mean[1] * 1000000.0, mean[2] * 1000000.0, mean[3]);
+        for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+            free(results[i][e]);
+        }
+    }
+    printf("+----------+--------------+--------------+--------------+-------------------+\n");
+}
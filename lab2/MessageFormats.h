@@ -0,0 +1,461 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Settings.h"
+#include "EchoPeer.h"
+#include "FlatMessage.h"
+#include "../common/PerfCounters.h"
+#include "../common/Results.h"
+
+// What it costs to move a structured payload rather than opaque bytes: an
+// order with scalars, two strings and a vector of fills, sent over MmapIO
+// as
+//   packed - a packed struct with fixed-size arrays, memcpy'd both ways;
+//   varint - LEB128 integers and length-prefixed strings, parsed back into a
+//            native struct;
+//   flat   - FlatMessage built straight into the slot (MmapIO_reserve) and
+//            read in place by the peer (MmapIO_peek), with no copy at all.
+// The peer touches every field and answers with a checksum of them, which
+// the sender compares with its own.
+
+#define ORDER_SYMBOL_MAX 16
+#define ORDER_ACCOUNT_MAX 32
+#define ORDER_FILLS_MAX 64
+#define ORDER_SAMPLES 64
+#define FORMAT_SLOT_SIZE 1024
+
+typedef enum {
+    FORMAT_PACKED,
+    FORMAT_VARINT,
+    FORMAT_FLAT,
+} MessageFormat;
+
+static const char *MESSAGE_FORMAT_NAMES[] = { "packed", "varint", "flat" };
+
+typedef struct {
+    uint64_t id;
+    uint64_t timestamp;
+    double price;
+    uint32_t quantity;
+    uint32_t symbol_len;
+    char symbol[ORDER_SYMBOL_MAX];
+    uint32_t account_len;
+    char account[ORDER_ACCOUNT_MAX];
+    uint32_t fill_count;
+    double fills[ORDER_FILLS_MAX];
+} Order;
+
+typedef struct __attribute__((packed)) {
+    uint64_t id;
+    uint64_t timestamp;
+    double price;
+    uint32_t quantity;
+    uint8_t symbol_len;
+    char symbol[ORDER_SYMBOL_MAX];
+    uint8_t account_len;
+    char account[ORDER_ACCOUNT_MAX];
+    uint8_t fill_count;
+    double fills[ORDER_FILLS_MAX];
+} PackedOrder;
+
+enum {
+    ORDER_ID,
+    ORDER_TIMESTAMP,
+    ORDER_PRICE,
+    ORDER_QUANTITY,
+    ORDER_SYMBOL,
+    ORDER_ACCOUNT,
+    ORDER_FILLS,
+    ORDER_FIELD_COUNT,
+};
+
+static const FlatField ORDER_FIELDS[ORDER_FIELD_COUNT] = {
+    { "id", FLAT_U64, 0 },
+    { "timestamp", FLAT_U64, 0 },
+    { "price", FLAT_F64, 0 },
+    { "quantity", FLAT_U32, 0 },
+    { "symbol", FLAT_STRING, 0 },
+    { "account", FLAT_STRING, 0 },
+    { "fills", FLAT_VECTOR, sizeof(double) },
+};
+
+static const FlatSchema ORDER_SCHEMA = { 1, ORDER_FIELD_COUNT, ORDER_FIELDS };
+
+// Set before the peer starts; a forked peer gets its own copy.
+static MessageFormat message_format;
+
+// Keeps the in-process encode and decode loops from being optimised away.
+static volatile uint64_t message_format_sink;
+
+static uint64_t order_mix(uint64_t hash, uint64_t value) {
+    return (hash ^ value) * 0x100000001b3ull;
+}
+
+static uint64_t order_mix_f64(uint64_t hash, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return order_mix(hash, bits);
+}
+
+static uint64_t order_mix_text(uint64_t hash, const char *text, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        hash = order_mix(hash, (uint8_t)text[i]);
+    }
+    return order_mix(hash, len);
+}
+
+// Touches every field, so each format pays for reading all of them.
+static uint64_t order_checksum(uint64_t id, uint64_t timestamp, double price, uint32_t quantity, const char *symbol,
+                               uint32_t symbol_len, const char *account, uint32_t account_len, const double *fills,
+                               uint32_t fill_count) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = order_mix(hash, id);
+    hash = order_mix(hash, timestamp);
+    hash = order_mix_f64(hash, price);
+    hash = order_mix(hash, quantity);
+    hash = order_mix_text(hash, symbol, symbol_len);
+    hash = order_mix_text(hash, account, account_len);
+    for (uint32_t i = 0; i < fill_count; i++) {
+        hash = order_mix_f64(hash, fills[i]);
+    }
+    return order_mix(hash, fill_count);
+}
+
+static uint64_t Order_checksum(const Order *order) {
+    return order_checksum(order->id, order->timestamp, order->price, order->quantity, order->symbol,
+                          order->symbol_len, order->account, order->account_len, order->fills, order->fill_count);
+}
+
+// Orders of different shapes: short and long strings, 0 to 60 fills.
+static void orders_init(Order *orders, int count) {
+    static const char *symbols[] = { "AAPL", "MSFT", "BRK.B", "GOOGL", "NVDA", "TSLA" };
+    static const char *accounts[] = { "retail-1", "institutional-account-00042", "desk-7", "fund-alpha-omega" };
+
+    memset(orders, 0, count * sizeof(Order));
+    for (int i = 0; i < count; i++) {
+        Order *order = &orders[i];
+        order->id = 1000000 + (uint64_t)i * 7919;
+        order->timestamp = 1700000000000000000ull + (uint64_t)i * 123456789;
+        order->price = 100.0 + i * 0.25;
+        order->quantity = 100 * (i % 50 + 1);
+        order->symbol_len = strlen(symbols[i % 6]);
+        memcpy(order->symbol, symbols[i % 6], order->symbol_len);
+        order->account_len = strlen(accounts[i % 4]);
+        memcpy(order->account, accounts[i % 4], order->account_len);
+        order->fill_count = (i * 13) % (ORDER_FILLS_MAX - 3);
+        for (uint32_t f = 0; f < order->fill_count; f++) {
+            order->fills[f] = order->price + f * 0.01;
+        }
+    }
+}
+
+static int packed_encode(const Order *order, uint8_t *out) {
+    PackedOrder packed;
+    packed.id = order->id;
+    packed.timestamp = order->timestamp;
+    packed.price = order->price;
+    packed.quantity = order->quantity;
+    packed.symbol_len = order->symbol_len;
+    memcpy(packed.symbol, order->symbol, ORDER_SYMBOL_MAX);
+    packed.account_len = order->account_len;
+    memcpy(packed.account, order->account, ORDER_ACCOUNT_MAX);
+    packed.fill_count = order->fill_count;
+    memcpy(packed.fills, order->fills, sizeof(packed.fills));
+    memcpy(out, &packed, sizeof(packed));
+    return sizeof(packed);
+}
+
+static uint64_t packed_checksum(const uint8_t *bytes, int size) {
+    PackedOrder packed;
+    if (size != (int)sizeof(packed)) {
+        return 0;
+    }
+    memcpy(&packed, bytes, sizeof(packed));
+    double fills[ORDER_FILLS_MAX];
+    uint32_t fill_count = packed.fill_count < ORDER_FILLS_MAX ? packed.fill_count : ORDER_FILLS_MAX;
+    memcpy(fills, packed.fills, sizeof(fills));
+    return order_checksum(packed.id, packed.timestamp, packed.price, packed.quantity, packed.symbol,
+                          packed.symbol_len < ORDER_SYMBOL_MAX ? packed.symbol_len : ORDER_SYMBOL_MAX,
+                          packed.account, packed.account_len < ORDER_ACCOUNT_MAX ? packed.account_len : ORDER_ACCOUNT_MAX,
+                          fills, fill_count);
+}
+
+static uint8_t *varint_put(uint8_t *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+// NULL once `in` would pass `end`.
+static const uint8_t *varint_get(const uint8_t *in, const uint8_t *end, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; in != NULL && in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+static const uint8_t *varint_get_bytes(const uint8_t *in, const uint8_t *end, void *out, uint64_t len) {
+    if (in == NULL || len > (uint64_t)(end - in)) {
+        return NULL;
+    }
+    memcpy(out, in, len);
+    return in + len;
+}
+
+static int varint_encode(const Order *order, uint8_t *out) {
+    uint8_t *p = out;
+    p = varint_put(p, order->id);
+    p = varint_put(p, order->timestamp);
+    memcpy(p, &order->price, sizeof(double));
+    p += sizeof(double);
+    p = varint_put(p, order->quantity);
+    p = varint_put(p, order->symbol_len);
+    memcpy(p, order->symbol, order->symbol_len);
+    p += order->symbol_len;
+    p = varint_put(p, order->account_len);
+    memcpy(p, order->account, order->account_len);
+    p += order->account_len;
+    p = varint_put(p, order->fill_count);
+    memcpy(p, order->fills, order->fill_count * sizeof(double));
+    p += order->fill_count * sizeof(double);
+    return (int)(p - out);
+}
+
+// Parses into a native Order first, as a generated decoder would.
+static uint64_t varint_checksum(const uint8_t *bytes, int size) {
+    const uint8_t *p = bytes, *end = bytes + size;
+    uint64_t quantity = 0, symbol_len = 0, account_len = 0, fill_count = 0;
+    Order order;
+
+    p = varint_get(p, end, &order.id);
+    p = p ? varint_get(p, end, &order.timestamp) : NULL;
+    p = varint_get_bytes(p, end, &order.price, sizeof(double));
+    p = p ? varint_get(p, end, &quantity) : NULL;
+    p = p ? varint_get(p, end, &symbol_len) : NULL;
+    p = symbol_len <= ORDER_SYMBOL_MAX ? varint_get_bytes(p, end, order.symbol, symbol_len) : NULL;
+    p = p ? varint_get(p, end, &account_len) : NULL;
+    p = account_len <= ORDER_ACCOUNT_MAX ? varint_get_bytes(p, end, order.account, account_len) : NULL;
+    p = p ? varint_get(p, end, &fill_count) : NULL;
+    p = fill_count <= ORDER_FILLS_MAX ? varint_get_bytes(p, end, order.fills, fill_count * sizeof(double)) : NULL;
+    if (p == NULL) {
+        return 0;
+    }
+
+    order.quantity = quantity;
+    order.symbol_len = symbol_len;
+    order.account_len = account_len;
+    order.fill_count = fill_count;
+    return Order_checksum(&order);
+}
+
+static int flat_encode(const Order *order, uint8_t *out, int capacity) {
+    FlatBuilder builder;
+    FlatBuilder_init(&builder, &ORDER_SCHEMA, out, capacity);
+    FlatBuilder_u64(&builder, ORDER_ID, order->id);
+    FlatBuilder_u64(&builder, ORDER_TIMESTAMP, order->timestamp);
+    FlatBuilder_f64(&builder, ORDER_PRICE, order->price);
+    FlatBuilder_u32(&builder, ORDER_QUANTITY, order->quantity);
+    FlatBuilder_string(&builder, ORDER_SYMBOL, order->symbol, order->symbol_len);
+    FlatBuilder_string(&builder, ORDER_ACCOUNT, order->account, order->account_len);
+    double *fills = (double *)FlatBuilder_vector(&builder, ORDER_FILLS, order->fill_count);
+    for (uint32_t f = 0; fills != NULL && f < order->fill_count; f++) {
+        fills[f] = order->fills[f];
+    }
+    return FlatBuilder_finish(&builder);
+}
+
+// Reads every field where it lies.
+static uint64_t flat_checksum(const uint8_t *bytes, int size) {
+    FlatMessage message;
+    uint32_t symbol_len = 0, account_len = 0, fill_count = 0;
+
+    if (!FlatMessage_init(&message, &ORDER_SCHEMA, bytes, size)) {
+        return 0;
+    }
+    const char *symbol = FlatMessage_string(&message, ORDER_SYMBOL, &symbol_len);
+    const char *account = FlatMessage_string(&message, ORDER_ACCOUNT, &account_len);
+    const double *fills = (const double *)FlatMessage_vector(&message, ORDER_FILLS, &fill_count);
+    if (symbol == NULL || account == NULL || fills == NULL) {
+        return 0;
+    }
+    return order_checksum(FlatMessage_u64(&message, ORDER_ID, 0), FlatMessage_u64(&message, ORDER_TIMESTAMP, 0),
+                          FlatMessage_f64(&message, ORDER_PRICE, 0), FlatMessage_u32(&message, ORDER_QUANTITY, 0),
+                          symbol, symbol_len, account, account_len, fills, fill_count);
+}
+
+static int format_encode(MessageFormat format, const Order *order, uint8_t *out, int capacity) {
+    switch (format) {
+        case FORMAT_PACKED:
+            return packed_encode(order, out);
+        case FORMAT_VARINT:
+            return varint_encode(order, out);
+        case FORMAT_FLAT:
+            return flat_encode(order, out, capacity);
+    }
+    return -1;
+}
+
+static uint64_t format_checksum(MessageFormat format, const uint8_t *bytes, int size) {
+    switch (format) {
+        case FORMAT_PACKED:
+            return packed_checksum(bytes, size);
+        case FORMAT_VARINT:
+            return varint_checksum(bytes, size);
+        case FORMAT_FLAT:
+            return flat_checksum(bytes, size);
+    }
+    return 0;
+}
+
+// Decodes each order and answers with its checksum. Flat messages are read
+// in the slot itself; the others are copied out first, as read_bytes does.
+void *echo_MessageFormat(void *arg) {
+    MmapIO *io = (MmapIO *)arg;
+    _Alignas(FLAT_ALIGN) uint8_t data[FORMAT_SLOT_SIZE];
+    uint64_t checksum;
+    int size;
+
+    while (true) {
+        if (message_format == FORMAT_FLAT) {
+            const uint8_t *message = MmapIO_peek(io, &size);
+            if (message == NULL) {
+                break;
+            }
+            checksum = flat_checksum(message, size);
+            MmapIO_release(io);
+        } else {
+            size = MmapIO_read_bytes(io, data, sizeof(data));
+            if (size <= 0) {
+                break;
+            }
+            checksum = format_checksum(message_format, data, size);
+        }
+        MmapIO_write_bytes(io, (const uint8_t *)&checksum, sizeof(checksum));
+    }
+
+    PhaseStats_dump("message format peer");
+    return NULL;
+}
+
+// result: encode and decode time per message in-process (s), round trip
+// over MmapIO with the peer decoding (s), average size on the wire (B).
+double* compute_format_MessageFormat(MmapIO *io_first, MmapIO *io_second, MessageFormat format, uint64_t number_of_messages) {
+    double *result = (double *)malloc(4 * sizeof(double));
+    Order orders[ORDER_SAMPLES];
+    uint64_t expected[ORDER_SAMPLES];
+    _Alignas(FLAT_ALIGN) uint8_t encoded[ORDER_SAMPLES][FORMAT_SLOT_SIZE];
+    int sizes[ORDER_SAMPLES];
+    uint64_t wire_bytes = 0, failures = 0, sink = 0;
+
+    orders_init(orders, ORDER_SAMPLES);
+    for (int i = 0; i < ORDER_SAMPLES; i++) {
+        expected[i] = Order_checksum(&orders[i]);
+        sizes[i] = format_encode(format, &orders[i], encoded[i], FORMAT_SLOT_SIZE);
+        wire_bytes += sizes[i];
+        failures += format_checksum(format, encoded[i], sizes[i]) != expected[i];
+    }
+
+    uint64_t startTime = getCurTimeNs();
+    for (uint64_t k = 0; k < number_of_messages; k++) {
+        sink += format_encode(format, &orders[k % ORDER_SAMPLES], encoded[k % ORDER_SAMPLES], FORMAT_SLOT_SIZE);
+    }
+    uint64_t encodeTime = getCurTimeNs() - startTime;
+
+    startTime = getCurTimeNs();
+    for (uint64_t k = 0; k < number_of_messages; k++) {
+        sink += format_checksum(format, encoded[k % ORDER_SAMPLES], sizes[k % ORDER_SAMPLES]);
+    }
+    uint64_t decodeTime = getCurTimeNs() - startTime;
+
+    message_format = format;
+    EchoPeer peer;
+    EchoPeer_start(&peer, EXEC_PROCESS, echo_MessageFormat, io_second);
+
+    _Alignas(FLAT_ALIGN) uint8_t data[FORMAT_SLOT_SIZE];
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    PerfCounters_start(&counters);
+
+    startTime = getCurTimeNs();
+    for (uint64_t k = 0; k < number_of_messages; k++) {
+        const Order *order = &orders[k % ORDER_SAMPLES];
+        uint64_t checksum = 0;
+
+        if (format == FORMAT_FLAT) {
+            uint8_t *slot = MmapIO_reserve(io_first);
+            MmapIO_commit(io_first, flat_encode(order, slot, FORMAT_SLOT_SIZE));
+        } else {
+            MmapIO_write_bytes(io_first, data, format_encode(format, order, data, sizeof(data)));
+        }
+        MmapIO_read_bytes(io_first, (uint8_t *)&checksum, sizeof(checksum));
+        failures += checksum != expected[k % ORDER_SAMPLES];
+    }
+    uint64_t roundTripTime = getCurTimeNs() - startTime;
+    PerfCounters_stop(&counters);
+
+    MmapIO_close(io_first);
+    EchoPeer_join(&peer);
+    PerfCounters_print(&counters, MESSAGE_FORMAT_NAMES[format], number_of_messages, "message");
+    PerfCounters_close(&counters);
+
+    result[0] = (double)encodeTime / (double)number_of_messages / 1000000000.0;
+    result[1] = (double)decodeTime / (double)number_of_messages / 1000000000.0;
+    result[2] = (double)roundTripTime / (double)number_of_messages / 1000000000.0;
+    result[3] = (double)wire_bytes / ORDER_SAMPLES;
+
+    if (failures) printf("Checksum mismatches: %lu\n", failures);
+    message_format_sink = sink;
+    printf("Format: %s, Encode: %f s, Decode: %f s, Round trip: %f s, Size: %.0f B\n", MESSAGE_FORMAT_NAMES[format],
+           result[0], result[1], result[2], result[3]);
+    return result;
+}
+
+// Each format runs NUMBER_OF_EXPERIMENTS times with 10000 messages, one
+// sample per run; the table shows the mean of the runs.
+void run_benchmark_MessageFormat(const char *name, uint8_t *ptr) {
+    printf("Starting benchmark for method: %s\n", name);
+
+    const MessageFormat formats[] = { FORMAT_PACKED, FORMAT_VARINT, FORMAT_FLAT };
+    const int number_of_formats = sizeof(formats) / sizeof(formats[0]);
+    double *results[number_of_formats][NUMBER_OF_EXPERIMENTS];
+
+    for (int i = 0; i < number_of_formats; i++) {
+        for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+            MmapIO io1, io2;
+            memset(ptr, 0, sizeof(int) * 2);
+            MmapIO_init(&io1, ptr, 1);
+            MmapIO_init(&io2, ptr, 2);
+            results[i][e] = compute_format_MessageFormat(&io1, &io2, formats[i], 10000);
+        }
+    }
+
+    printf("Mean of %d experiments\n", NUMBER_OF_EXPERIMENTS);
+    printf("+----------+--------------+--------------+-----------------+-----------+\n");
+    printf("|  Format  | Encode (ns)  | Decode (ns)  | Round trip (us) | Size (B)  |\n");
+    printf("+----------+--------------+--------------+-----------------+-----------+\n");
+    for (int i = 0; i < number_of_formats; i++) {
+        const char *variant = MESSAGE_FORMAT_NAMES[formats[i]];
+        double mean[4];
+        mean[0] = Results_record_column(name, variant, "encode", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 0);
+        mean[1] = Results_record_column(name, variant, "decode", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 1);
+        mean[2] = Results_record_column(name, variant, "round_trip", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 2);
+        mean[3] = Results_record_column(name, variant, "wire_size", "B", true, results[i], NUMBER_OF_EXPERIMENTS, 3);
+
+        printf("| %-8s | %12.1lf | %12.1lf | %15.3lf | %9.0lf |\n", variant, mean[0] * 1000000000.0,
+               mean[1] * 1000000000.0, mean[2] * 1000000.0, mean[3]);
+        for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+            free(results[i][e]);
+        }
+    }
+    printf("+----------+--------------+--------------+-----------------+-----------+\n");
+}
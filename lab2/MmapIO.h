@@ -1,4 +1,3 @@
-#include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -10,10 +9,12 @@
 #include <time.h>
 #include <unistd.h>
 #include <sys/mman.h>
-#include "config.h"
-
-#define read_bytes MmapIO_read_bytes
-#define write_bytes MmapIO_write_bytes
+#include "Settings.h"
+#include "EchoPeer.h"
+#include "OneWay.h"
+#include "PhaseStats.h"
+#include "Transport.h"
+#include "EchoBenchmark.h"
 
 typedef struct {
     int sender;
@@ -41,16 +42,26 @@ void MmapIO_write_bytes(MmapIO *mmap_io, const uint8_t *bytes, int len) {
         return;
     }
 
-    while (*mmap_io->size_ptr) {}
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
+
+    while (*mmap_io->size_ptr) {
+        wait_relax();
+    }
 
     if (*mmap_io->size_ptr == -1) {
         MmapIO_close(mmap_io);
         return;
     }
 
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_WAIT);
+
     memcpy(mmap_io->data_ptr, bytes, len);
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_COPY);
+
     *mmap_io->size_ptr = len;
     *mmap_io->other_ptr = mmap_io->sender;
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_PUBLISH);
 }
 
 int MmapIO_read_bytes(MmapIO *mmap_io, uint8_t *out_data, int max_size) {
@@ -59,145 +70,154 @@ int MmapIO_read_bytes(MmapIO *mmap_io, uint8_t *out_data, int max_size) {
     }
 
     int size, other;
+    uint64_t polls = 0;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
 
     do {
+        wait_retry(&polls);
         other = *mmap_io->other_ptr;
         size = *mmap_io->size_ptr;
     } while (!size || other == mmap_io->sender);
 
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_WAIT);
+
     if (size == -1) {
         MmapIO_close(mmap_io);
         return -1;
     }
 
+    // A message longer than max_size is cut short; the rest is dropped
+    // when the slot is released.
+    size = size < max_size ? size : max_size;
     memcpy(out_data, mmap_io->data_ptr, size);
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_COPY);
+
     *mmap_io->size_ptr = 0;
     *mmap_io->other_ptr = mmap_io->sender;
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_PUBLISH);
 
     return size;
 }
 
-double compute_latency_MmapIO(MmapIO *file_io, uint64_t number_of_experiments) {
-    double total_latency = 0;
-    uint8_t data[128];
-    uint8_t response[128];
-
-    for (uint64_t k = 0; k < number_of_experiments; k++) {
-        uint64_t startTime = getCurTime();
+// Zero-copy access to the slot: a writer builds its message in place
+// between reserve and commit, a reader uses it in place between peek and
+// release. Together each pair does what MmapIO_write_bytes or
+// MmapIO_read_bytes does, minus the memcpy.
 
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            data[i] = i;
-        }
+// Waits until the slot is free and returns it (message_capacity() bytes),
+// or NULL once the channel is closed.
+uint8_t *MmapIO_reserve(MmapIO *mmap_io) {
+    if (mmap_io->closed) {
+        return NULL;
+    }
 
-        write_bytes(file_io, data, sizeof(data));
-        int response_size = read_bytes(file_io, response, sizeof(response));
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
 
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            assert(data[i] == response[i]);
-        }
-
-        uint64_t endTime = getCurTime();
-        total_latency += ((double)(endTime - startTime)/1000000.0) / 2;
+    while (*mmap_io->size_ptr > 0) {
+        wait_relax();
     }
 
-    printf("Latency: %f s\n", total_latency / (double)number_of_experiments);
+    if (*mmap_io->size_ptr == -1) {
+        MmapIO_close(mmap_io);
+        return NULL;
+    }
 
-    return total_latency / (double)number_of_experiments;
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_WAIT);
+    return mmap_io->data_ptr;
 }
 
-double compute_throughput_MmapIO(MmapIO *file_io, uint64_t number_of_experiments) {
-    double throughput = 0;
+void MmapIO_commit(MmapIO *mmap_io, int len) {
+    if (mmap_io->closed) {
+        return;
+    }
 
-    for(uint64_t n = 0; n < number_of_experiments; n++) {
-        uint64_t startTime = getCurTime();
-        uint8_t data[PACKET_SIZE];
-        uint8_t response[PACKET_SIZE];
-        uint64_t mega_bytes = 128;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
 
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            data[i] = i;
-        }
+    *mmap_io->size_ptr = len;
+    *mmap_io->other_ptr = mmap_io->sender;
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_PUBLISH);
+}
 
-        for (uint64_t k = 0; k < mega_bytes * 1024 * 1024 / PACKET_SIZE; k++) {
-            write_bytes(file_io, data, sizeof(data));
-            int response_size = read_bytes(file_io, response, sizeof(response));
+// Waits for a message from the other side and returns it in place, or NULL
+// once the channel is closed. The slot stays the reader's until release.
+const uint8_t *MmapIO_peek(MmapIO *mmap_io, int *size) {
+    if (mmap_io->closed) {
+        return NULL;
+    }
 
-            for (uint64_t i = 0; i < sizeof(data); i++) {
-                assert(data[i] == response[i]);
-            }
-        }
+    int other;
+    uint64_t polls = 0;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
 
-        uint64_t endTime = getCurTime();
-        throughput += (double)mega_bytes / ((double)(endTime - startTime) / 1000000.0) * 2;
-    }
+    do {
+        wait_retry(&polls);
+        other = *mmap_io->other_ptr;
+        *size = *mmap_io->size_ptr;
+    } while (!*size || other == mmap_io->sender);
 
-    printf("Throughput: %f MB/s\n", throughput / (double)number_of_experiments);
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_WAIT);
 
-    return throughput / (double)number_of_experiments;
+    if (*size == -1) {
+        MmapIO_close(mmap_io);
+        return NULL;
+    }
+    return mmap_io->data_ptr;
 }
 
-double compute_capacity_MmapIO(MmapIO *file_io, uint64_t number_of_experiments) {
-    double total_max_throughput = 0;
-
-    for(uint64_t n = 0; n < number_of_experiments; n++) {
-        double max_throughput = 0;
-        uint8_t data[PACKET_SIZE];
-        uint8_t response[PACKET_SIZE];
-        uint64_t mega_bytes = 128;
-
-        for (int k = 0; k < 10; k++) {
-            uint64_t startTime = getCurTime();
-
-            for (uint64_t i = 0; i < sizeof(data); i++) {
-                data[i] = i;
-            }
-
-            for (uint64_t k = 0; k < mega_bytes * 1024 * 1024 / PACKET_SIZE; k++) {
-                write_bytes(file_io, data, sizeof(data));
-                int response_size = read_bytes(file_io, response, sizeof(response));
-
-                for (uint64_t i = 0; i < sizeof(data); i++) {
-                    assert(data[i] == response[i]);
-                }
-            }
-            uint64_t endTime = getCurTime();
-            double throughput = (double)mega_bytes / ((double)(endTime - startTime) / 1000000.0) * 2;
-            max_throughput = (max_throughput < throughput) ? throughput : max_throughput;
-        }
-        total_max_throughput += max_throughput;
+void MmapIO_release(MmapIO *mmap_io) {
+    if (mmap_io->closed) {
+        return;
     }
 
-    printf("Capacity: %f MB/s\n", total_max_throughput / (double)number_of_experiments);
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
 
-    return total_max_throughput / (double)number_of_experiments;
+    *mmap_io->size_ptr = 0;
+    *mmap_io->other_ptr = mmap_io->sender;
+    PhaseTimer_mark(&timer, PHASE_MMAPIO, PHASE_PUBLISH);
 }
 
-double* run_benchmark_MmapIO(const char *name, MmapIO *io_first, MmapIO *io_second) {
-    double *result = (double *)malloc(3 * sizeof(double));
+void *echo_MmapIO(void *arg) {
+    MmapIO *io = (MmapIO *)arg;
+    uint8_t *data = (uint8_t *)malloc(message_capacity());
+    int data_size;
 
-    printf("Starting benchmark for method: %s\n", name);
+    do {
+        data_size = MmapIO_read_bytes(io, data, message_capacity());
 
-    int p = fork();
+        if (data_size > 0) {
+            OneWay_echo(data, data_size);
+            MmapIO_write_bytes(io, data, data_size);
+        }
+    } while (data_size > 0);
 
-    if (p == 0) {
-        uint8_t data[PACKET_SIZE];
-        int data_size;
+    free(data);
+    PhaseStats_dump("echo peer");
+    return NULL;
+}
 
-        do {
-            data_size = read_bytes(io_second, data, sizeof(data));
+static void MmapIO_transport_write(void *io, const uint8_t *bytes, int len) {
+    MmapIO_write_bytes((MmapIO *)io, bytes, len);
+}
 
-            if (data_size > 0) {
-                write_bytes(io_second, data, data_size);
-            }
-        } while (data_size > 0);
+static int MmapIO_transport_read(void *io, uint8_t *out_data, int max_size) {
+    return MmapIO_read_bytes((MmapIO *)io, out_data, max_size);
+}
 
-        exit(0);
-    } else {
-        result[0] = compute_latency_MmapIO(io_first, NUMBER_OF_EXPERIMENTS * 10000);
-        result[1] = compute_throughput_MmapIO(io_first, NUMBER_OF_EXPERIMENTS);
-        result[2] = compute_capacity_MmapIO(io_first, NUMBER_OF_EXPERIMENTS);
-        MmapIO_close(io_first);
-    }
-    
-    return result;
+static void MmapIO_transport_close(void *io) {
+    MmapIO_close((MmapIO *)io);
+}
+
+Transport MmapIO_transport(const char *name, MmapIO *mmap_io) {
+    Transport transport = { name, mmap_io, MmapIO_transport_write, MmapIO_transport_read, MmapIO_transport_close };
+    return transport;
+}
+
+double* run_benchmark_MmapIO(const char *name, MmapIO *io_first, MmapIO *io_second, ExecMode mode) {
+    Transport transport = MmapIO_transport(name, io_first);
+    return run_benchmark(&transport, echo_MmapIO, io_second, mode);
 }
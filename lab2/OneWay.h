@@ -0,0 +1,230 @@
+#ifndef ONE_WAY_H
+#define ONE_WAY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PhaseStats.h"
+#include "../common/Results.h"
+#include "../common/Samples.h"
+
+// One-way latency from timestamps carried in the message. Halving the round
+// trip assumes both directions cost the same, but the echo peer wakes up
+// differently from the benchmark thread. So a latency message starts with a
+// OneWayStamp: the sender fills in when it sent the message, the echo peer
+// when it received it and sent it back, and the sender, on receiving the
+// echo, splits the round trip into its forward and backward legs.
+//
+// All stamps are CLOCK_MONOTONIC, which is one clock for every process on
+// the host. The stamps double as a check of that: a message received before
+// it was sent means the processes do not see the same clock. With one clock
+// the fastest trip in each direction shows how much slower one direction
+// is than the other at its best.
+
+#define ONEWAY_MAGIC 0x5453594157454e4full
+
+typedef struct {
+    uint64_t magic;
+    uint64_t sent_ns;            // sender, just before write_bytes
+    uint64_t echo_received_ns;   // echo peer, when read_bytes returned
+    uint64_t echo_sent_ns;       // echo peer, just before write_bytes
+} OneWayStamp;
+
+typedef struct {
+    PhaseHistogram forward;      // sender -> echo peer, every message
+    PhaseHistogram backward;     // echo peer -> sender
+    Samples forward_batches;     // mean per Runner batch, for the results file
+    Samples backward_batches;
+    uint64_t batch_forward_ns;
+    uint64_t batch_backward_ns;
+    uint64_t batch_messages;
+    uint64_t min_forward_ns;
+    uint64_t min_backward_ns;
+    uint64_t round_trips;
+    uint64_t out_of_order;       // stamps that contradict causality
+} OneWayStats;
+
+// Filled by each compute_latency_* and recorded by its run_benchmark_*.
+static OneWayStats oneway_stats;
+
+static void oneway_clear(OneWayStats *stats) {
+    memset(&stats->forward, 0, sizeof(stats->forward));
+    memset(&stats->backward, 0, sizeof(stats->backward));
+    stats->batch_forward_ns = stats->batch_backward_ns = stats->batch_messages = 0;
+    stats->min_forward_ns = stats->min_backward_ns = UINT64_MAX;
+    stats->round_trips = stats->out_of_order = 0;
+}
+
+void OneWay_init(OneWayStats *stats) {
+    Samples_init(&stats->forward_batches, 0);
+    Samples_init(&stats->backward_batches, 0);
+    oneway_clear(stats);
+}
+
+void OneWay_free(OneWayStats *stats) {
+    Samples_free(&stats->forward_batches);
+    Samples_free(&stats->backward_batches);
+}
+
+// Sender: marks `message` (at least sizeof(OneWayStamp) bytes) for stamping.
+static inline void OneWay_stamp(uint8_t *message) {
+    OneWayStamp stamp = { ONEWAY_MAGIC, phase_now(), 0, 0 };
+    memcpy(message, &stamp, sizeof(stamp));
+}
+
+// Echo peer: stamps a marked message on its way back; others are untouched.
+static inline void OneWay_echo(uint8_t *message, int size) {
+    uint64_t received = phase_now();
+    OneWayStamp stamp;
+
+    if (size < (int)sizeof(stamp)) {
+        return;
+    }
+    memcpy(&stamp, message, sizeof(stamp));
+    if (stamp.magic != ONEWAY_MAGIC) {
+        return;
+    }
+    stamp.echo_received_ns = received;
+    stamp.echo_sent_ns = phase_now();
+    memcpy(message, &stamp, sizeof(stamp));
+}
+
+// Sender: accounts for an echoed message that arrived at `received_ns`.
+void OneWay_add(OneWayStats *stats, const uint8_t *response, int size, uint64_t received_ns) {
+    OneWayStamp stamp;
+
+    if (size < (int)sizeof(stamp)) {
+        return;
+    }
+    memcpy(&stamp, response, sizeof(stamp));
+    if (stamp.magic != ONEWAY_MAGIC || stamp.echo_sent_ns == 0) {
+        return;
+    }
+
+    stats->round_trips++;
+    if (stamp.echo_received_ns < stamp.sent_ns || received_ns < stamp.echo_sent_ns) {
+        stats->out_of_order++;
+        return;
+    }
+
+    uint64_t forward = stamp.echo_received_ns - stamp.sent_ns;
+    uint64_t backward = received_ns - stamp.echo_sent_ns;
+    PhaseHistogram_add(&stats->forward, forward);
+    PhaseHistogram_add(&stats->backward, backward);
+    stats->min_forward_ns = forward < stats->min_forward_ns ? forward : stats->min_forward_ns;
+    stats->min_backward_ns = backward < stats->min_backward_ns ? backward : stats->min_backward_ns;
+    stats->batch_forward_ns += forward;
+    stats->batch_backward_ns += backward;
+    stats->batch_messages++;
+}
+
+// Called at the start of every Runner batch: keeps the mean of the batch
+// just finished if it was `measured`, or drops everything so far while the
+// Runner is still warming up.
+void OneWay_batch(OneWayStats *stats, bool measured) {
+    if (!measured) {
+        Samples_clear(&stats->forward_batches);
+        Samples_clear(&stats->backward_batches);
+        oneway_clear(stats);
+        return;
+    }
+    if (stats->batch_messages) {
+        Samples_add(&stats->forward_batches, stats->batch_forward_ns / stats->batch_messages);
+        Samples_add(&stats->backward_batches, stats->batch_backward_ns / stats->batch_messages);
+    }
+    stats->batch_forward_ns = stats->batch_backward_ns = stats->batch_messages = 0;
+}
+
+// The responses of one Runner batch with their arrival times, so their
+// stamps and test patterns are checked once the batch is over instead of
+// pausing the Runner after every message.
+typedef struct {
+    uint8_t *responses;          // `size` bytes per message
+    int *sizes;
+    uint64_t *received_ns;
+    uint64_t count;
+    uint64_t capacity;
+    size_t size;
+} OneWayLog;
+
+void OneWayLog_init(OneWayLog *log, size_t size) {
+    memset(log, 0, sizeof(*log));
+    log->size = size;
+}
+
+void OneWayLog_free(OneWayLog *log) {
+    free(log->responses);
+    free(log->sizes);
+    free(log->received_ns);
+}
+
+// Empties the log and makes room for a batch of `n` messages. It only grows
+// while the Runner calibrates its batch size.
+void OneWayLog_reset(OneWayLog *log, uint64_t n) {
+    if (n > log->capacity) {
+        log->capacity = n;
+        log->responses = (uint8_t *)realloc(log->responses, n * log->size);
+        log->sizes = (int *)realloc(log->sizes, n * sizeof(int));
+        log->received_ns = (uint64_t *)realloc(log->received_ns, n * sizeof(uint64_t));
+    }
+    log->count = 0;
+}
+
+static inline uint8_t *OneWayLog_response(const OneWayLog *log, uint64_t k) {
+    return log->responses + k * log->size;
+}
+
+// Where the next response is read to; OneWayLog_add keeps it.
+static inline uint8_t *OneWayLog_next(const OneWayLog *log) {
+    return OneWayLog_response(log, log->count);
+}
+
+static inline void OneWayLog_add(OneWayLog *log, int size, uint64_t received_ns) {
+    log->sizes[log->count] = size;
+    log->received_ns[log->count] = received_ns;
+    log->count++;
+}
+
+void OneWay_print(const OneWayStats *stats, const char *name) {
+    const PhaseHistogram *legs[] = { &stats->forward, &stats->backward };
+    const char *directions[] = { "forward", "backward" };
+
+    printf("One-way latency for %s:\n", name);
+    printf("+-----------+------------+------------+------------+------------+------------+\n");
+    printf("| Direction |  Samples   | Mean (ns)  | p50 (ns)   | p99 (ns)   | Max (ns)   |\n");
+    printf("+-----------+------------+------------+------------+------------+------------+\n");
+    for (int d = 0; d < 2; d++) {
+        const PhaseHistogram *histogram = legs[d];
+        printf("| %-9s | %10lu | %10lu | %10lu | %10lu | %10lu |\n", directions[d], histogram->samples,
+               histogram->samples ? histogram->total_ns / histogram->samples : 0, phase_quantile(histogram, 0.5),
+               phase_quantile(histogram, 0.99), histogram->max_ns);
+    }
+    printf("+-----------+------------+------------+------------+------------+------------+\n");
+
+    if (stats->out_of_order) {
+        printf("Clock check FAILED: %lu of %lu round trips were received before they were sent; "
+               "one-way numbers are not trustworthy\n", stats->out_of_order, stats->round_trips);
+    } else if (stats->forward.samples) {
+        printf("Clock check: %lu round trips in causal order\n", stats->round_trips);
+        printf("Fastest trips: forward %lu ns, backward %lu ns, asymmetry (forward - backward) %+ld ns\n",
+               stats->min_forward_ns, stats->min_backward_ns,
+               (int64_t)stats->min_forward_ns - (int64_t)stats->min_backward_ns);
+    }
+}
+
+// Writes the per-batch means of both directions in seconds.
+void OneWay_record(const OneWayStats *stats, const char *benchmark, const char *variant) {
+    const Samples *batches[] = { &stats->forward_batches, &stats->backward_batches };
+    const char *metrics[] = { "latency_forward", "latency_backward" };
+
+    for (int d = 0; d < 2; d++) {
+        for (size_t i = 0; i < batches[d]->count; i++) {
+            Results_sample(batches[d]->values[i] / 1000000000.0);
+        }
+        Results_record(benchmark, variant, metrics[d], "s", true);
+    }
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef OPEN_LOOP_H
+#define OPEN_LOOP_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "Settings.h"
+#include "Transport.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Results.h"
+#include "../common/Samples.h"
+
+// Open-loop load: messages are scheduled at a target rate whether or not the
+// previous response has come back, and each latency is measured from the
+// message's intended send time. When the transport falls behind, the time a
+// message spends waiting for its turn counts against it, which a closed-loop
+// ping-pong never shows (coordinated omission).
+
+#define OPENLOOP_MESSAGE_SIZE 128
+#define OPENLOOP_SPIN_NS 20000
+
+typedef enum {
+    ARRIVAL_CONSTANT,
+    ARRIVAL_POISSON,
+} ArrivalMode;
+
+typedef struct {
+    double offered_rate;
+    double achieved_rate;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} OpenLoopStep;
+
+static uint64_t openloop_now() {
+    struct timespec tms;
+    clock_gettime(CLOCK_MONOTONIC, &tms);
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
+}
+
+// Sleeps until shortly before `deadline`, then spins the rest of the way.
+static void openloop_wait_until(uint64_t deadline) {
+    uint64_t now = openloop_now();
+
+    if (deadline > now + OPENLOOP_SPIN_NS) {
+        uint64_t wake = deadline - OPENLOOP_SPIN_NS;
+        struct timespec tms = { (time_t)(wake / 1000000000ull), (long)(wake % 1000000000ull) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tms, NULL);
+    }
+    while (openloop_now() < deadline) {}
+}
+
+// Exponential inter-arrival gap for a Poisson process (xorshift64 state).
+static uint64_t openloop_poisson_gap(uint64_t *state, double mean_gap_ns) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+
+    double uniform = ((double)(x >> 11) + 0.5) / 9007199254740992.0;
+    return (uint64_t)(-log(uniform) * mean_gap_ns);
+}
+
+OpenLoopStep compute_openloop(Transport *transport, double rate, ArrivalMode arrivals, uint64_t number_of_messages) {
+    OpenLoopStep step;
+    uint8_t data[OPENLOOP_MESSAGE_SIZE];
+    uint8_t response[OPENLOOP_MESSAGE_SIZE];
+    Samples latencies;
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    double mean_gap_ns = 1000000000.0 / rate;
+
+    for (uint64_t i = 0; i < sizeof(data); i++) {
+        data[i] = i;
+    }
+    Samples_init(&latencies, number_of_messages);
+
+    uint64_t startTime = openloop_now();
+    uint64_t intended = startTime;
+
+    for (uint64_t k = 0; k < number_of_messages; k++) {
+        intended += arrivals == ARRIVAL_POISSON ? openloop_poisson_gap(&rng, mean_gap_ns) : (uint64_t)mean_gap_ns;
+        openloop_wait_until(intended);
+
+        transport->write(transport->io, data, sizeof(data));
+        transport->read(transport->io, response, sizeof(response));
+        Samples_add(&latencies, openloop_now() - intended);
+    }
+
+    uint64_t endTime = openloop_now();
+    ResourceUsage_moved(2 * number_of_messages * sizeof(data));
+
+    step.offered_rate = rate;
+    step.achieved_rate = (double)number_of_messages / ((double)(endTime - startTime) / 1000000000.0);
+    step.p50_ns = Samples_quantile(&latencies, 0.5);
+    step.p99_ns = Samples_quantile(&latencies, 0.99);
+    step.p999_ns = Samples_quantile(&latencies, 0.999);
+    step.max_ns = Samples_quantile(&latencies, 1.0);
+
+    Samples_free(&latencies);
+    return step;
+}
+
+static bool openloop_sustained(const OpenLoopStep *step) {
+    return step->p99_ns <= OPENLOOP_P99_BOUND_US * 1000ull && step->achieved_rate >= 0.95 * step->offered_rate;
+}
+
+static OpenLoopStep openloop_run_step(Transport *transport, double rate, ArrivalMode arrivals) {
+    uint64_t number_of_messages = (uint64_t)(rate * OPENLOOP_STEP_MS / 1000.0);
+    OpenLoopStep step = compute_openloop(transport, rate, arrivals, number_of_messages < 100 ? 100 : number_of_messages);
+
+    printf("| %13.0lf | %14.0lf | %10.3lf | %10.3lf | %10.3lf | %10.3lf | %-3s |\n",
+           step.offered_rate, step.achieved_rate, step.p50_ns / 1000.0, step.p99_ns / 1000.0,
+           step.p999_ns / 1000.0, step.max_ns / 1000.0, openloop_sustained(&step) ? "yes" : "no");
+    return step;
+}
+
+// Doubles the offered rate until p99 exceeds OPENLOOP_P99_BOUND_US or the
+// transport stops keeping up (halving instead if the starting rate is
+// already too much), then bisects between the last good and the first bad
+// rate, OPENLOOP_REPETITIONS times over. Each bisection's highest sustained
+// rate is a Results_sample; returns their mean (messages per second).
+double compute_knee(Transport *transport, ArrivalMode arrivals) {
+    double good = 0, bad = 0;
+    double rate = OPENLOOP_START_RATE;
+
+    printf("Open-loop sweep for %s (%s arrivals, p99 bound %d us):\n", transport->name,
+           arrivals == ARRIVAL_POISSON ? "Poisson" : "constant", OPENLOOP_P99_BOUND_US);
+    printf("+---------------+----------------+------------+------------+------------+------------+-----+\n");
+    printf("| Offered (1/s) | Achieved (1/s) |  p50 (us)  |  p99 (us)  | p99.9 (us) |  Max (us)  | OK  |\n");
+    printf("+---------------+----------------+------------+------------+------------+------------+-----+\n");
+
+    OpenLoopStep step = openloop_run_step(transport, rate, arrivals);
+    bool ramp_up = openloop_sustained(&step);
+
+    while (true) {
+        if (openloop_sustained(&step)) {
+            good = rate;
+        } else {
+            bad = rate;
+        }
+
+        rate = ramp_up ? rate * 2 : rate / 2;
+        if ((good > 0 && bad > 0) || rate > OPENLOOP_MAX_RATE || rate < OPENLOOP_MIN_RATE) {
+            break;
+        }
+        step = openloop_run_step(transport, rate, arrivals);
+    }
+
+    // Without a bracket the knee is outside the swept range and there is
+    // nothing to repeat.
+    double knee = good;
+    int repetitions = good > 0 && bad > 0 ? OPENLOOP_REPETITIONS : 1;
+    if (repetitions > 1) {
+        knee = 0;
+        for (int r = 0; r < repetitions; r++) {
+            double low = good, high = bad;
+            for (int i = 0; i < 3; i++) {
+                double rate = (low + high) / 2;
+                OpenLoopStep step = openloop_run_step(transport, rate, arrivals);
+                if (openloop_sustained(&step)) {
+                    low = rate;
+                } else {
+                    high = rate;
+                }
+            }
+            Results_sample(low);
+            knee += low / repetitions;
+        }
+    } else {
+        Results_sample(knee);
+    }
+
+    printf("+---------------+----------------+------------+------------+------------+------------+-----+\n");
+    printf("Knee: %f msg/s (mean of %d)\n", knee, repetitions);
+    return knee;
+}
+
+#endif
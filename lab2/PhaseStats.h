@@ -0,0 +1,185 @@
+#ifndef PHASE_STATS_H
+#define PHASE_STATS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "Settings.h"
+#include "../common/EventTrace.h"
+
+// Per-phase timing of every transport operation: how long it waited for the
+// peer, how long it moved data, and how long it took to publish the result.
+// Histograms are thread-local, so the hot path never shares a cache line,
+// and only one in PHASE_SAMPLE_RATE operations is timed. With --events every
+// operation is timed and the same timestamps also go to the event tracer
+// (../common/EventTrace.h).
+
+#define PHASE_BUCKETS 48
+
+typedef enum {
+    PHASE_WAIT,
+    PHASE_COPY,
+    PHASE_PUBLISH,
+    PHASE_COUNT,
+} Phase;
+
+typedef enum {
+    PHASE_FILEIO,
+    PHASE_MMAPIO,
+    PHASE_SHAREDIO,
+    PHASE_CMAIO,
+    PHASE_BROADCAST,
+    PHASE_SEQLOCK,
+    PHASE_CHANNELSET,
+    PHASE_LANEIO,
+    PHASE_WORKPOOL,
+    PHASE_PIPEIO,
+    PHASE_SOCKETIO,
+    PHASE_TRANSPORTS,
+} PhaseTransport;
+
+static const char *PHASE_TRANSPORT_NAMES[PHASE_TRANSPORTS] = {
+    "FileIO", "MmapIO", "SharedIO", "CmaIO", "Broadcast", "Seqlock", "ChannelSet", "LaneIO", "WorkPool", "PipeIO", "SocketIO",
+};
+
+static const char *PHASE_NAMES[PHASE_COUNT] = { "wait", "copy", "publish" };
+
+typedef enum {
+    PHASE_SEND,
+    PHASE_RECEIVE,
+} PhaseDirection;
+
+// The event each phase ends with: a sender waits for a free slot, copies
+// and publishes; a receiver is woken, copies and releases the slot.
+static const EventKind PHASE_EVENTS[2][PHASE_COUNT] = {
+    { EVENT_SLOT_ACQUIRED, EVENT_COPY_DONE, EVENT_PUBLISHED },
+    { EVENT_WOKEN, EVENT_RECEIVED, EVENT_RELEASED },
+};
+
+typedef struct {
+    uint64_t samples;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[PHASE_BUCKETS];
+} PhaseHistogram;
+
+static _Thread_local PhaseHistogram phase_histograms[PHASE_TRANSPORTS][PHASE_COUNT];
+// Counted per direction: a round trip alternates sends and receives, so a
+// shared count with an even rate would only ever sample one of them.
+static _Thread_local int phase_countdown[2];   // operations until the next sample
+static int phase_sample_rate = PHASE_SAMPLE_RATE;
+
+typedef struct {
+    bool sampled;
+    PhaseDirection direction;
+    uint64_t last;
+    uint64_t started;   // until the first mark, which knows the transport
+} PhaseTimer;
+
+static inline uint64_t phase_now() {
+    struct timespec tms;
+    clock_gettime(CLOCK_MONOTONIC, &tms);
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
+}
+
+static inline void PhaseHistogram_add(PhaseHistogram *histogram, uint64_t ns) {
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+
+    histogram->samples++;
+    histogram->total_ns += ns;
+    histogram->max_ns = ns > histogram->max_ns ? ns : histogram->max_ns;
+    histogram->buckets[bucket < PHASE_BUCKETS ? bucket : PHASE_BUCKETS - 1]++;
+}
+
+static inline void PhaseTimer_start(PhaseTimer *timer, PhaseDirection direction) {
+    int *countdown = &phase_countdown[direction];
+    timer->sampled = *countdown == 0;
+    *countdown = timer->sampled ? phase_sample_rate - 1 : *countdown - 1;
+    timer->direction = direction;
+    timer->last = timer->sampled ? phase_now() : 0;
+    timer->started = timer->last;
+}
+
+// Charges the time since the previous mark (or start) to `phase`.
+static inline void PhaseTimer_mark(PhaseTimer *timer, PhaseTransport transport, Phase phase) {
+    if (!timer->sampled) {
+        return;
+    }
+
+    uint64_t now = phase_now();
+    PhaseHistogram_add(&phase_histograms[transport][phase], now - timer->last);
+    timer->last = now;
+
+    if (EventTrace_enabled()) {
+        if (timer->started) {
+            EventKind start = timer->direction == PHASE_SEND ? EVENT_SEND_START : EVENT_RECEIVE_START;
+            EventTrace_record_at(start, transport, timer->started);
+            timer->started = 0;
+        }
+        EventTrace_record_at(PHASE_EVENTS[timer->direction][phase], transport, now);
+    }
+}
+
+// Upper bound of the log2 bucket holding the given quantile, capped at the
+// largest sample.
+static uint64_t phase_quantile(const PhaseHistogram *histogram, double quantile) {
+    uint64_t rank = (uint64_t)(quantile * (double)histogram->samples);
+    uint64_t seen = 0;
+
+    for (int b = 0; b < PHASE_BUCKETS; b++) {
+        seen += histogram->buckets[b];
+        if (seen > rank) {
+            uint64_t bound = b ? 1ull << b : 0;
+            return bound < histogram->max_ns ? bound : histogram->max_ns;
+        }
+    }
+    return histogram->max_ns;
+}
+
+void PhaseStats_reset() {
+    memset(phase_histograms, 0, sizeof(phase_histograms));
+    memset(phase_countdown, 0, sizeof(phase_countdown));
+}
+
+// Times every operation from now on, as the event tracer needs.
+void PhaseStats_sample_all() {
+    phase_sample_rate = 1;
+    memset(phase_countdown, 0, sizeof(phase_countdown));
+}
+
+// Prints the calling thread's histograms and clears them.
+void PhaseStats_dump(const char *who) {
+    bool header = false;
+
+    for (int t = 0; t < PHASE_TRANSPORTS; t++) {
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            const PhaseHistogram *histogram = &phase_histograms[t][p];
+            if (!histogram->samples) {
+                continue;
+            }
+
+            if (!header) {
+                printf("Phase timings for %s (1 in %d operations sampled):\n", who, phase_sample_rate);
+                printf("+------------+---------+------------+------------+------------+------------+------------+\n");
+                printf("| Transport  |  Phase  |  Samples   | Mean (ns)  | p50 (ns)   | p99 (ns)   | Max (ns)   |\n");
+                printf("+------------+---------+------------+------------+------------+------------+------------+\n");
+                header = true;
+            }
+
+            printf("| %-10s | %-7s | %10lu | %10lu | %10lu | %10lu | %10lu |\n",
+                   PHASE_TRANSPORT_NAMES[t], PHASE_NAMES[p], histogram->samples,
+                   histogram->total_ns / histogram->samples, phase_quantile(histogram, 0.5),
+                   phase_quantile(histogram, 0.99), histogram->max_ns);
+        }
+    }
+
+    if (header) {
+        printf("+------------+---------+------------+------------+------------+------------+------------+\n");
+    }
+    fflush(stdout);
+    PhaseStats_reset();
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "OneWay.h"
+#include "PhaseStats.h"
+#include "Transport.h"
+
+// Request/response over a pair of anonymous pipes, one per direction. A
+// message is its length (int) followed by its bytes; a length of -1 closes
+// the channel. Closing the file descriptors is not enough: a forked peer
+// holds copies of both ends, so the reader would never see end of file.
+
+typedef struct {
+    int read_fd;
+    int write_fd;
+    bool closed;
+} PipeIO;
+
+// Creates both ends of a channel; false (with a message) if pipe() fails.
+bool PipeIO_init_pair(PipeIO *first, PipeIO *second) {
+    int forward[2], backward[2];
+
+    if (pipe(forward) != 0 || pipe(backward) != 0) {
+        perror("pipe");
+        return false;
+    }
+    *first = (PipeIO){ backward[0], forward[1], false };
+    *second = (PipeIO){ forward[0], backward[1], false };
+    return true;
+}
+
+static bool pipe_write_all(int fd, const uint8_t *bytes, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, bytes, len);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        len -= written;
+    }
+    return true;
+}
+
+static bool pipe_read_all(int fd, uint8_t *bytes, size_t len) {
+    while (len > 0) {
+        ssize_t got = read(fd, bytes, len);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        len -= got;
+    }
+    return true;
+}
+
+void PipeIO_close(PipeIO *pipe_io) {
+    if (pipe_io->closed) {
+        return;
+    }
+    int end = -1;
+    pipe_write_all(pipe_io->write_fd, (const uint8_t *)&end, sizeof(end));
+    pipe_io->closed = true;
+}
+
+// Closes this process's descriptors once the channel is no longer used.
+void PipeIO_release(PipeIO *pipe_io) {
+    close(pipe_io->read_fd);
+    close(pipe_io->write_fd);
+}
+
+void PipeIO_write_bytes(PipeIO *pipe_io, const uint8_t *bytes, int len) {
+    if (pipe_io->closed) {
+        return;
+    }
+
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
+
+    if (!pipe_write_all(pipe_io->write_fd, (const uint8_t *)&len, sizeof(len)) ||
+        !pipe_write_all(pipe_io->write_fd, bytes, len)) {
+        pipe_io->closed = true;
+        return;
+    }
+    PhaseTimer_mark(&timer, PHASE_PIPEIO, PHASE_COPY);
+}
+
+int PipeIO_read_bytes(PipeIO *pipe_io, uint8_t *out_data, int max_size) {
+    if (pipe_io->closed) {
+        return -1;
+    }
+
+    int size;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+    if (!pipe_read_all(pipe_io->read_fd, (uint8_t *)&size, sizeof(size)) || size < 0) {
+        PipeIO_close(pipe_io);
+        return -1;
+    }
+    PhaseTimer_mark(&timer, PHASE_PIPEIO, PHASE_WAIT);
+
+    // Whatever does not fit is read and dropped, so the stream stays framed.
+    int keep = size < max_size ? size : max_size;
+    bool ok = pipe_read_all(pipe_io->read_fd, out_data, keep);
+    for (int rest = size - keep; ok && rest > 0;) {
+        uint8_t scratch[4096];
+        int chunk = rest < (int)sizeof(scratch) ? rest : (int)sizeof(scratch);
+        ok = pipe_read_all(pipe_io->read_fd, scratch, chunk);
+        rest -= chunk;
+    }
+    if (!ok) {
+        pipe_io->closed = true;
+        return -1;
+    }
+    PhaseTimer_mark(&timer, PHASE_PIPEIO, PHASE_COPY);
+
+    return keep;
+}
+
+void *echo_PipeIO(void *arg) {
+    PipeIO *io = (PipeIO *)arg;
+    uint8_t *data = (uint8_t *)malloc(message_capacity());
+    int data_size;
+
+    do {
+        data_size = PipeIO_read_bytes(io, data, message_capacity());
+
+        if (data_size > 0) {
+            OneWay_echo(data, data_size);
+            PipeIO_write_bytes(io, data, data_size);
+        }
+    } while (data_size > 0);
+
+    free(data);
+    PhaseStats_dump("echo peer");
+    return NULL;
+}
+
+static void PipeIO_transport_write(void *io, const uint8_t *bytes, int len) {
+    PipeIO_write_bytes((PipeIO *)io, bytes, len);
+}
+
+static int PipeIO_transport_read(void *io, uint8_t *out_data, int max_size) {
+    return PipeIO_read_bytes((PipeIO *)io, out_data, max_size);
+}
+
+static void PipeIO_transport_close(void *io) {
+    PipeIO_close((PipeIO *)io);
+}
+
+Transport PipeIO_transport(const char *name, PipeIO *pipe_io) {
+    Transport transport = { name, pipe_io, PipeIO_transport_write, PipeIO_transport_read, PipeIO_transport_close };
+    return transport;
+}
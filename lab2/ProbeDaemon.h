@@ -0,0 +1,565 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "EchoPeer.h"
+#include "../common/Grid.h"
+#include "../common/ResourceUsage.h"
+
+// A long-running probe (lab2 --daemon <config>) that keeps measuring what
+// the benchmarks measure once, to catch noisy neighbours and kernel
+// regressions on a live host: a short burst of round trips through each
+// configured transport (as in Calibration.h) and a pointer chase through
+// each configured working set (a light version of lab3's random mode).
+// Samples go into rolling histograms that are served as Prometheus text
+// exposition on a local UNIX or TCP socket.
+//
+// Rounds run every interval_ms, but never sooner than the CPU budget allows:
+// the daemon's CPU time, echo peers included, is kept under cpu_budget
+// percent of one CPU by pushing the next round back.
+//
+// The config file holds "name = values" lines (see ../common/Grid.h):
+//   transport = mmap_io, pipe_io, unix_stream   # channel kinds, Channel.h
+//   packet_size = 64
+//   round_trips = 200          # per transport and round
+//   working_set = 32k, 1m, 64m
+//   wait = yield               # spin, yield or sleep, as in the sweep
+//   interval_ms = 1000
+//   cpu_budget = 2             # percent of one CPU
+//   window_s = 60              # quantiles cover the last DAEMON_WINDOWS windows
+//   listen = unix:lab2-probe.sock   # or tcp:<port> on 127.0.0.1
+
+// Log-linear buckets: 8 per power of two, so a quantile is within 12.5%.
+#define PROBE_SUB_BUCKETS 8
+#define PROBE_BUCKETS (62 * PROBE_SUB_BUCKETS)
+
+typedef struct {
+    uint32_t buckets[PROBE_BUCKETS];
+    uint64_t count;
+    uint64_t max;
+} ProbeWindow;
+
+// Quantiles over the last DAEMON_WINDOWS windows; count and sum since start,
+// as a Prometheus summary expects.
+typedef struct {
+    ProbeWindow windows[DAEMON_WINDOWS];
+    int current;
+    uint64_t window_start_ns;
+    uint64_t window_ns;
+    uint64_t total_count;
+    double total_sum;
+} RollingHistogram;
+
+static int probe_bucket(uint64_t value) {
+    if (value < PROBE_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int bucket = (exponent - 2) * PROBE_SUB_BUCKETS + (int)((value >> (exponent - 3)) & (PROBE_SUB_BUCKETS - 1));
+    return bucket < PROBE_BUCKETS ? bucket : PROBE_BUCKETS - 1;
+}
+
+static uint64_t probe_bucket_upper(int bucket) {
+    if (bucket < PROBE_SUB_BUCKETS) {
+        return bucket;
+    }
+    int exponent = bucket / PROBE_SUB_BUCKETS + 2;
+    uint64_t width = 1ull << (exponent - 3);
+    return (PROBE_SUB_BUCKETS + bucket % PROBE_SUB_BUCKETS) * width + width - 1;
+}
+
+void RollingHistogram_init(RollingHistogram *histogram, uint64_t window_ns) {
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->window_ns = window_ns;
+    histogram->window_start_ns = getCurTimeNs();
+}
+
+// Retires windows older than the rolling span.
+static void rolling_advance(RollingHistogram *histogram, uint64_t now) {
+    for (int k = 0; k < DAEMON_WINDOWS && now - histogram->window_start_ns >= histogram->window_ns; k++) {
+        histogram->current = (histogram->current + 1) % DAEMON_WINDOWS;
+        memset(&histogram->windows[histogram->current], 0, sizeof(ProbeWindow));
+        histogram->window_start_ns += histogram->window_ns;
+    }
+    if (now - histogram->window_start_ns >= histogram->window_ns) {
+        histogram->window_start_ns = now;   // idle for longer than the span
+    }
+}
+
+void RollingHistogram_add(RollingHistogram *histogram, uint64_t value) {
+    rolling_advance(histogram, getCurTimeNs());
+    ProbeWindow *window = &histogram->windows[histogram->current];
+    window->buckets[probe_bucket(value)]++;
+    window->count++;
+    window->max = value > window->max ? value : window->max;
+    histogram->total_count++;
+    histogram->total_sum += (double)value;
+}
+
+// Upper bound of the bucket holding `quantile` over the rolling span,
+// capped at its largest sample; 0 without samples.
+uint64_t RollingHistogram_quantile(RollingHistogram *histogram, double quantile, uint64_t *max) {
+    uint64_t count = 0, seen = 0;
+    *max = 0;
+
+    rolling_advance(histogram, getCurTimeNs());
+    for (int w = 0; w < DAEMON_WINDOWS; w++) {
+        count += histogram->windows[w].count;
+        *max = histogram->windows[w].max > *max ? histogram->windows[w].max : *max;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(quantile * (double)(count - 1));
+    for (int b = 0; b < PROBE_BUCKETS; b++) {
+        for (int w = 0; w < DAEMON_WINDOWS; w++) {
+            seen += histogram->windows[w].buckets[b];
+        }
+        if (seen > rank) {
+            uint64_t bound = probe_bucket_upper(b);
+            return bound < *max ? bound : *max;
+        }
+    }
+    return *max;
+}
+
+typedef struct {
+    const ChannelKind *kind;
+    RollingHistogram round_trips;   // ns
+    uint64_t failures;
+} TransportProbe;
+
+typedef struct {
+    long working_set;
+    void **chain;
+    void **cursor;
+    RollingHistogram accesses;      // ps per access
+} MemoryProbe;
+
+typedef struct {
+    TransportProbe transports[CHANNEL_KIND_COUNT];
+    int transport_count;
+    MemoryProbe memory[GRID_MAX_VALUES];
+    int memory_count;
+    int packet_size;
+    long round_trips;
+    long interval_ms;
+    double cpu_budget;              // fraction of one CPU
+    char listen[GRID_VALUE_SIZE];
+    int listen_fd;
+    uint64_t rounds;
+    double cpu_seconds;
+    double last_interval_s;
+} ProbeDaemon;
+
+static volatile sig_atomic_t probe_daemon_stop = 0;
+
+static void probe_daemon_signal(int signum) {
+    (void)signum;
+    probe_daemon_stop = 1;
+}
+
+// A random cyclic permutation of the working set's cache lines (Sattolo's
+// algorithm), so every load depends on the previous one and the prefetcher
+// cannot guess the next.
+static void **probe_chain_new(long working_set) {
+    long lines = working_set / 64 > 1 ? working_set / 64 : 2;
+    void **chain = (void **)aligned_alloc(64, lines * 64);
+    long *order = (long *)malloc(lines * sizeof(long));
+    if (chain == NULL || order == NULL) {
+        free(chain);
+        free(order);
+        return NULL;
+    }
+
+    for (long k = 0; k < lines; k++) {
+        order[k] = k;
+    }
+    for (long k = lines - 1; k > 0; k--) {
+        long j = random() % k;
+        long swap = order[k];
+        order[k] = order[j];
+        order[j] = swap;
+    }
+    for (long k = 0; k < lines; k++) {
+        chain[order[k] * 8] = &chain[order[(k + 1) % lines] * 8];
+    }
+    free(order);
+    return chain;
+}
+
+static bool probe_daemon_configure(ProbeDaemon *daemon, const char *path) {
+    Grid config;
+    long packet_size, window_s;
+
+    Grid_init(&config);
+    Grid_define(&config, "transport", "mmap_io,pipe_io,unix_stream");
+    Grid_define(&config, "packet_size", "64");
+    Grid_define(&config, "round_trips", "200");
+    Grid_define(&config, "working_set", "32k,1m,64m");
+    Grid_define(&config, "wait", "yield");
+    Grid_define(&config, "interval_ms", "1000");
+    Grid_define(&config, "cpu_budget", "2");
+    Grid_define(&config, "window_s", "60");
+    Grid_define(&config, "listen", "unix:lab2-probe.sock");
+    if (!Grid_load(&config, path)) {
+        return false;
+    }
+
+    memset(daemon, 0, sizeof(*daemon));
+    daemon->listen_fd = -1;
+    if (!Grid_parse_long(Grid_get(&config, "packet_size"), &packet_size) || packet_size < PACKET_SIZE_MIN ||
+        packet_size > PACKET_SIZE_MAX || !Grid_parse_long(Grid_get(&config, "round_trips"), &daemon->round_trips) ||
+        daemon->round_trips < 1 || !Grid_parse_long(Grid_get(&config, "interval_ms"), &daemon->interval_ms) ||
+        daemon->interval_ms < 1 || !Grid_parse_long(Grid_get(&config, "window_s"), &window_s) || window_s < 1) {
+        fprintf(stderr, "%s: packet_size must be %d..%d; round_trips, interval_ms and window_s must be positive\n",
+                path, PACKET_SIZE_MIN, PACKET_SIZE_MAX);
+        return false;
+    }
+    daemon->packet_size = (int)packet_size;
+    daemon->cpu_budget = atof(Grid_get(&config, "cpu_budget")) / 100.0;
+    if (daemon->cpu_budget <= 0 || daemon->cpu_budget > 1) {
+        fprintf(stderr, "%s: cpu_budget must be a percentage in (0, 100]\n", path);
+        return false;
+    }
+    if (!WaitStrategy_parse(Grid_get(&config, "wait"), &settings.wait)) {
+        fprintf(stderr, "%s: unknown wait strategy '%s' (spin, yield, sleep)\n", path, Grid_get(&config, "wait"));
+        return false;
+    }
+    snprintf(daemon->listen, sizeof(daemon->listen), "%s", Grid_get(&config, "listen"));
+
+    const GridParam *transports = Grid_param(&config, "transport");
+    for (int k = 0; k < transports->count; k++) {
+        const ChannelKind *kind = ChannelKind_find(transports->values[k]);
+        if (kind == NULL) {
+            fprintf(stderr, "%s: unknown transport '%s'\n", path, transports->values[k]);
+            return false;
+        }
+        TransportProbe *probe = &daemon->transports[daemon->transport_count++];
+        probe->kind = kind;
+        RollingHistogram_init(&probe->round_trips, window_s * 1000000000ull);
+    }
+
+    const GridParam *working_sets = Grid_param(&config, "working_set");
+    for (int k = 0; k < working_sets->count; k++) {
+        MemoryProbe *probe = &daemon->memory[daemon->memory_count];
+        if (!Grid_parse_long(working_sets->values[k], &probe->working_set) || probe->working_set < 128) {
+            fprintf(stderr, "%s: bad working set '%s'\n", path, working_sets->values[k]);
+            return false;
+        }
+        if ((probe->chain = probe_chain_new(probe->working_set)) == NULL) {
+            fprintf(stderr, "%s: cannot allocate a working set of %ld bytes\n", path, probe->working_set);
+            return false;
+        }
+        probe->cursor = probe->chain;
+        RollingHistogram_init(&probe->accesses, window_s * 1000000000ull);
+        daemon->memory_count++;
+    }
+
+    // The echo peers size their buffers by message_capacity(), which
+    // follows PACKET_SIZE.
+    settings.packet_size = daemon->packet_size > settings.packet_size ? daemon->packet_size : settings.packet_size;
+    return true;
+}
+
+static bool probe_daemon_listen(ProbeDaemon *daemon) {
+    int fd;
+
+    if (strncmp(daemon->listen, "unix:", 5) == 0) {
+        struct sockaddr_un address = { .sun_family = AF_UNIX };
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", daemon->listen + 5);
+        unlink(address.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+            perror(daemon->listen);
+            return false;
+        }
+    } else if (strncmp(daemon->listen, "tcp:", 4) == 0) {
+        long port;
+        int reuse = 1;
+        if (!Grid_parse_long(daemon->listen + 4, &port) || port < 1 || port > 65535) {
+            fprintf(stderr, "Bad port in '%s'\n", daemon->listen);
+            return false;
+        }
+        // Loopback only: the metrics are for a local scraper or agent.
+        struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port),
+                                       .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd != -1) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        }
+        if (fd == -1 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+            perror(daemon->listen);
+            return false;
+        }
+    } else {
+        fprintf(stderr, "listen must be unix:<path> or tcp:<port>, not '%s'\n", daemon->listen);
+        return false;
+    }
+
+    if (listen(fd, 16) != 0) {
+        perror("listen");
+        close(fd);
+        return false;
+    }
+    daemon->listen_fd = fd;
+    return true;
+}
+
+// Starts the echo peer with stdout on /dev/null: every peer prints its
+// phase timings when it exits, which would fill the daemon's log.
+static void probe_start_peer(EchoPeer *peer, Channel *channel) {
+    int saved = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+
+    fflush(stdout);
+    dup2(null, STDOUT_FILENO);
+    EchoPeer_start(peer, EXEC_PROCESS, channel->echo, channel->peer_io);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(null);
+}
+
+// One burst of round trips; returns the CPU seconds the echo peer used.
+static double probe_transport(ProbeDaemon *daemon, TransportProbe *probe) {
+    Channel channel;
+    EchoPeer peer;
+
+    if (!Channel_open_kind(&channel, probe->kind, daemon->packet_size)) {
+        probe->failures++;
+        return 0;
+    }
+    probe_start_peer(&peer, &channel);
+
+    Transport *transport = &channel.transport;
+    uint8_t *data = (uint8_t *)calloc(daemon->packet_size, 1);
+    uint8_t *response = (uint8_t *)malloc(daemon->packet_size);
+    for (int k = 0; k < DAEMON_WARMUP; k++) {
+        transport->write(transport->io, data, daemon->packet_size);
+        transport->read(transport->io, response, daemon->packet_size);
+    }
+    for (long k = 0; k < daemon->round_trips; k++) {
+        uint64_t sent = getCurTimeNs();
+        transport->write(transport->io, data, daemon->packet_size);
+        if (transport->read(transport->io, response, daemon->packet_size) != daemon->packet_size) {
+            probe->failures++;
+            break;
+        }
+        RollingHistogram_add(&probe->round_trips, getCurTimeNs() - sent);
+    }
+    free(response);
+    free(data);
+
+    transport->close(transport->io);
+    EchoPeer_join(&peer);
+    Channel_close(&channel);
+    return peer.usage.user_s + peer.usage.system_s;
+}
+
+// DAEMON_ACCESSES dependent loads, timed in chunks of DAEMON_CHUNK.
+static void probe_memory(MemoryProbe *probe) {
+    void **cursor = probe->cursor;
+
+    for (int chunk = 0; chunk < DAEMON_ACCESSES / DAEMON_CHUNK; chunk++) {
+        uint64_t started = getCurTimeNs();
+        for (int k = 0; k < DAEMON_CHUNK; k++) {
+            cursor = (void **)*cursor;
+        }
+        RollingHistogram_add(&probe->accesses, (getCurTimeNs() - started) * 1000 / DAEMON_CHUNK);
+    }
+    probe->cursor = cursor;   // also keeps the chase from being optimized out
+}
+
+static void probe_summary(FILE *out, const char *name, const char *labels, RollingHistogram *histogram, double scale) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    uint64_t max = 0;
+
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        uint64_t value = RollingHistogram_quantile(histogram, quantiles[q], &max);
+        if (max > 0) {
+            fprintf(out, "%s{%s,quantile=\"%g\"} %.12g\n", name, labels, quantiles[q], value * scale);
+        }
+    }
+    fprintf(out, "%s_sum{%s} %.12g\n", name, labels, histogram->total_sum * scale);
+    fprintf(out, "%s_count{%s} %lu\n", name, labels, histogram->total_count);
+}
+
+// The largest sample over the rolling span, as its own gauge family.
+static void probe_max(FILE *out, const char *name, const char *labels, RollingHistogram *histogram, double scale) {
+    uint64_t max;
+    RollingHistogram_quantile(histogram, 1, &max);
+    fprintf(out, "%s{%s} %.12g\n", name, labels, max * scale);
+}
+
+// The whole exposition, in a malloc'd string.
+static char *probe_daemon_metrics(ProbeDaemon *daemon, size_t *len) {
+    char *text = NULL;
+    char labels[128];
+    FILE *out = open_memstream(&text, len);
+
+    fprintf(out, "# HELP lab2_ipc_round_trip_seconds Round trip through an echo peer; quantiles over the last %d windows.\n",
+            DAEMON_WINDOWS);
+    fprintf(out, "# TYPE lab2_ipc_round_trip_seconds summary\n");
+    for (int k = 0; k < daemon->transport_count; k++) {
+        TransportProbe *probe = &daemon->transports[k];
+        snprintf(labels, sizeof(labels), "transport=\"%s\",size=\"%d\"", probe->kind->name, daemon->packet_size);
+        probe_summary(out, "lab2_ipc_round_trip_seconds", labels, &probe->round_trips, 1e-9);
+    }
+    fprintf(out, "# HELP lab2_ipc_round_trip_max_seconds Slowest round trip over the last %d windows.\n", DAEMON_WINDOWS);
+    fprintf(out, "# TYPE lab2_ipc_round_trip_max_seconds gauge\n");
+    for (int k = 0; k < daemon->transport_count; k++) {
+        TransportProbe *probe = &daemon->transports[k];
+        snprintf(labels, sizeof(labels), "transport=\"%s\",size=\"%d\"", probe->kind->name, daemon->packet_size);
+        probe_max(out, "lab2_ipc_round_trip_max_seconds", labels, &probe->round_trips, 1e-9);
+    }
+    fprintf(out, "# HELP lab2_ipc_probe_failures_total Probe rounds a transport could not open or complete.\n");
+    fprintf(out, "# TYPE lab2_ipc_probe_failures_total counter\n");
+    for (int k = 0; k < daemon->transport_count; k++) {
+        fprintf(out, "lab2_ipc_probe_failures_total{transport=\"%s\"} %lu\n", daemon->transports[k].kind->name,
+                daemon->transports[k].failures);
+    }
+
+    fprintf(out, "# HELP lab2_memory_access_seconds Dependent load in a random chain over the working set.\n");
+    fprintf(out, "# TYPE lab2_memory_access_seconds summary\n");
+    for (int k = 0; k < daemon->memory_count; k++) {
+        snprintf(labels, sizeof(labels), "working_set=\"%ld\"", daemon->memory[k].working_set);
+        probe_summary(out, "lab2_memory_access_seconds", labels, &daemon->memory[k].accesses, 1e-12);
+    }
+    fprintf(out, "# HELP lab2_memory_access_max_seconds Slowest chunk of loads over the last %d windows, per load.\n",
+            DAEMON_WINDOWS);
+    fprintf(out, "# TYPE lab2_memory_access_max_seconds gauge\n");
+    for (int k = 0; k < daemon->memory_count; k++) {
+        snprintf(labels, sizeof(labels), "working_set=\"%ld\"", daemon->memory[k].working_set);
+        probe_max(out, "lab2_memory_access_max_seconds", labels, &daemon->memory[k].accesses, 1e-12);
+    }
+
+    fprintf(out, "# HELP lab2_probe_cpu_seconds_total CPU time spent probing, echo peers included.\n");
+    fprintf(out, "# TYPE lab2_probe_cpu_seconds_total counter\n");
+    fprintf(out, "lab2_probe_cpu_seconds_total %.6f\n", daemon->cpu_seconds);
+    fprintf(out, "# HELP lab2_probe_cpu_budget_ratio Configured share of one CPU the probes may use.\n");
+    fprintf(out, "# TYPE lab2_probe_cpu_budget_ratio gauge\n");
+    fprintf(out, "lab2_probe_cpu_budget_ratio %g\n", daemon->cpu_budget);
+    fprintf(out, "# HELP lab2_probe_rounds_total Probe rounds run.\n");
+    fprintf(out, "# TYPE lab2_probe_rounds_total counter\n");
+    fprintf(out, "lab2_probe_rounds_total %lu\n", daemon->rounds);
+    fprintf(out, "# HELP lab2_probe_interval_seconds Time between the last two rounds; above interval_ms when the budget holds rounds back.\n");
+    fprintf(out, "# TYPE lab2_probe_interval_seconds gauge\n");
+    fprintf(out, "lab2_probe_interval_seconds %.6f\n", daemon->last_interval_s);
+    fclose(out);
+    return text;
+}
+
+// Answers one scrape: reads what the client sends (an HTTP request from
+// Prometheus, nothing from nc) for up to DAEMON_SCRAPE_TIMEOUT_MS, then
+// writes the metrics as an HTTP/1.0 response.
+static void probe_daemon_serve(ProbeDaemon *daemon) {
+    int fd = accept(daemon->listen_fd, NULL, NULL);
+    if (fd == -1) {
+        return;
+    }
+
+    char request[4096];
+    size_t got = 0;
+    struct pollfd readable = { fd, POLLIN, 0 };
+    while (got < sizeof(request) - 1 && poll(&readable, 1, DAEMON_SCRAPE_TIMEOUT_MS) == 1) {
+        ssize_t n = read(fd, request + got, sizeof(request) - 1 - got);
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+        request[got] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+
+    size_t len;
+    char *body = probe_daemon_metrics(daemon, &len);
+    char header[160];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", len);
+    send(fd, header, header_len, MSG_NOSIGNAL);
+    for (size_t sent = 0; sent < len;) {
+        ssize_t n = send(fd, body + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        sent += n;
+    }
+    free(body);
+    close(fd);
+}
+
+// Runs until SIGINT or SIGTERM.
+int ProbeDaemon_run(const char *config_path) {
+    ProbeDaemon *daemon = (ProbeDaemon *)malloc(sizeof(ProbeDaemon));
+
+    if (!probe_daemon_configure(daemon, config_path) || !probe_daemon_listen(daemon)) {
+        free(daemon);
+        return 1;
+    }
+    signal(SIGINT, probe_daemon_signal);
+    signal(SIGTERM, probe_daemon_signal);
+    printf("Probing %d transports and %d working sets every %ld ms within %.1f%% of a CPU; metrics on %s\n",
+           daemon->transport_count, daemon->memory_count, daemon->interval_ms, daemon->cpu_budget * 100,
+           daemon->listen);
+    fflush(stdout);
+
+    uint64_t started = getCurTimeNs(), next_round = started, last_round = 0;
+    while (!probe_daemon_stop) {
+        uint64_t now = getCurTimeNs();
+        if (now >= next_round) {
+            ResourceUsage before, after, self;
+            double peers = 0;
+
+            ResourceUsage_thread(&before);
+            for (int k = 0; k < daemon->transport_count; k++) {
+                peers += probe_transport(daemon, &daemon->transports[k]);
+            }
+            for (int k = 0; k < daemon->memory_count; k++) {
+                probe_memory(&daemon->memory[k]);
+            }
+            ResourceUsage_thread(&after);
+            ResourceUsage_sub(&self, &after, &before);
+
+            daemon->cpu_seconds += self.user_s + self.system_s + peers;
+            daemon->last_interval_s = last_round ? (double)(now - last_round) / 1000000000.0 : 0;
+            daemon->rounds++;
+            last_round = now;
+
+            // The budget is checked on the total since start, so a round
+            // that ran long is paid back by the next intervals.
+            uint64_t earliest = started + (uint64_t)(daemon->cpu_seconds / daemon->cpu_budget * 1000000000.0);
+            next_round = now + daemon->interval_ms * 1000000ull;
+            next_round = earliest > next_round ? earliest : next_round;
+            continue;
+        }
+
+        struct pollfd listening = { daemon->listen_fd, POLLIN, 0 };
+        int timeout_ms = (int)((next_round - now) / 1000000) + 1;
+        if (poll(&listening, 1, timeout_ms) == 1) {
+            probe_daemon_serve(daemon);
+        }
+    }
+
+    printf("Stopping after %lu rounds, %.3f CPU-s\n", daemon->rounds, daemon->cpu_seconds);
+    close(daemon->listen_fd);
+    if (strncmp(daemon->listen, "unix:", 5) == 0) {
+        unlink(daemon->listen + 5);
+    }
+    for (int k = 0; k < daemon->memory_count; k++) {
+        free(daemon->memory[k].chain);
+    }
+    free(daemon);
+    return 0;
+}
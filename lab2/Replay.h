@@ -0,0 +1,115 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "Settings.h"
+#include "EchoPeer.h"
+#include "OpenLoop.h"
+#include "PhaseStats.h"
+#include "Transport.h"
+#include "../common/Results.h"
+#include "../common/Samples.h"
+#include "../common/Trace.h"
+
+// Replays the requests of a recorded trace through `transport`, each sent at
+// its recorded time divided by `speed` (0: back to back) and answered by the
+// echo peer, so a response is always the size of its request and the
+// trace's own response records are not sent. Sizes above PACKET_SIZE are
+// capped. Latency runs from the recorded send time, as in the open-loop
+// sweep. result: average latency (s), throughput (MB/s), p50 and p99
+// latency (s). The requests are also split into *number_of_segments runs of
+// equal count whose throughputs go to `segments`; *number_of_segments is
+// lowered when the trace has fewer requests.
+double* compute_replay(Transport *transport, const Trace *trace, double speed, double *segments, int *number_of_segments) {
+    double *result = (double *)malloc(4 * sizeof(double));
+    uint8_t *data = (uint8_t *)malloc(PACKET_SIZE);
+    uint8_t *response = (uint8_t *)malloc(PACKET_SIZE);
+    uint64_t bytes = 0;
+    Samples latencies;
+
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        data[i] = i;
+    }
+    Samples_init(&latencies, trace->count);
+
+    size_t requests = 0;
+    for (size_t k = 0; k < trace->count; k++) {
+        requests += trace->records[k].direction == TRACE_REQUEST;
+    }
+    if ((size_t)*number_of_segments > requests) {
+        *number_of_segments = (int)requests;
+    }
+    int segment = 0;
+    uint64_t segment_bytes = 0;
+
+    uint64_t startTime = openloop_now();
+    uint64_t segmentStart = startTime;
+
+    for (size_t k = 0; k < trace->count; k++) {
+        const TraceRecord *record = &trace->records[k];
+        if (record->direction != TRACE_REQUEST) {
+            continue;
+        }
+
+        int size = record->size < (uint32_t)PACKET_SIZE ? (int)record->size : PACKET_SIZE;
+        size = size > 0 ? size : 1;
+
+        uint64_t due = Trace_due(record, startTime, speed);
+        openloop_wait_until(due);
+
+        transport->write(transport->io, data, size);
+        transport->read(transport->io, response, PACKET_SIZE);
+        uint64_t latency = openloop_now() - due;
+        Samples_add(&latencies, latency);
+        Results_sample((double)latency / 1000000000.0);
+        bytes += 2 * (uint64_t)size;
+        segment_bytes += 2 * (uint64_t)size;
+
+        if (latencies.count == requests * (segment + 1) / *number_of_segments) {
+            uint64_t now = openloop_now();
+            segments[segment++] = (double)segment_bytes / (1024.0 * 1024.0) / ((double)(now - segmentStart) / 1000000000.0);
+            segment_bytes = 0;
+            segmentStart = now;
+        }
+    }
+
+    uint64_t endTime = openloop_now();
+    ResourceUsage_moved(bytes);
+
+    result[0] = Samples_mean(&latencies) / 1000000000.0;
+    result[1] = (double)bytes / (1024.0 * 1024.0) / ((double)(endTime - startTime) / 1000000000.0);
+    result[2] = (double)Samples_quantile(&latencies, 0.5) / 1000000000.0;
+    result[3] = (double)Samples_quantile(&latencies, 0.99) / 1000000000.0;
+
+    printf("Replayed %zu requests at %.2fx speed\n", latencies.count, speed);
+    printf("Latency: %f s\n", result[0]);
+    printf("Throughput: %f MB/s\n", result[1]);
+
+    Samples_free(&latencies);
+    free(response);
+    free(data);
+    return result;
+}
+
+double* run_replay(Transport *transport, void *(*echo)(void *), void *peer_io, ExecMode mode, const Trace *trace, double speed) {
+    printf("Starting replay for method: %s (%s)\n", transport->name, ExecMode_name(mode));
+
+    EchoPeer peer;
+    EchoPeer_start(&peer, mode, echo, peer_io);
+
+    double *segments = (double *)malloc(NUMBER_OF_EXPERIMENTS * sizeof(double));
+    int number_of_segments = NUMBER_OF_EXPERIMENTS;
+    double *result = compute_replay(transport, trace, speed, segments, &number_of_segments);
+    Results_record(transport->name, ExecMode_name(mode), "replay_latency", "s", true);
+    Results_record_values(transport->name, ExecMode_name(mode), "replay_throughput", "MB/s", false, segments, number_of_segments);
+    free(segments);
+    transport->close(transport->io);
+    EchoPeer_join(&peer);
+    PhaseStats_dump(transport->name);
+
+    return result;
+}
+
+#endif
@@ -0,0 +1,271 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "PhaseStats.h"
+#include "../common/PerfCounters.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Results.h"
+
+#define SEQLOCK_MAX_PAYLOAD 4096
+#define SEQLOCK_MAX_READERS 64
+
+typedef struct {
+    _Alignas(64) uint64_t reads;
+    uint64_t retries;
+    uint64_t total_staleness_ns;
+    uint64_t total_version_lag;
+} SeqlockReaderStats;
+
+// Latest-value channel: `seq` is odd while the writer is updating the value
+// and even once it is stable, so seq / 2 is the version of the payload.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t seq;
+    int len;
+    _Atomic int closed;
+    _Atomic int ready_readers;
+    _Atomic int started;
+    SeqlockReaderStats stats[SEQLOCK_MAX_READERS];
+    _Alignas(64) uint8_t data[SEQLOCK_MAX_PAYLOAD];
+} SeqlockRegion;
+
+typedef struct {
+    SeqlockRegion *region;
+} SeqlockWriter;
+
+typedef struct {
+    SeqlockRegion *region;
+    uint64_t version;
+    uint64_t retries;
+} SeqlockReader;
+
+void SeqlockWriter_init(SeqlockWriter *writer, uint8_t *ptr) {
+    writer->region = (SeqlockRegion *)ptr;
+    memset(writer->region, 0, sizeof(SeqlockRegion));
+}
+
+void SeqlockWriter_close(SeqlockWriter *writer) {
+    atomic_store_explicit(&writer->region->closed, 1, memory_order_release);
+}
+
+// Never waits: readers that overlap the update notice the changed sequence
+// and retry. A value larger than the region's SEQLOCK_MAX_PAYLOAD is refused.
+void SeqlockWriter_write(SeqlockWriter *writer, const uint8_t *bytes, int len) {
+    SeqlockRegion *region = writer->region;
+    if (len < 0 || len > SEQLOCK_MAX_PAYLOAD) {
+        fprintf(stderr, "A %d-byte value does not fit the %d-byte seqlock payload\n", len, SEQLOCK_MAX_PAYLOAD);
+        exit(1);
+    }
+    uint64_t seq = atomic_load_explicit(&region->seq, memory_order_relaxed);
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
+
+    atomic_store_explicit(&region->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(region->data, bytes, len);
+    region->len = len;
+    PhaseTimer_mark(&timer, PHASE_SEQLOCK, PHASE_COPY);
+
+    atomic_store_explicit(&region->seq, seq + 2, memory_order_release);
+    PhaseTimer_mark(&timer, PHASE_SEQLOCK, PHASE_PUBLISH);
+}
+
+void SeqlockReader_init(SeqlockReader *reader, uint8_t *ptr) {
+    reader->region = (SeqlockRegion *)ptr;
+    reader->version = 0;
+    reader->retries = 0;
+}
+
+// Copies the newest value into out_data and returns its length, or -1 once
+// the writer has closed the channel. reader->version holds the version read.
+int SeqlockReader_read(SeqlockReader *reader, uint8_t *out_data, int max_size) {
+    SeqlockRegion *region = reader->region;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+    while (true) {
+        uint64_t seq = atomic_load_explicit(&region->seq, memory_order_acquire);
+
+        if (atomic_load_explicit(&region->closed, memory_order_acquire)) {
+            return -1;
+        }
+
+        if (seq & 1) {
+            reader->retries++;
+            continue;
+        }
+
+        int len = region->len;
+        if (len > max_size) {
+            len = max_size;
+        }
+        memcpy(out_data, region->data, len);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&region->seq, memory_order_relaxed) != seq) {
+            reader->retries++;
+            continue;
+        }
+
+        // Torn reads are retried, so their time shows up as waiting.
+        PhaseTimer_mark(&timer, PHASE_SEQLOCK, PHASE_WAIT);
+        reader->version = seq / 2;
+        return len;
+    }
+}
+
+static void seqlock_reader_process(uint8_t *ptr, int id) {
+    SeqlockRegion *region = (SeqlockRegion *)ptr;
+    SeqlockReaderStats *stats = &region->stats[id];
+    SeqlockReader reader;
+    uint8_t data[SEQLOCK_MAX_PAYLOAD];
+
+    SeqlockReader_init(&reader, ptr);
+    atomic_fetch_add(&region->ready_readers, 1);
+    while (!atomic_load_explicit(&region->started, memory_order_acquire)) {}
+
+    while (SeqlockReader_read(&reader, data, sizeof(data)) > 0) {
+        uint64_t written;
+        memcpy(&written, data, sizeof(written));
+        uint64_t now = getCurTimeNs();
+        uint64_t latest = atomic_load_explicit(&region->seq, memory_order_relaxed) / 2;
+
+        stats->reads++;
+        stats->total_staleness_ns += now - written;
+        stats->total_version_lag += latest - reader.version;
+    }
+
+    stats->retries = reader.retries;
+
+    if (id == 0) {
+        PhaseStats_dump("seqlock reader 0");
+    }
+}
+
+// Writes `number_of_writes` timestamped snapshots of `payload_size` bytes
+// while `readers` forked processes poll the latest value. result: writes per
+// second, reads per second over all readers, torn-read retries (% of read
+// attempts), average staleness (s), average version lag, CPU-seconds per GB
+// read.
+double* compute_snapshot_Seqlock(uint8_t *ptr, int payload_size, int readers, uint64_t number_of_writes) {
+    double *result = (double *)malloc(6 * sizeof(double));
+    SeqlockWriter writer;
+    SeqlockWriter_init(&writer, ptr);
+    SeqlockRegion *region = writer.region;
+
+    uint8_t *data = (uint8_t *)malloc(payload_size);
+    for (int i = 0; i < payload_size; i++) {
+        data[i] = i;
+    }
+    uint64_t now = getCurTimeNs();
+    memcpy(data, &now, sizeof(now));
+    SeqlockWriter_write(&writer, data, payload_size);
+
+    ResourceUsage start, end, self, peers = { 0 };
+    ResourceUsage_thread(&start);
+
+    pid_t *children = (pid_t *)malloc(readers * sizeof(pid_t));
+    fflush(stdout);
+    for (int r = 0; r < readers; r++) {
+        children[r] = fork();
+        if (children[r] == 0) {
+            seqlock_reader_process(ptr, r);
+            exit(0);
+        }
+    }
+
+    while (atomic_load(&region->ready_readers) < readers) {}
+
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    PerfCounters_start(&counters);
+
+    uint64_t startTime = getCurTimeNs();
+    atomic_store_explicit(&region->started, 1, memory_order_release);
+    for (uint64_t k = 0; k < number_of_writes; k++) {
+        now = getCurTimeNs();
+        memcpy(data, &now, sizeof(now));
+        SeqlockWriter_write(&writer, data, payload_size);
+    }
+    uint64_t endTime = getCurTimeNs();
+    PerfCounters_stop(&counters);
+    SeqlockWriter_close(&writer);
+
+    for (int r = 0; r < readers; r++) {
+        ResourceUsage child;
+        ResourceUsage_wait(children[r], &child);
+        ResourceUsage_add(&peers, &child);
+    }
+    ResourceUsage_thread(&end);
+    ResourceUsage_sub(&self, &end, &start);
+    PhaseStats_dump("seqlock writer");
+    PerfCounters_print(&counters, "seqlock writer", number_of_writes, "write");
+    PerfCounters_close(&counters);
+
+    uint64_t reads = 0, retries = 0, total_staleness = 0, total_lag = 0;
+    for (int r = 0; r < readers; r++) {
+        reads += region->stats[r].reads;
+        retries += region->stats[r].retries;
+        total_staleness += region->stats[r].total_staleness_ns;
+        total_lag += region->stats[r].total_version_lag;
+    }
+
+    double seconds = (double)(endTime - startTime) / 1000000000.0;
+    result[0] = (double)number_of_writes / seconds;
+    result[1] = (double)reads / seconds;
+    result[2] = (reads + retries) ? 100.0 * (double)retries / (double)(reads + retries) : 0;
+    result[3] = reads ? (double)total_staleness / (double)reads / 1000000000.0 : 0;
+    result[4] = reads ? (double)total_lag / (double)reads : 0;
+    result[5] = ResourceUsage_cpu_per_gb(&self, &peers, reads * payload_size);
+
+    printf("Payload: %d B, Writes: %f /s, Reads: %f /s, Retries: %f %%\n", payload_size, result[0], result[1], result[2]);
+    ResourceUsage_print("seqlock writer and readers", &self, &peers, reads * payload_size);
+
+    free(children);
+    free(data);
+    return result;
+}
+
+// Each payload size runs NUMBER_OF_EXPERIMENTS times with 100000 writes,
+// one sample per run; the table shows the mean of the runs.
+void run_benchmark_Seqlock(const char *name, uint8_t *ptr, int readers, const int *payload_sizes, int number_of_sizes) {
+    printf("Starting benchmark for method: %s\n", name);
+
+    double *results[number_of_sizes][NUMBER_OF_EXPERIMENTS];
+    for (int i = 0; i < number_of_sizes; i++) {
+        for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+            results[i][e] = compute_snapshot_Seqlock(ptr, payload_sizes[i], readers, 100000);
+        }
+    }
+
+    printf("Readers: %d, mean of %d experiments\n", readers, NUMBER_OF_EXPERIMENTS);
+    printf("+--------------+-----------------+----------------+-------------+----------------+-------------+------------+\n");
+    printf("| Payload (B)  | Writes (1/s)    | Reads (1/s)    | Retries (%%) | Staleness (us) | Version lag | CPU s / GB |\n");
+    printf("+--------------+-----------------+----------------+-------------+----------------+-------------+------------+\n");
+    for (int i = 0; i < number_of_sizes; i++) {
+        char variant[32];
+        double mean[6];
+        snprintf(variant, sizeof(variant), "payload=%d", payload_sizes[i]);
+        mean[0] = Results_record_column(name, variant, "writes", "1/s", false, results[i], NUMBER_OF_EXPERIMENTS, 0);
+        mean[1] = Results_record_column(name, variant, "reads", "1/s", false, results[i], NUMBER_OF_EXPERIMENTS, 1);
+        mean[2] = Results_record_column(name, variant, "retries", "%", true, results[i], NUMBER_OF_EXPERIMENTS, 2);
+        mean[3] = Results_record_column(name, variant, "staleness", "s", true, results[i], NUMBER_OF_EXPERIMENTS, 3);
+        mean[4] = Results_record_column(name, variant, "version_lag", "versions", true, results[i], NUMBER_OF_EXPERIMENTS, 4);
+        mean[5] = Results_record_column(name, variant, "cpu_per_gb", "s/GB", true, results[i], NUMBER_OF_EXPERIMENTS, 5);
+
+        printf("| %12d | %15.1lf | %14.1lf | %11.3lf | %14.3lf | %11.2lf | %10.3lf |\n", payload_sizes[i],
+               mean[0], mean[1], mean[2], mean[3] * 1000000.0, mean[4], mean[5]);
+        for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+            free(results[i][e]);
+        }
+    }
+    printf("+--------------+-----------------+----------------+-------------+----------------+-------------+------------+\n");
+}
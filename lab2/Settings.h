@@ -0,0 +1,139 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+
+// Settings a sweep changes between runs without a rebuild (see main.c and
+// ../common/Grid.h). config.h holds their defaults and everything that
+// stays fixed at compile time.
+
+// What a transport does while it polls for the peer.
+typedef enum {
+    WAIT_SPIN,      // re-read immediately
+    WAIT_YIELD,     // sched_yield() between reads
+    WAIT_SLEEP,     // sleep WAIT_SLEEP_NS between reads
+} WaitStrategy;
+
+// Where the benchmark thread and its echo peer run.
+typedef enum {
+    PLACEMENT_ANY,      // wherever the scheduler puts them
+    PLACEMENT_SAME,     // both on the first allowed CPU
+    PLACEMENT_SPLIT,    // on the first and second allowed CPUs
+} Placement;
+
+typedef struct {
+    int packet_size;
+    int number_of_experiments;
+    WaitStrategy wait;
+    Placement placement;
+} Settings;
+
+static Settings settings = { DEFAULT_PACKET_SIZE, DEFAULT_NUMBER_OF_EXPERIMENTS, WAIT_SPIN, PLACEMENT_ANY };
+
+#define PACKET_SIZE (settings.packet_size)
+#define NUMBER_OF_EXPERIMENTS (settings.number_of_experiments)
+
+// Latency is always measured with 128-byte messages, so shared-memory
+// transports hold at least that much.
+static inline int message_capacity() {
+    return PACKET_SIZE > 128 ? PACKET_SIZE : 128;
+}
+
+static const char *WAIT_NAMES[] = { "spin", "yield", "sleep" };
+static const char *PLACEMENT_NAMES[] = { "any", "same", "split" };
+
+static bool settings_lookup(const char **names, int count, const char *name, int *value) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            *value = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WaitStrategy_parse(const char *name, WaitStrategy *wait) {
+    int value;
+    if (!settings_lookup(WAIT_NAMES, 3, name, &value)) {
+        return false;
+    }
+    *wait = (WaitStrategy)value;
+    return true;
+}
+
+bool Placement_parse(const char *name, Placement *placement) {
+    int value;
+    if (!settings_lookup(PLACEMENT_NAMES, 3, name, &value)) {
+        return false;
+    }
+    *placement = (Placement)value;
+    return true;
+}
+
+// One poll of a transport that found nothing to do.
+static inline void wait_relax() {
+    switch (settings.wait) {
+        case WAIT_SPIN:
+            break;
+        case WAIT_YIELD:
+            sched_yield();
+            break;
+        case WAIT_SLEEP:
+            nanosleep(&(struct timespec){ 0, WAIT_SLEEP_NS }, NULL);
+            break;
+    }
+}
+
+// For do-while polling loops: relaxes before every read but the first, so a
+// peer that has already answered costs nothing extra.
+static inline void wait_retry(uint64_t *polls) {
+    if ((*polls)++) {
+        wait_relax();
+    }
+}
+
+// The CPUs the process was allowed at the first call; placements pick from
+// them and PLACEMENT_ANY restores them.
+static cpu_set_t placement_cpus;
+static bool placement_saved = false;
+
+// Pins the calling thread according to settings.placement: the benchmark
+// side (peer = false) to the first allowed CPU, the echo peer to the same
+// one or the next.
+void Placement_apply(bool peer) {
+    if (!placement_saved) {
+        sched_getaffinity(0, sizeof(placement_cpus), &placement_cpus);
+        placement_saved = true;
+    }
+
+    cpu_set_t set = placement_cpus;
+    if (settings.placement != PLACEMENT_ANY) {
+        int first = -1, second = -1;
+        for (int cpu = 0; cpu < CPU_SETSIZE && second < 0; cpu++) {
+            if (CPU_ISSET(cpu, &placement_cpus)) {
+                *(first < 0 ? &first : &second) = cpu;
+            }
+        }
+
+        int cpu = first;
+        if (peer && settings.placement == PLACEMENT_SPLIT) {
+            cpu = second >= 0 ? second : first;
+        } else if (!peer && settings.placement == PLACEMENT_SPLIT && second < 0) {
+            printf("Placement 'split' needs two CPUs; both sides run on CPU %d\n", first);
+        }
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+    }
+
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity");
+    }
+}
+
+#endif
@@ -8,11 +8,12 @@
 #include <time.h>
 #include <unistd.h>
 #include <stdint.h>
-#include "config.h"
-
-#define read_bytes SharedIO_read_bytes
-#define write_bytes SharedIO_write_bytes
-#define DEBUG 0
+#include "Settings.h"
+#include "EchoPeer.h"
+#include "OneWay.h"
+#include "PhaseStats.h"
+#include "Transport.h"
+#include "EchoBenchmark.h"
 
 typedef struct {
     int id;
@@ -74,9 +75,12 @@ void SharedIO_write_bytes(SharedIO *shared_io, const uint8_t *bytes, int len) {
     }
 
     int size = 0;
-    uint64_t startTime2 = getCurTime();
+    uint64_t polls = 0;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
 
     do {
+        wait_retry(&polls);
         shm_read((char *) &size, shared_io, sizeof(int), sizeof(int));
 
         if (size == -1) {
@@ -85,17 +89,15 @@ void SharedIO_write_bytes(SharedIO *shared_io, const uint8_t *bytes, int len) {
         }
     } while (size != 0);
 
-    uint64_t endTime2 = getCurTime();
-    if (DEBUG) printf("WAITING WRITE TIME: %f\n", (double)(endTime2 - startTime2)/1000000.0);
+    PhaseTimer_mark(&timer, PHASE_SHAREDIO, PHASE_WAIT);
 
-    uint64_t startTime3 = getCurTime();
     shm_write(shared_io, (char *) bytes, sizeof(int) * 2, len);
+    PhaseTimer_mark(&timer, PHASE_SHAREDIO, PHASE_COPY);
+
     int temp = len;
     shm_write(shared_io, (char *) &temp, sizeof(int), sizeof(int));
     shm_write(shared_io, (char *) &shared_io->sender, 0, sizeof(int));
-
-    uint64_t endTime3 = getCurTime();
-    if (DEBUG) printf("        WRITE TIME: %f\n", (double)(endTime3 - startTime3)/1000000.0);
+    PhaseTimer_mark(&timer, PHASE_SHAREDIO, PHASE_PUBLISH);
 }
 
 int SharedIO_read_bytes(SharedIO *shared_io, uint8_t *out_data, int max_size) {
@@ -104,165 +106,74 @@ int SharedIO_read_bytes(SharedIO *shared_io, uint8_t *out_data, int max_size) {
     }
 
     int size, other;
-    uint64_t startTime2 = getCurTime();
+    uint64_t polls = 0;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
 
     do {
+        wait_retry(&polls);
         shm_read((char *) &other, shared_io, 0, sizeof(int));
         shm_read((char *) &size, shared_io, sizeof(int), sizeof(int));
     } while (!size || other == shared_io->sender);
 
-    uint64_t endTime2 = getCurTime();
-
-    if (DEBUG) printf("WAITING  READ TIME: %f\n", (double)(endTime2 - startTime2)/1000000.0);
+    PhaseTimer_mark(&timer, PHASE_SHAREDIO, PHASE_WAIT);
 
     if (size == -1) {
         SharedIO_close(shared_io);
         return -1;
     }
-    uint64_t startTime3 = getCurTime();
+
+    // A message longer than max_size is cut short; the rest is dropped
+    // when the slot is released.
+    size = size < max_size ? size : max_size;
     shm_read((char *) out_data, shared_io, sizeof(int) * 2, size);
+    PhaseTimer_mark(&timer, PHASE_SHAREDIO, PHASE_COPY);
 
     int temp = 0;
     shm_write(shared_io, (char *) &temp, sizeof(int), sizeof(int));
     shm_write(shared_io, (char *) &shared_io->sender, 0, sizeof(int));
-
-    uint64_t endTime3 = getCurTime();
-    if (DEBUG) printf("        READ TIME: %f\n", (double)(endTime3 - startTime3)/1000000.0);
+    PhaseTimer_mark(&timer, PHASE_SHAREDIO, PHASE_PUBLISH);
 
     return size;
 }
 
-double compute_latency_SharedIO(SharedIO *file_io, uint64_t number_of_experiments) {
-    double total_latency = 0;
-    uint8_t data[128];
-    uint8_t response[128];
-
-    for (uint64_t k = 0; k < number_of_experiments; k++) {
-        uint64_t startTime = getCurTime();
-
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            data[i] = i;
-        }
-
-        uint64_t startTime2 = getCurTime();
-        write_bytes(file_io, data, sizeof(data));
-        uint64_t endTime2 = getCurTime();
+void *echo_SharedIO(void *arg) {
+    SharedIO *io = (SharedIO *)arg;
+    uint8_t *data = (uint8_t *)malloc(message_capacity());
+    int data_size;
 
-        if (DEBUG) printf("WRITE TIME: %f\n", (double)(endTime2 - startTime2)/1000000.0);
-
-        uint64_t startTime3 = getCurTime();
-        int response_size = read_bytes(file_io, response, sizeof(response));
-        uint64_t endTime3 = getCurTime();
+    do {
+        data_size = SharedIO_read_bytes(io, data, message_capacity());
 
-        if (DEBUG) printf("READ  TIME: %f\n", (double)(endTime3 - startTime3)/1000000.0);
-        
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            assert(data[i] == response[i]);
+        if (data_size > 0) {
+            OneWay_echo(data, data_size);
+            SharedIO_write_bytes(io, data, data_size);
         }
+    } while (data_size > 0);
 
-        uint64_t endTime = getCurTime();
-        total_latency += ((double)(endTime - startTime)/1000000.0) / 2;
-    }
-
-    printf("Latency: %f s\n", total_latency / (double)number_of_experiments);
-
-    return total_latency / (double)number_of_experiments;
+    free(data);
+    PhaseStats_dump("echo peer");
+    return NULL;
 }
 
-double compute_throughput_SharedIO(SharedIO *file_io, uint64_t number_of_experiments) {
-    double throughput = 0;
-
-    for(uint64_t n = 0; n < number_of_experiments; n++) {
-        uint64_t startTime = getCurTime();
-        uint8_t data[PACKET_SIZE];
-        uint8_t response[PACKET_SIZE];
-        uint64_t mega_bytes = 128;
-
-        for (uint64_t i = 0; i < sizeof(data); i++) {
-            data[i] = i;
-        }
-
-        for (uint64_t k = 0; k < mega_bytes * 1024 * 1024 / PACKET_SIZE; k++) {
-            write_bytes(file_io, data, sizeof(data));
-            int response_size = read_bytes(file_io, response, sizeof(response));
-
-            for (uint64_t i = 0; i < sizeof(data); i++) {
-                assert(data[i] == response[i]);
-            }
-        }
-        uint64_t endTime = getCurTime();
-        throughput += ((double)(endTime - startTime)/1000000.0);
-    }
-
-    printf("Throughput: %f MB/s\n", (128.0 / throughput) * (number_of_experiments / (1024 * 1024)));
-
-    return (128.0 / throughput) * (number_of_experiments / (1024 * 1024));
+static void SharedIO_transport_write(void *io, const uint8_t *bytes, int len) {
+    SharedIO_write_bytes((SharedIO *)io, bytes, len);
 }
 
-
-double compute_capacity_SharedIO(SharedIO *file_io, uint64_t number_of_experiments) {
-    double total_max_throughput = 0;
-
-    for(uint64_t n = 0; n < number_of_experiments; n++){
-        double max_throughput = 0;
-        uint8_t data[PACKET_SIZE];
-        uint8_t response[PACKET_SIZE];
-        uint64_t mega_bytes = 128;
-
-        for (int k = 0; k < 10; k++) {
-            uint64_t startTime = getCurTime();
-
-            for (uint64_t i = 0; i < sizeof(data); i++) {
-                data[i] = i;
-            }
-
-            for (uint64_t k = 0; k < mega_bytes * 1024 * 1024 / PACKET_SIZE; k++) {
-                write_bytes(file_io, data, sizeof(data));
-                int response_size = read_bytes(file_io, response, sizeof(response));
-                
-                for (uint64_t i = 0; i < sizeof(data); i++) {
-                    assert(data[i] == response[i]);
-                }
-            }
-            uint64_t endTime = getCurTime();
-            double throughput = (double)mega_bytes / ((double)(endTime - startTime)/1000000.0) * 2;
-            max_throughput = (max_throughput < throughput) ? throughput : max_throughput;
-        }
-        total_max_throughput += max_throughput;
-    }
-
-    printf("Capacity: %f MB/s\n", total_max_throughput/(double)number_of_experiments);
-
-    return total_max_throughput/(double)number_of_experiments;
+static int SharedIO_transport_read(void *io, uint8_t *out_data, int max_size) {
+    return SharedIO_read_bytes((SharedIO *)io, out_data, max_size);
 }
 
+static void SharedIO_transport_close(void *io) {
+    SharedIO_close((SharedIO *)io);
+}
 
-double* run_benchmark_SharedIO(const char *name, SharedIO *io_first, SharedIO *io_second) {
-    double *result = (double *)malloc(3 * sizeof(double));
-
-    printf("Starting benchmark for method: %s\n", name);
-
-    int p = fork();
-
-    if (p == 0) {
-        uint8_t data[PACKET_SIZE];
-        int data_size;
-
-        do {
-            data_size = read_bytes(io_second, data, sizeof(data));
-
-            if (data_size > 0) {
-                write_bytes(io_second, data, data_size);
-            }
-        } while (data_size > 0);
+Transport SharedIO_transport(const char *name, SharedIO *shared_io) {
+    Transport transport = { name, shared_io, SharedIO_transport_write, SharedIO_transport_read, SharedIO_transport_close };
+    return transport;
+}
 
-        exit(0);
-    } else {
-        result[0] = compute_latency_SharedIO(io_first, NUMBER_OF_EXPERIMENTS*10000);
-        result[1] = compute_throughput_SharedIO(io_first, NUMBER_OF_EXPERIMENTS);
-        result[2] = compute_capacity_SharedIO(io_first, NUMBER_OF_EXPERIMENTS);
-        SharedIO_close(io_first);
-    }
-    
-    return result;
+double* run_benchmark_SharedIO(const char *name, SharedIO *io_first, SharedIO *io_second, ExecMode mode) {
+    Transport transport = SharedIO_transport(name, io_first);
+    return run_benchmark(&transport, echo_SharedIO, io_second, mode);
 }
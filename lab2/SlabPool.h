@@ -0,0 +1,321 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "../common/PerfCounters.h"
+#include "../common/ResourceUsage.h"
+#include "../common/Results.h"
+
+#define SLAB_CLASSES 3
+#define SLAB_BLOCKS_PER_CLASS 8
+#define SLAB_INVALID_HANDLE UINT32_MAX
+
+// The largest class holds one message, so it follows the run-time PACKET_SIZE.
+static int slab_class_size(int c) {
+    const int sizes[SLAB_CLASSES] = { 4 * 1024, 64 * 1024, PACKET_SIZE };
+    return sizes[c];
+}
+
+// A handle names a block as (size class << 24 | block index); it is the only
+// thing that travels through the channel.
+typedef uint32_t SlabHandle;
+
+// Free blocks form a Treiber stack. `free_head` packs an ABA tag in the
+// upper 32 bits and (block index + 1) in the lower 32 bits, 0 meaning empty.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t free_head;
+    int block_size;
+    size_t offset;
+    _Atomic int refcount[SLAB_BLOCKS_PER_CLASS];
+    uint32_t next[SLAB_BLOCKS_PER_CLASS];
+} SlabClass;
+
+typedef struct {
+    SlabClass classes[SLAB_CLASSES];
+} SlabPoolHeader;
+
+typedef struct {
+    uint8_t *base;
+    SlabPoolHeader *header;
+} SlabPool;
+
+static size_t slab_header_size() {
+    return (sizeof(SlabPoolHeader) + 4095) & ~(size_t)4095;
+}
+
+size_t SlabPool_segment_size() {
+    size_t size = slab_header_size();
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        size += (size_t)slab_class_size(c) * SLAB_BLOCKS_PER_CLASS;
+    }
+    return size;
+}
+
+// Lays out the pool in a fresh segment. Only one process formats it; every
+// other process just attaches.
+void SlabPool_format(SlabPool *pool, uint8_t *ptr) {
+    pool->base = ptr;
+    pool->header = (SlabPoolHeader *)ptr;
+    memset(pool->header, 0, sizeof(SlabPoolHeader));
+
+    size_t offset = slab_header_size();
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        SlabClass *slab_class = &pool->header->classes[c];
+        slab_class->block_size = slab_class_size(c);
+        slab_class->offset = offset;
+        offset += (size_t)slab_class_size(c) * SLAB_BLOCKS_PER_CLASS;
+
+        for (uint32_t i = 0; i < SLAB_BLOCKS_PER_CLASS; i++) {
+            slab_class->next[i] = (i + 1 < SLAB_BLOCKS_PER_CLASS) ? i + 2 : 0;
+            atomic_init(&slab_class->refcount[i], 0);
+        }
+        atomic_init(&slab_class->free_head, 1);
+    }
+}
+
+void SlabPool_attach(SlabPool *pool, uint8_t *ptr) {
+    pool->base = ptr;
+    pool->header = (SlabPoolHeader *)ptr;
+}
+
+static void slab_push(SlabClass *slab_class, uint32_t index) {
+    uint64_t head = atomic_load_explicit(&slab_class->free_head, memory_order_relaxed);
+    uint64_t new_head;
+
+    do {
+        slab_class->next[index] = (uint32_t)head;
+        new_head = (((head >> 32) + 1) << 32) | (index + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&slab_class->free_head, &head, new_head,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+static bool slab_pop(SlabClass *slab_class, uint32_t *index) {
+    uint64_t head = atomic_load_explicit(&slab_class->free_head, memory_order_acquire);
+    uint64_t new_head;
+
+    do {
+        if ((uint32_t)head == 0) {
+            return false;
+        }
+        uint32_t next = slab_class->next[(uint32_t)head - 1];
+        new_head = (((head >> 32) + 1) << 32) | next;
+    } while (!atomic_compare_exchange_weak_explicit(&slab_class->free_head, &head, new_head,
+                                                    memory_order_acquire, memory_order_acquire));
+
+    *index = (uint32_t)head - 1;
+    return true;
+}
+
+// Returns a block of at least `size` bytes with a reference count of one, or
+// SLAB_INVALID_HANDLE when the matching size class is exhausted.
+SlabHandle SlabPool_alloc(SlabPool *pool, int size) {
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        if (size > pool->header->classes[c].block_size) {
+            continue;
+        }
+
+        uint32_t index;
+        if (!slab_pop(&pool->header->classes[c], &index)) {
+            return SLAB_INVALID_HANDLE;
+        }
+        atomic_store_explicit(&pool->header->classes[c].refcount[index], 1, memory_order_relaxed);
+        return ((uint32_t)c << 24) | index;
+    }
+
+    return SLAB_INVALID_HANDLE;
+}
+
+uint8_t *SlabPool_get(SlabPool *pool, SlabHandle handle) {
+    SlabClass *slab_class = &pool->header->classes[handle >> 24];
+    return pool->base + slab_class->offset + (size_t)(handle & 0xFFFFFF) * slab_class->block_size;
+}
+
+int SlabPool_block_size(SlabPool *pool, SlabHandle handle) {
+    return pool->header->classes[handle >> 24].block_size;
+}
+
+void SlabPool_retain(SlabPool *pool, SlabHandle handle) {
+    SlabClass *slab_class = &pool->header->classes[handle >> 24];
+    atomic_fetch_add_explicit(&slab_class->refcount[handle & 0xFFFFFF], 1, memory_order_relaxed);
+}
+
+void SlabPool_release(SlabPool *pool, SlabHandle handle) {
+    SlabClass *slab_class = &pool->header->classes[handle >> 24];
+    uint32_t index = handle & 0xFFFFFF;
+
+    if (atomic_fetch_sub_explicit(&slab_class->refcount[index], 1, memory_order_acq_rel) == 1) {
+        slab_push(slab_class, index);
+    }
+}
+
+// Reads one byte per cache line, standing in for the consumer using the data.
+static uint64_t slab_consume(const uint8_t *data, int len) {
+    uint64_t sum = 0;
+    for (int i = 0; i < len; i += 64) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static void slab_fill(uint8_t *data, int len, uint64_t k) {
+    for (int i = 0; i < len; i++) {
+        data[i] = i + k;
+    }
+}
+
+// Closes a one-way channel once the consumer has taken the last message,
+// claiming the slot so the consumer sees the close marker.
+static void slab_channel_finish(SharedIO *channel) {
+    int size, other;
+    do {
+        shm_read((char *) &other, channel, 0, sizeof(int));
+        shm_read((char *) &size, channel, sizeof(int), sizeof(int));
+    } while (size != 0 || other == channel->sender);
+
+    shm_write(channel, (char *) &channel->sender, 0, sizeof(int));
+    SharedIO_close(channel);
+}
+
+// Ends an experiment every `per_experiment` messages and samples its
+// throughput as seen by the producer, which the channel holds to the
+// consumer's pace.
+static void slab_sample_experiment(uint64_t sent, uint64_t per_experiment, uint64_t mega_bytes, uint64_t *experimentStart) {
+    if (sent % per_experiment == 0) {
+        uint64_t now = getCurTime();
+        Results_sample((double)mega_bytes / ((double)(now - *experimentStart) / 1000000.0));
+        *experimentStart = now;
+    }
+}
+
+// Streams PACKET_SIZE messages one way by copying them through `channel`,
+// one Results_sample per experiment.
+double compute_throughput_SlabPool_copy(SharedIO *channel, SharedIO *peer, uint64_t number_of_experiments) {
+    uint64_t mega_bytes = 128;
+    uint64_t messages = mega_bytes * 1024 * 1024 / PACKET_SIZE * number_of_experiments;
+    uint8_t *data = (uint8_t *)malloc(PACKET_SIZE);
+
+    ResourceUsage start, end, self, consumer;
+    ResourceUsage_thread(&start);
+
+    fflush(stdout);
+    int p = fork();
+
+    if (p == 0) {
+        volatile uint64_t sink = 0;
+        int data_size;
+
+        while ((data_size = SharedIO_read_bytes(peer, data, PACKET_SIZE)) > 0) {
+            sink += slab_consume(data, data_size);
+        }
+        exit(0);
+    }
+
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    PerfCounters_start(&counters);
+
+    uint64_t startTime = getCurTime();
+    uint64_t experimentStart = startTime;
+    for (uint64_t k = 0; k < messages; k++) {
+        slab_fill(data, PACKET_SIZE, k);
+        SharedIO_write_bytes(channel, data, PACKET_SIZE);
+        slab_sample_experiment(k + 1, messages / number_of_experiments, mega_bytes, &experimentStart);
+    }
+    slab_channel_finish(channel);
+    PerfCounters_stop(&counters);
+    ResourceUsage_wait(p, &consumer);
+    uint64_t endTime = getCurTime();
+    ResourceUsage_thread(&end);
+    ResourceUsage_sub(&self, &end, &start);
+
+    double throughput = (double)(mega_bytes * number_of_experiments) / ((double)(endTime - startTime) / 1000000.0);
+    printf("Copy throughput: %f MB/s\n", throughput);
+    PerfCounters_print(&counters, "slab pool copy producer", messages, "message");
+    PerfCounters_close(&counters);
+    ResourceUsage_print("slab pool copy producer and consumer", &self, &consumer, mega_bytes * number_of_experiments * 1024 * 1024);
+
+    free(data);
+    return throughput;
+}
+
+// Streams the same messages by filling pool blocks in place and sending only
+// their handles through `channel`; the consumer reads in place and releases.
+// One Results_sample per experiment.
+double compute_throughput_SlabPool_handle(SlabPool *pool, SharedIO *channel, SharedIO *peer, uint64_t number_of_experiments) {
+    uint64_t mega_bytes = 128;
+    uint64_t messages = mega_bytes * 1024 * 1024 / PACKET_SIZE * number_of_experiments;
+
+    ResourceUsage start, end, self, consumer;
+    ResourceUsage_thread(&start);
+
+    fflush(stdout);
+    int p = fork();
+
+    if (p == 0) {
+        volatile uint64_t sink = 0;
+        SlabHandle handle;
+
+        while (SharedIO_read_bytes(peer, (uint8_t *)&handle, sizeof(handle)) > 0) {
+            sink += slab_consume(SlabPool_get(pool, handle), PACKET_SIZE);
+            SlabPool_release(pool, handle);
+        }
+        exit(0);
+    }
+
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    PerfCounters_start(&counters);
+
+    uint64_t startTime = getCurTime();
+    uint64_t experimentStart = startTime;
+    for (uint64_t k = 0; k < messages; k++) {
+        SlabHandle handle;
+        while ((handle = SlabPool_alloc(pool, PACKET_SIZE)) == SLAB_INVALID_HANDLE) {}
+
+        slab_fill(SlabPool_get(pool, handle), PACKET_SIZE, k);
+        SharedIO_write_bytes(channel, (uint8_t *)&handle, sizeof(handle));
+        slab_sample_experiment(k + 1, messages / number_of_experiments, mega_bytes, &experimentStart);
+    }
+    slab_channel_finish(channel);
+    PerfCounters_stop(&counters);
+    ResourceUsage_wait(p, &consumer);
+    uint64_t endTime = getCurTime();
+    ResourceUsage_thread(&end);
+    ResourceUsage_sub(&self, &end, &start);
+
+    double throughput = (double)(mega_bytes * number_of_experiments) / ((double)(endTime - startTime) / 1000000.0);
+    printf("Handle throughput: %f MB/s\n", throughput);
+    PerfCounters_print(&counters, "slab pool handle producer", messages, "message");
+    PerfCounters_close(&counters);
+    ResourceUsage_print("slab pool handle producer and consumer", &self, &consumer, mega_bytes * number_of_experiments * 1024 * 1024);
+
+    return throughput;
+}
+
+double* run_benchmark_SlabPool(const char *name, SlabPool *pool, SharedIO *copy_io[2], SharedIO *handle_io[2]) {
+    double *result = (double *)malloc(2 * sizeof(double));
+
+    printf("Starting benchmark for method: %s\n", name);
+
+    result[0] = compute_throughput_SlabPool_copy(copy_io[0], copy_io[1], NUMBER_OF_EXPERIMENTS);
+    Results_record(name, "copy", "throughput", "MB/s", false);
+    result[1] = compute_throughput_SlabPool_handle(pool, handle_io[0], handle_io[1], NUMBER_OF_EXPERIMENTS);
+    Results_record(name, "handle", "throughput", "MB/s", false);
+
+    printf("Message size: %d B\n", PACKET_SIZE);
+    printf("+-------------------+-------------------+\n");
+    printf("|       Path        | Throughput (MB/s) |\n");
+    printf("+-------------------+-------------------+\n");
+    printf("| SharedIO copy     | %17.3lf |\n", result[0]);
+    printf("+-------------------+-------------------+\n");
+    printf("| SlabPool handle   | %17.3lf |\n", result[1]);
+    printf("+-------------------+-------------------+\n");
+
+    return result;
+}
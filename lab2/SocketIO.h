@@ -0,0 +1,308 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "EchoBenchmark.h"
+#include "EchoPeer.h"
+#include "OneWay.h"
+#include "PhaseStats.h"
+#include "Transport.h"
+
+// The socket flavours measured with the same echo driver as the other
+// transports. Every message is its length (int) followed by its bytes, and
+// a length of -1 closes the channel. Seqpacket sockets keep record
+// boundaries and refuse records larger than the send buffer, so there the
+// payload goes out in records of at most SOCKET_SEQPACKET_CHUNK bytes and
+// is read back record by record.
+
+#define SOCKET_UNIX_PATH "lab2.sock"
+#define SOCKET_SEQPACKET_CHUNK (64 * 1024)
+
+typedef enum {
+    SOCKET_PAIR,            // socketpair(AF_UNIX, SOCK_STREAM)
+    SOCKET_UNIX_STREAM,     // AF_UNIX SOCK_STREAM through a listening socket
+    SOCKET_UNIX_SEQPACKET,  // AF_UNIX SOCK_SEQPACKET through a listening socket
+    SOCKET_TCP,             // TCP over 127.0.0.1 with TCP_NODELAY
+} SocketKind;
+
+static const char *SOCKET_KIND_NAMES[] = { "socketpair", "unix_stream", "unix_seqpacket", "tcp_loopback" };
+
+typedef struct {
+    int fd;
+    bool records;           // SOCK_SEQPACKET
+    bool closed;
+} SocketIO;
+
+static bool socket_listen_unix(int type, int *listener, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    snprintf(address->sun_path, sizeof(address->sun_path), "%s", SOCKET_UNIX_PATH);
+    unlink(SOCKET_UNIX_PATH);
+
+    *listener = socket(AF_UNIX, type, 0);
+    return *listener >= 0 && bind(*listener, (struct sockaddr *)address, sizeof(*address)) == 0 &&
+           listen(*listener, 1) == 0;
+}
+
+static bool socket_listen_tcp(int *listener, struct sockaddr_in *address) {
+    socklen_t len = sizeof(*address);
+    int one = 1;
+
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address->sin_port = 0;
+
+    *listener = socket(AF_INET, SOCK_STREAM, 0);
+    return *listener >= 0 && setsockopt(*listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0 &&
+           bind(*listener, (struct sockaddr *)address, sizeof(*address)) == 0 && listen(*listener, 1) == 0 &&
+           getsockname(*listener, (struct sockaddr *)address, &len) == 0;
+}
+
+// Connects two sockets of `kind` to each other; the connect completes
+// against the listen backlog, so both ends are set up by one thread.
+// False (with a message) if the host does not allow it.
+bool SocketIO_open_pair(SocketIO *first, SocketIO *second, SocketKind kind) {
+    int fds[2] = { -1, -1 };
+    int listener = -1;
+    bool ok;
+
+    if (kind == SOCKET_PAIR) {
+        ok = socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+    } else if (kind == SOCKET_TCP) {
+        struct sockaddr_in address;
+        int one = 1;
+        ok = socket_listen_tcp(&listener, &address) && (fds[0] = socket(AF_INET, SOCK_STREAM, 0)) >= 0 &&
+             connect(fds[0], (struct sockaddr *)&address, sizeof(address)) == 0 &&
+             (fds[1] = accept(listener, NULL, NULL)) >= 0;
+        if (ok) {
+            setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            setsockopt(fds[1], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    } else {
+        int type = kind == SOCKET_UNIX_SEQPACKET ? SOCK_SEQPACKET : SOCK_STREAM;
+        struct sockaddr_un address;
+        ok = socket_listen_unix(type, &listener, &address) && (fds[0] = socket(AF_UNIX, type, 0)) >= 0 &&
+             connect(fds[0], (struct sockaddr *)&address, sizeof(address)) == 0 &&
+             (fds[1] = accept(listener, NULL, NULL)) >= 0;
+        unlink(SOCKET_UNIX_PATH);
+    }
+
+    if (listener >= 0) {
+        close(listener);
+    }
+    if (!ok) {
+        perror(SOCKET_KIND_NAMES[kind]);
+        for (int i = 0; i < 2; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+        return false;
+    }
+
+    *first = (SocketIO){ fds[0], kind == SOCKET_UNIX_SEQPACKET, false };
+    *second = (SocketIO){ fds[1], kind == SOCKET_UNIX_SEQPACKET, false };
+    return true;
+}
+
+static bool socket_send_all(int fd, const uint8_t *bytes, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+static bool socket_recv_all(int fd, uint8_t *bytes, size_t len) {
+    while (len > 0) {
+        ssize_t got = recv(fd, bytes, len, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        len -= got;
+    }
+    return true;
+}
+
+// One record on a seqpacket socket: a single send and a single recv of the
+// same size.
+static bool socket_send_record(int fd, const uint8_t *bytes, size_t len) {
+    ssize_t sent;
+    while ((sent = send(fd, bytes, len, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    return sent == (ssize_t)len;
+}
+
+static bool socket_recv_record(int fd, uint8_t *bytes, size_t len) {
+    ssize_t got;
+    while ((got = recv(fd, bytes, len, 0)) < 0 && errno == EINTR) {}
+    return got == (ssize_t)len;
+}
+
+static bool socket_send(SocketIO *socket_io, const uint8_t *bytes, size_t len) {
+    if (!socket_io->records) {
+        return socket_send_all(socket_io->fd, bytes, len);
+    }
+    for (size_t offset = 0; offset < len; offset += SOCKET_SEQPACKET_CHUNK) {
+        size_t chunk = len - offset < SOCKET_SEQPACKET_CHUNK ? len - offset : SOCKET_SEQPACKET_CHUNK;
+        if (!socket_send_record(socket_io->fd, bytes + offset, chunk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool socket_recv(SocketIO *socket_io, uint8_t *bytes, size_t len) {
+    if (!socket_io->records) {
+        return socket_recv_all(socket_io->fd, bytes, len);
+    }
+    for (size_t offset = 0; offset < len; offset += SOCKET_SEQPACKET_CHUNK) {
+        size_t chunk = len - offset < SOCKET_SEQPACKET_CHUNK ? len - offset : SOCKET_SEQPACKET_CHUNK;
+        if (!socket_recv_record(socket_io->fd, bytes + offset, chunk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Receives a payload of `size` bytes and keeps the first `keep` of them;
+// the rest is read and dropped, so the stream stays framed. A seqpacket
+// record read into a shorter buffer has its tail discarded by the kernel.
+static bool socket_recv_payload(SocketIO *socket_io, uint8_t *out_data, int size, int keep) {
+    uint8_t scratch[4096];
+
+    if (!socket_io->records) {
+        bool ok = socket_recv_all(socket_io->fd, out_data, keep);
+        for (int rest = size - keep; ok && rest > 0;) {
+            int chunk = rest < (int)sizeof(scratch) ? rest : (int)sizeof(scratch);
+            ok = socket_recv_all(socket_io->fd, scratch, chunk);
+            rest -= chunk;
+        }
+        return ok;
+    }
+    for (int offset = 0; offset < size; offset += SOCKET_SEQPACKET_CHUNK) {
+        int chunk = size - offset < SOCKET_SEQPACKET_CHUNK ? size - offset : SOCKET_SEQPACKET_CHUNK;
+        int wanted = keep - offset < chunk ? keep - offset : chunk;
+        bool ok = wanted > 0 ? socket_recv_record(socket_io->fd, out_data + offset, wanted)
+                             : socket_recv_record(socket_io->fd, scratch, 1);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SocketIO_close(SocketIO *socket_io) {
+    if (socket_io->closed) {
+        return;
+    }
+    int end = -1;
+    socket_send(socket_io, (const uint8_t *)&end, sizeof(end));
+    socket_io->closed = true;
+}
+
+// Closes this process's descriptor once the channel is no longer used.
+void SocketIO_release(SocketIO *socket_io) {
+    close(socket_io->fd);
+}
+
+void SocketIO_write_bytes(SocketIO *socket_io, const uint8_t *bytes, int len) {
+    if (socket_io->closed) {
+        return;
+    }
+
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_SEND);
+
+    if (!socket_send(socket_io, (const uint8_t *)&len, sizeof(len)) || !socket_send(socket_io, bytes, len)) {
+        socket_io->closed = true;
+        return;
+    }
+    PhaseTimer_mark(&timer, PHASE_SOCKETIO, PHASE_COPY);
+}
+
+int SocketIO_read_bytes(SocketIO *socket_io, uint8_t *out_data, int max_size) {
+    if (socket_io->closed) {
+        return -1;
+    }
+
+    int size;
+    PhaseTimer timer;
+    PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+    if (!socket_recv(socket_io, (uint8_t *)&size, sizeof(size)) || size < 0) {
+        SocketIO_close(socket_io);
+        return -1;
+    }
+    PhaseTimer_mark(&timer, PHASE_SOCKETIO, PHASE_WAIT);
+
+    int keep = size < max_size ? size : max_size;
+    if (!socket_recv_payload(socket_io, out_data, size, keep)) {
+        socket_io->closed = true;
+        return -1;
+    }
+    PhaseTimer_mark(&timer, PHASE_SOCKETIO, PHASE_COPY);
+
+    return keep;
+}
+
+void *echo_SocketIO(void *arg) {
+    SocketIO *io = (SocketIO *)arg;
+    uint8_t *data = (uint8_t *)malloc(message_capacity());
+    int data_size;
+
+    do {
+        data_size = SocketIO_read_bytes(io, data, message_capacity());
+
+        if (data_size > 0) {
+            OneWay_echo(data, data_size);
+            SocketIO_write_bytes(io, data, data_size);
+        }
+    } while (data_size > 0);
+
+    free(data);
+    PhaseStats_dump("echo peer");
+    return NULL;
+}
+
+static void SocketIO_transport_write(void *io, const uint8_t *bytes, int len) {
+    SocketIO_write_bytes((SocketIO *)io, bytes, len);
+}
+
+static int SocketIO_transport_read(void *io, uint8_t *out_data, int max_size) {
+    return SocketIO_read_bytes((SocketIO *)io, out_data, max_size);
+}
+
+static void SocketIO_transport_close(void *io) {
+    SocketIO_close((SocketIO *)io);
+}
+
+Transport SocketIO_transport(const char *name, SocketIO *socket_io) {
+    Transport transport = { name, socket_io, SocketIO_transport_write, SocketIO_transport_read, SocketIO_transport_close };
+    return transport;
+}
+
+double* run_benchmark_SocketIO(const char *name, SocketIO *io_first, SocketIO *io_second, ExecMode mode) {
+    Transport transport = SocketIO_transport(name, io_first);
+    return run_benchmark(&transport, echo_SocketIO, io_second, mode);
+}
@@ -0,0 +1,16 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+
+// One end of a request/response transport, for harnesses that drive every
+// transport the same way. Each transport header provides X_transport(io).
+typedef struct {
+    const char *name;
+    void *io;
+    void (*write)(void *io, const uint8_t *bytes, int len);
+    int (*read)(void *io, uint8_t *out_data, int max_size);
+    void (*close)(void *io);
+} Transport;
+
+#endif
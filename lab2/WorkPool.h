@@ -0,0 +1,380 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Settings.h"
+#include "PhaseStats.h"
+#include "../common/PerfCounters.h"
+#include "../common/Results.h"
+
+// A pool of echo workers behind one shared front queue, modelling a
+// request-processing tier. The parent submits messages into the front
+// queue; each worker process moves a batch of them into its own deque,
+// serves them from the bottom, and when it runs dry steals from the top of
+// another worker's deque. Every served message goes back to the parent over
+// the worker's own completion ring.
+
+#define WORKPOOL_MAX_WORKERS 16
+#define WORKPOOL_RING 256          // front queue and completion ring slots
+#define WORKPOOL_WINDOW 64         // messages the parent keeps in flight, <= WORKPOOL_RING
+#define WORKPOOL_GRAB 8            // messages a worker takes from the front queue at once
+#define WORKPOOL_DEQUE_SLOTS 64    // per worker, >= WORKPOOL_WINDOW
+
+// Mean cost of serving one message. With a skewed load about one message in
+// WORKPOOL_SKEW_EVERY costs WORKPOOL_SKEW_FACTOR times a short one, with
+// the same mean as the uniform load.
+#define WORKPOOL_COST_NS 20000
+#define WORKPOOL_SKEW_EVERY 16
+#define WORKPOOL_SKEW_FACTOR 50
+
+typedef enum {
+    WORKLOAD_UNIFORM,
+    WORKLOAD_SKEWED,
+} WorkLoad;
+
+static const char *WORKLOAD_NAMES[] = { "uniform", "skewed" };
+
+typedef struct {
+    uint64_t sent_ns;
+    uint64_t cost_ns;
+} WorkItem;
+
+typedef struct {
+    uint64_t seq;
+    uint64_t done_ns;
+} WorkCompletion;
+
+// Chase-Lev deque of front queue sequence numbers: the owner pushes and
+// pops at the bottom, thieves take from the top.
+typedef struct {
+    _Alignas(64) _Atomic int64_t top;
+    _Alignas(64) _Atomic int64_t bottom;
+    _Atomic uint64_t items[WORKPOOL_DEQUE_SLOTS];
+} WorkDeque;
+
+// Single-producer ring from one worker back to the parent.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t tail;
+    WorkCompletion entries[WORKPOOL_RING];
+} WorkCompletions;
+
+typedef struct {
+    _Alignas(64) uint64_t served;
+    uint64_t stolen;             // of those, taken from another worker's deque
+    uint64_t grabs;              // batches taken from the front queue
+} WorkerStats;
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t submitted;   // written by the parent
+    _Alignas(64) _Atomic uint64_t claimed;     // advanced by the workers
+    _Alignas(64) _Atomic int closed;
+    _Atomic int ready_workers;
+    int workers;
+    WorkItem front[WORKPOOL_RING];
+    WorkDeque deques[WORKPOOL_MAX_WORKERS];
+    WorkCompletions completions[WORKPOOL_MAX_WORKERS];
+    WorkerStats stats[WORKPOOL_MAX_WORKERS];
+} WorkRegion;
+
+size_t WorkPool_region_size() {
+    return sizeof(WorkRegion);
+}
+
+static bool work_deque_push(WorkDeque *deque, uint64_t seq) {
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+    if (b - t >= WORKPOOL_DEQUE_SLOTS) {
+        return false;
+    }
+    atomic_store_explicit(&deque->items[b % WORKPOOL_DEQUE_SLOTS], seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+static bool work_deque_pop(WorkDeque *deque, uint64_t *seq) {
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return false;
+    }
+    *seq = atomic_load_explicit(&deque->items[b % WORKPOOL_DEQUE_SLOTS], memory_order_relaxed);
+    if (t < b) {
+        return true;
+    }
+
+    // The last item: race the thieves for it.
+    bool won = atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst,
+                                                       memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return won;
+}
+
+static bool work_deque_steal(WorkDeque *deque, uint64_t *seq) {
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return false;
+    }
+    *seq = atomic_load_explicit(&deque->items[t % WORKPOOL_DEQUE_SLOTS], memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst,
+                                                   memory_order_relaxed);
+}
+
+// Moves up to WORKPOOL_GRAB submitted messages into `deque`.
+static int work_grab(WorkRegion *region, WorkDeque *deque) {
+    uint64_t claimed = atomic_load(&region->claimed);
+    uint64_t count;
+
+    do {
+        uint64_t available = atomic_load_explicit(&region->submitted, memory_order_acquire) - claimed;
+        if (available == 0) {
+            return 0;
+        }
+        count = available < WORKPOOL_GRAB ? available : WORKPOOL_GRAB;
+    } while (!atomic_compare_exchange_weak(&region->claimed, &claimed, claimed + count));
+
+    // Pushed in reverse so the owner, popping from the bottom, serves the
+    // batch in submission order.
+    for (uint64_t i = count; i > 0; i--) {
+        while (!work_deque_push(deque, claimed + i - 1)) {
+            wait_relax();
+        }
+    }
+    return (int)count;
+}
+
+// Spins for `cost_ns`, standing in for the work a request needs.
+static void work_serve(uint64_t cost_ns) {
+    uint64_t start = getCurTimeNs();
+    while (getCurTimeNs() - start < cost_ns) {}
+}
+
+static void work_complete(WorkCompletions *ring, uint64_t seq) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == WORKPOOL_RING) {
+        wait_relax();
+    }
+    ring->entries[head % WORKPOOL_RING] = (WorkCompletion){ seq, getCurTimeNs() };
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void work_worker_process(WorkRegion *region, int id) {
+    WorkDeque *own = &region->deques[id];
+    WorkerStats *stats = &region->stats[id];
+    PhaseTimer timer;
+
+    atomic_fetch_add(&region->ready_workers, 1);
+
+    while (true) {
+        uint64_t seq;
+        bool stolen = false;
+        PhaseTimer_start(&timer, PHASE_RECEIVE);
+
+        bool found = work_deque_pop(own, &seq);
+        while (!found) {
+            if (work_grab(region, own) > 0) {
+                stats->grabs++;
+                found = work_deque_pop(own, &seq);
+                continue;
+            }
+            for (int v = 1; v < region->workers && !stolen; v++) {
+                stolen = work_deque_steal(&region->deques[(id + v) % region->workers], &seq);
+            }
+            found = stolen;
+            if (found || atomic_load(&region->closed)) {
+                break;
+            }
+            wait_relax();
+        }
+        if (!found) {
+            break;
+        }
+        PhaseTimer_mark(&timer, PHASE_WORKPOOL, PHASE_WAIT);
+
+        // Service time is not a phase of the transport; only the wait for
+        // work and the completion are timed.
+        work_serve(region->front[seq % WORKPOOL_RING].cost_ns);
+
+        PhaseTimer_start(&timer, PHASE_SEND);
+        work_complete(&region->completions[id], seq);
+        PhaseTimer_mark(&timer, PHASE_WORKPOOL, PHASE_PUBLISH);
+
+        stats->served++;
+        stats->stolen += stolen;
+    }
+
+    if (id == 0) {
+        PhaseStats_dump("work pool worker 0");
+    }
+}
+
+static int work_compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// The same service costs for every run of a load, from a fixed seed.
+static uint64_t work_cost(WorkLoad load, uint64_t *state) {
+    if (load == WORKLOAD_UNIFORM) {
+        return WORKPOOL_COST_NS;
+    }
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    uint64_t short_cost = (uint64_t)WORKPOOL_COST_NS * WORKPOOL_SKEW_EVERY / (WORKPOOL_SKEW_EVERY - 1 + WORKPOOL_SKEW_FACTOR);
+    return *state % WORKPOOL_SKEW_EVERY == 0 ? short_cost * WORKPOOL_SKEW_FACTOR : short_cost;
+}
+
+// The parent keeps WORKPOOL_WINDOW of `number_of_messages` messages in
+// flight across `workers` forked workers. Latency runs from submission to
+// the worker finishing the message, queueing included.
+// result: throughput (msg/s), average, p99 and max latency (s), stolen (%).
+double* compute_pool_WorkPool(uint8_t *ptr, int workers, WorkLoad load, uint64_t number_of_messages) {
+    double *result = (double *)malloc(5 * sizeof(double));
+    WorkRegion *region = (WorkRegion *)ptr;
+    uint64_t *latencies = (uint64_t *)malloc(number_of_messages * sizeof(uint64_t));
+    uint64_t cost_state = 0x9e3779b97f4a7c15ull;
+
+    memset(region, 0, sizeof(*region));
+    region->workers = workers;
+
+    pid_t *children = (pid_t *)malloc(workers * sizeof(pid_t));
+    fflush(stdout);
+    for (int w = 0; w < workers; w++) {
+        children[w] = fork();
+        if (children[w] == 0) {
+            work_worker_process(region, w);
+            exit(0);
+        }
+    }
+
+    while (atomic_load(&region->ready_workers) < workers) {
+        wait_relax();
+    }
+
+    PerfCounters counters;
+    PerfCounters_init(&counters);
+    PerfCounters_start(&counters);
+
+    uint64_t submitted = 0, completed = 0;
+    uint64_t startTime = getCurTimeNs();
+    while (completed < number_of_messages) {
+        bool progress = false;
+
+        while (submitted < number_of_messages && submitted - completed < WORKPOOL_WINDOW) {
+            WorkItem *item = &region->front[submitted % WORKPOOL_RING];
+            item->cost_ns = work_cost(load, &cost_state);
+            item->sent_ns = getCurTimeNs();
+            atomic_store_explicit(&region->submitted, ++submitted, memory_order_release);
+            progress = true;
+        }
+
+        for (int w = 0; w < workers; w++) {
+            WorkCompletions *ring = &region->completions[w];
+            uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+            for (; tail < head; tail++) {
+                WorkCompletion *done = &ring->entries[tail % WORKPOOL_RING];
+                latencies[completed++] = done->done_ns - region->front[done->seq % WORKPOOL_RING].sent_ns;
+            }
+            if (head != atomic_load_explicit(&ring->tail, memory_order_relaxed)) {
+                atomic_store_explicit(&ring->tail, head, memory_order_release);
+                progress = true;
+            }
+        }
+
+        if (!progress) {
+            wait_relax();
+        }
+    }
+    uint64_t endTime = getCurTimeNs();
+    PerfCounters_stop(&counters);
+
+    atomic_store(&region->closed, 1);
+    for (int w = 0; w < workers; w++) {
+        waitpid(children[w], NULL, 0);
+    }
+    PerfCounters_print(&counters, "work pool parent", number_of_messages, "message");
+    PerfCounters_close(&counters);
+
+    uint64_t total = 0, stolen = 0;
+    for (uint64_t i = 0; i < number_of_messages; i++) {
+        total += latencies[i];
+    }
+    for (int w = 0; w < workers; w++) {
+        stolen += region->stats[w].stolen;
+    }
+    qsort(latencies, number_of_messages, sizeof(uint64_t), work_compare_u64);
+
+    result[0] = (double)number_of_messages / ((double)(endTime - startTime) / 1000000000.0);
+    result[1] = (double)total / (double)number_of_messages / 1000000000.0;
+    result[2] = (double)latencies[number_of_messages * 99 / 100] / 1000000000.0;
+    result[3] = (double)latencies[number_of_messages - 1] / 1000000000.0;
+    result[4] = 100.0 * (double)stolen / (double)number_of_messages;
+
+    printf("Workers: %d, Load: %s, Throughput: %f msg/s, Latency: %f s (p99 %f s), Stolen: %f %%\n", workers,
+           WORKLOAD_NAMES[load], result[0], result[1], result[2], result[4]);
+
+    free(children);
+    free(latencies);
+    return result;
+}
+
+// Each configuration runs NUMBER_OF_EXPERIMENTS times with 1000 messages,
+// one sample per run; the table shows the mean of the runs.
+void run_benchmark_WorkPool(const char *name, uint8_t *ptr, const int *worker_counts, int number_of_counts) {
+    printf("Starting benchmark for method: %s\n", name);
+
+    const WorkLoad loads[] = { WORKLOAD_UNIFORM, WORKLOAD_SKEWED };
+    double *results[number_of_counts][2][NUMBER_OF_EXPERIMENTS];
+
+    for (int i = 0; i < number_of_counts; i++) {
+        for (int l = 0; l < 2; l++) {
+            for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+                results[i][l][e] = compute_pool_WorkPool(ptr, worker_counts[i], loads[l], 1000);
+            }
+        }
+    }
+
+    printf("Mean service cost: %d us, window: %d messages, mean of %d experiments\n", WORKPOOL_COST_NS / 1000,
+           WORKPOOL_WINDOW, NUMBER_OF_EXPERIMENTS);
+    printf("+---------+----------+--------------------+--------------+--------------+--------------+------------+\n");
+    printf("| Workers |   Load   | Throughput (msg/s) | Latency (us) |   p99 (us)   |   Max (us)   | Stolen (%%) |\n");
+    printf("+---------+----------+--------------------+--------------+--------------+--------------+------------+\n");
+    for (int i = 0; i < number_of_counts; i++) {
+        for (int l = 0; l < 2; l++) {
+            char variant[32];
+            double mean[5];
+            double *const *runs = results[i][l];
+            snprintf(variant, sizeof(variant), "%s/workers=%d", WORKLOAD_NAMES[loads[l]], worker_counts[i]);
+            mean[0] = Results_record_column(name, variant, "throughput", "msg/s", false, runs, NUMBER_OF_EXPERIMENTS, 0);
+            mean[1] = Results_record_column(name, variant, "latency", "s", true, runs, NUMBER_OF_EXPERIMENTS, 1);
+            mean[2] = Results_record_column(name, variant, "p99_latency", "s", true, runs, NUMBER_OF_EXPERIMENTS, 2);
+            mean[3] = Results_record_column(name, variant, "max_latency", "s", true, runs, NUMBER_OF_EXPERIMENTS, 3);
+            mean[4] = Results_record_column(name, variant, "stolen", "%", false, runs, NUMBER_OF_EXPERIMENTS, 4);
+
+            printf("| %7d | %-8s | %18.1lf | %12.3lf | %12.3lf | %12.3lf | %10.2lf |\n", worker_counts[i],
+                   WORKLOAD_NAMES[loads[l]], mean[0], mean[1] * 1000000.0, mean[2] * 1000000.0,
+                   mean[3] * 1000000.0, mean[4]);
+            for (int e = 0; e < NUMBER_OF_EXPERIMENTS; e++) {
+                free(runs[e]);
+            }
+        }
+        printf("+---------+----------+--------------------+--------------+--------------+--------------+------------+\n");
+    }
+}
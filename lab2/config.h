@@ -1,2 +1,62 @@
-#define PACKET_SIZE (1024 * 512)
-#define NUMBER_OF_EXPERIMENTS 10
\ No newline at end of file
+// Defaults for the run-time settings in Settings.h (--set packet_size=...,
+// --set experiments=...). Messages larger than PACKET_SIZE_MAX do not fit
+// the stack buffers of the throughput benchmarks; messages smaller than
+// PACKET_SIZE_MIN cannot carry the CRC32C of a test pattern (Checksum.h).
+#define DEFAULT_PACKET_SIZE (1024 * 512)
+#define DEFAULT_NUMBER_OF_EXPERIMENTS 10
+#define PACKET_SIZE_MIN 4
+#define PACKET_SIZE_MAX (2 * 1024 * 1024)
+
+// How long WAIT_SLEEP naps between polls of a transport.
+#define WAIT_SLEEP_NS 1000
+
+// 1: test patterns and their CRC32C are generated once up front and checked
+// outside the timed region. 0: fill and compare byte by byte inside it.
+#define MEASURE_ONLY 1
+
+// Time the wait/copy/publish phases of one in every PHASE_SAMPLE_RATE
+// transport operations; the clock reads would otherwise be a visible share
+// of a shared-memory round trip. --events times every operation.
+#define PHASE_SAMPLE_RATE 64
+
+// Open-loop sweep: arrival process (ARRIVAL_CONSTANT or ARRIVAL_POISSON),
+// the p99 bound a rate must meet to count as sustained, how long each rate
+// is offered for, the range of rates ramped through, and how many times the
+// ramp's bracket is bisected (one knee sample each; below 7 per run the
+// Mann-Whitney test of --compare cannot reach RESULTS_ALPHA).
+#define OPENLOOP_ARRIVALS ARRIVAL_POISSON
+#define OPENLOOP_P99_BOUND_US 1000
+#define OPENLOOP_STEP_MS 200
+#define OPENLOOP_START_RATE 1000
+#define OPENLOOP_MIN_RATE 100
+#define OPENLOOP_MAX_RATE 1000000
+#define OPENLOOP_REPETITIONS 8
+
+// Latency runner (../common/Runner.h): warm-up, the relative half-width of
+// the median's 95% confidence interval to stop at, and the time limit.
+#define RUNNER_WARMUP_MS 200
+#define RUNNER_TARGET_ERROR 0.01
+#define RUNNER_MAX_MS 10000
+
+// Calibration (--calibrate): message sizes profiled for each transport,
+// warm-up round trips, and the cap on round trips and on time spent timing
+// latency, then throughput, at each size.
+#define CALIBRATION_SIZES { 64, 1024, 16 * 1024, 256 * 1024, 1024 * 1024 }
+#define CALIBRATION_WARMUP 20
+#define CALIBRATION_ROUND_TRIPS 1000
+#define CALIBRATION_MS 100
+
+// Event tracer (--events): events kept per thread; older ones are
+// overwritten. 16 bytes each, and a merged trace much past a few million
+// events is more than chrome://tracing will load.
+#define EVENT_TRACE_CAPACITY (1u << 18)
+
+// Probe daemon (--daemon): rolling windows behind the quantiles, warm-up
+// round trips per transport and round, dependent loads per working set and
+// round and how many are timed together, and how long a scrape may take to
+// send its request.
+#define DAEMON_WINDOWS 5
+#define DAEMON_WARMUP 5
+#define DAEMON_ACCESSES 100000
+#define DAEMON_CHUNK 1000
+#define DAEMON_SCRAPE_TIMEOUT_MS 1000
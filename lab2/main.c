@@ -1,26 +1,44 @@
 #include "FileIO.h"
 #include "MmapIO.h"
 #include "SharedIO.h"
+#include "CmaIO.h"
+#include "PipeIO.h"
+#include "SocketIO.h"
+#include "Channel.h"
+#include "Calibration.h"
+#include "BroadcastRing.h"
+#include "SeqlockIO.h"
+#include "SlabPool.h"
+#include "ChannelSet.h"
+#include "LaneIO.h"
+#include "WorkPool.h"
+#include "MessageFormats.h"
+#include "Replay.h"
+#include "ProbeDaemon.h"
+#include "../common/Grid.h"
+#include "../common/HostInfo.h"
+#include "../common/Realtime.h"
 
-double* RunExperiment_FileIO(char* filename) {
+double* RunExperiment_FileIO(char* filename, ExecMode mode) {
     FileIO file1, file2;
     FileIO_open(&file1, filename, 1);
     FileIO_open(&file2, filename, 2);
-    return run_benchmark_fileIO("file_io", &file1, &file2);
+    return run_benchmark_fileIO("file_io", &file1, &file2, mode);
 }
 
-double* RunExperiment_MmapIO() {
+double* RunExperiment_MmapIO(ExecMode mode) {
     const char *shm_name = "/my_shared_memory";
-    size_t shm_size = 1024 * 1024;
+    size_t shm_size = sizeof(int) * 2 + message_capacity();
     int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
     ftruncate(shm_fd, shm_size);
     uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    memset(shm_ptr, 0, shm_size);  // a run killed mid-message leaves its segment behind
     
     MmapIO io1, io2;
     MmapIO_init(&io1, shm_ptr, 1);
     MmapIO_init(&io2, shm_ptr, 2);
     
-    double* result = run_benchmark_MmapIO("mmap_io", &io1, &io2);
+    double* result = run_benchmark_MmapIO("mmap_io", &io1, &io2, mode);
     
     munmap(shm_ptr, shm_size);
     shm_unlink(shm_name);
@@ -28,38 +46,676 @@ double* RunExperiment_MmapIO() {
     return result;
 }
 
-double* RunExperiment_SharedIO() {
-    shm_t *ptr = shm_new((PACKET_SIZE + 8) * sizeof(uint8_t));
+double* RunExperiment_SharedIO(ExecMode mode) {
+    shm_t *ptr = shm_new((message_capacity() + 8) * sizeof(uint8_t));
     SharedIO io1, io2;
     SharedIO_init(&io1, ptr, 1);
     SharedIO_init(&io2, ptr, 2);
-    double* result = run_benchmark_SharedIO("shares_io", &io1, &io2);
+    double* result = run_benchmark_SharedIO("shares_io", &io1, &io2, mode);
     shm_del(ptr);
     return result;
 }
 
-void print_table_of_experiments(double *FileIO, double *MmapIO, double *SharedIO, int number_of_experiments) {
+double* RunExperiment_CmaIO(ExecMode mode) {
+    if (!CmaIO_available()) {
+        printf("Skipping cma_io: process_vm_readv is not permitted on this host\n");
+        double *result = (double *)malloc(5 * sizeof(double));
+        result[0] = result[1] = result[2] = result[3] = result[4] = -1;
+        return result;
+    }
+
+    const char *shm_name = "/my_cma_control";
+    size_t shm_size = 4096;
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    memset(shm_ptr, 0, shm_size);  // a run killed mid-message leaves its segment behind
+
+    CmaIO io1, io2;
+    CmaIO_init(&io1, shm_ptr, 1);
+    CmaIO_init(&io2, shm_ptr, 2);
+
+    double* result = run_benchmark_CmaIO("cma_io", &io1, &io2, mode);
+
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    shm_unlink(shm_name);
+
+    return result;
+}
+
+double* RunExperiment_SocketIO(SocketKind kind, ExecMode mode) {
+    SocketIO io1, io2;
+
+    if (!SocketIO_open_pair(&io1, &io2, kind)) {
+        printf("Skipping %s: cannot connect a socket pair on this host\n", SOCKET_KIND_NAMES[kind]);
+        double *result = (double *)malloc(5 * sizeof(double));
+        result[0] = result[1] = result[2] = result[3] = result[4] = -1;
+        return result;
+    }
+
+    double* result = run_benchmark_SocketIO(SOCKET_KIND_NAMES[kind], &io1, &io2, mode);
+
+    SocketIO_release(&io1);
+    SocketIO_release(&io2);
+
+    return result;
+}
+
+void RunExperiment_Broadcast() {
+    const char *shm_name = "/my_broadcast_ring";
+    const int slots = 1024;
+    const int reader_counts[] = { 1, 2, 4, 8 };
+    size_t shm_size = BroadcastRing_region_size(slots);
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+    run_benchmark_Broadcast("broadcast_ring", shm_ptr, slots, reader_counts, sizeof(reader_counts) / sizeof(reader_counts[0]));
+
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    shm_unlink(shm_name);
+}
+
+void RunExperiment_Seqlock() {
+    const char *shm_name = "/my_seqlock";
+    const int readers = 4;
+    const int payload_sizes[] = { 8, 64, 512, 4096 };
+    size_t shm_size = sizeof(SeqlockRegion);
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+    run_benchmark_Seqlock("seqlock", shm_ptr, readers, payload_sizes, sizeof(payload_sizes) / sizeof(payload_sizes[0]));
+
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    shm_unlink(shm_name);
+}
+
+void RunExperiment_SlabPool() {
+    shm_t *pool_shm = shm_new(SlabPool_segment_size());
+    shm_t *copy_shm = shm_new((PACKET_SIZE + 8) * sizeof(uint8_t));
+    shm_t *handle_shm = shm_new(8 + sizeof(SlabHandle));
+
+    uint8_t *pool_ptr = (uint8_t *)shmat(pool_shm->id, NULL, 0);
+    SlabPool pool;
+    SlabPool_format(&pool, pool_ptr);
+
+    SharedIO copy1, copy2, handle1, handle2;
+    SharedIO_init(&copy1, copy_shm, 1);
+    SharedIO_init(&copy2, copy_shm, 2);
+    SharedIO_init(&handle1, handle_shm, 1);
+    SharedIO_init(&handle2, handle_shm, 2);
+
+    SharedIO *copy_io[2] = { &copy1, &copy2 };
+    SharedIO *handle_io[2] = { &handle1, &handle2 };
+    free(run_benchmark_SlabPool("slab_pool", &pool, copy_io, handle_io));
+
+    shmdt(pool_ptr);
+    shmdt(copy1.shm_data);
+    shmdt(copy2.shm_data);
+    shmdt(handle1.shm_data);
+    shmdt(handle2.shm_data);
+    shmctl(pool_shm->id, IPC_RMID, NULL);
+    shmctl(copy_shm->id, IPC_RMID, NULL);
+    shmctl(handle_shm->id, IPC_RMID, NULL);
+    shm_del(pool_shm);
+    shm_del(copy_shm);
+    shm_del(handle_shm);
+}
+
+void RunExperiment_ChannelSet() {
+    const char *shm_name = "/my_channel_set";
+    const int channel_counts[] = { 1, 100, 10000 };
+    size_t shm_size = ChannelSet_region_size(10000);
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+    run_benchmark_ChannelSet("channel_set", shm_ptr, channel_counts, sizeof(channel_counts) / sizeof(channel_counts[0]));
+
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    shm_unlink(shm_name);
+}
+
+void RunExperiment_LaneIO() {
+    const char *shm_name = "/my_lanes";
+    size_t shm_size = LaneIO_region_size(PACKET_SIZE);
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+    run_benchmark_LaneIO("lane_io", shm_ptr);
+
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    shm_unlink(shm_name);
+}
+
+void RunExperiment_MessageFormat() {
+    const char *shm_name = "/my_message_formats";
+    size_t shm_size = sizeof(int) * 2 + FORMAT_SLOT_SIZE;
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+    run_benchmark_MessageFormat("message_format", shm_ptr);
+
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    shm_unlink(shm_name);
+}
+
+void RunExperiment_WorkPool() {
+    const char *shm_name = "/my_work_pool";
+    const int worker_counts[] = { 1, 2, 4, 8 };
+    size_t shm_size = WorkPool_region_size();
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+    run_benchmark_WorkPool("work_pool", shm_ptr, worker_counts, sizeof(worker_counts) / sizeof(worker_counts[0]));
+
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    shm_unlink(shm_name);
+}
+
+double* RunReplay_FileIO(char* filename, const Trace *trace, double speed) {
+    FileIO file1, file2;
+    FileIO_open(&file1, filename, 1);
+    FileIO_open(&file2, filename, 2);
+    Transport transport = FileIO_transport("file_io", &file1);
+    return run_replay(&transport, echo_fileIO, &file2, EXEC_PROCESS, trace, speed);
+}
+
+double* RunReplay_MmapIO(const Trace *trace, double speed) {
+    const char *shm_name = "/my_shared_memory";
+    size_t shm_size = sizeof(int) * 2 + message_capacity();
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    memset(shm_ptr, 0, shm_size);  // a run killed mid-message leaves its segment behind
+
+    MmapIO io1, io2;
+    MmapIO_init(&io1, shm_ptr, 1);
+    MmapIO_init(&io2, shm_ptr, 2);
+
+    Transport transport = MmapIO_transport("mmap_io", &io1);
+    double* result = run_replay(&transport, echo_MmapIO, &io2, EXEC_PROCESS, trace, speed);
+
+    munmap(shm_ptr, shm_size);
+    shm_unlink(shm_name);
+
+    return result;
+}
+
+double* RunReplay_SharedIO(const Trace *trace, double speed) {
+    shm_t *ptr = shm_new((message_capacity() + 8) * sizeof(uint8_t));
+    SharedIO io1, io2;
+    SharedIO_init(&io1, ptr, 1);
+    SharedIO_init(&io2, ptr, 2);
+    Transport transport = SharedIO_transport("shares_io", &io1);
+    double* result = run_replay(&transport, echo_SharedIO, &io2, EXEC_PROCESS, trace, speed);
+    shm_del(ptr);
+    return result;
+}
+
+double* RunReplay_CmaIO(const Trace *trace, double speed) {
+    if (!CmaIO_available()) {
+        printf("Skipping cma_io: process_vm_readv is not permitted on this host\n");
+        double *result = (double *)malloc(4 * sizeof(double));
+        result[0] = result[1] = result[2] = result[3] = -1;
+        return result;
+    }
+
+    const char *shm_name = "/my_cma_control";
+    size_t shm_size = 4096;
+    int shm_fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    ftruncate(shm_fd, shm_size);
+    uint8_t *shm_ptr = (uint8_t *)mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    memset(shm_ptr, 0, shm_size);  // a run killed mid-message leaves its segment behind
+
+    CmaIO io1, io2;
+    CmaIO_init(&io1, shm_ptr, 1);
+    CmaIO_init(&io2, shm_ptr, 2);
+
+    Transport transport = CmaIO_transport("cma_io", &io1);
+    double* result = run_replay(&transport, echo_CmaIO, &io2, EXEC_PROCESS, trace, speed);
+
+    munmap(shm_ptr, shm_size);
+    close(shm_fd);
+    shm_unlink(shm_name);
+
+    return result;
+}
+
+double* RunReplay_SocketIO(SocketKind kind, const Trace *trace, double speed) {
+    SocketIO io1, io2;
+
+    if (!SocketIO_open_pair(&io1, &io2, kind)) {
+        printf("Skipping %s: cannot connect a socket pair on this host\n", SOCKET_KIND_NAMES[kind]);
+        double *result = (double *)malloc(4 * sizeof(double));
+        result[0] = result[1] = result[2] = result[3] = -1;
+        return result;
+    }
+
+    Transport transport = SocketIO_transport(SOCKET_KIND_NAMES[kind], &io1);
+    double* result = run_replay(&transport, echo_SocketIO, &io2, EXEC_PROCESS, trace, speed);
+
+    SocketIO_release(&io1);
+    SocketIO_release(&io2);
+
+    return result;
+}
+
+void print_table_of_replays(const char **names, double **results, int number_of_methods) {
+    printf("+----------+--------------+--------------+--------------+-------------------+\n");
+    printf("| IPC Type | Latency (s)  |   p50 (s)    |   p99 (s)    | Throughput (MB/s) |\n");
+    printf("+----------+--------------+--------------+--------------+-------------------+\n");
+    for (int i = 0; i < number_of_methods; i++) {
+        printf("| %-8s | %12lf | %12lf | %12lf | %17lf |\n", names[i],
+               results[i][0], results[i][2], results[i][3], results[i][1]);
+        printf("+----------+--------------+--------------+--------------+-------------------+\n");
+    }
+}
+
+// lab2 --replay <trace> [speed]: replays a recorded trace against every
+// transport, sockets included, instead of running the synthetic benchmarks.
+int main_replay(const char *path, double speed) {
+    Trace trace;
+    if (!Trace_load(&trace, path)) {
+        return 1;
+    }
+
+    const char *names[] = { "FileIO", "MmapIO", "SharedIO", "CmaIO", "SockPair", "UnixStrm", "UnixSeq", "TCP" };
+    double *results[] = {
+        RunReplay_FileIO("file.txt", &trace, speed),
+        RunReplay_MmapIO(&trace, speed),
+        RunReplay_SharedIO(&trace, speed),
+        RunReplay_CmaIO(&trace, speed),
+        RunReplay_SocketIO(SOCKET_PAIR, &trace, speed),
+        RunReplay_SocketIO(SOCKET_UNIX_STREAM, &trace, speed),
+        RunReplay_SocketIO(SOCKET_UNIX_SEQPACKET, &trace, speed),
+        RunReplay_SocketIO(SOCKET_TCP, &trace, speed),
+    };
+    int number_of_methods = sizeof(names) / sizeof(names[0]);
+
+    printf("Trace: %s, %zu records, speed %.2fx\n", path, trace.count, speed);
+    print_table_of_replays(names, results, number_of_methods);
+
+    for (int i = 0; i < number_of_methods; i++) {
+        free(results[i]);
+    }
+    Trace_free(&trace);
+    return 0;
+}
+
+void print_table_of_experiments(const char **names, double **process_results, double **thread_results, int number_of_methods) {
     printf("Number of experiments: %d\n", NUMBER_OF_EXPERIMENTS);
-    printf("+----------+-------------+-------------------+-----------------+\n");
-    printf("| IPC Type | Latency (s) | Throughput (MB/s) | Capacity (MB/s) |\n");
-    printf("+----------+-------------+-------------------+-----------------+\n");
-    printf("|  %s  |  %lf   |    %lf      |   %lf     |\n", "FileIO", FileIO[0], FileIO[1], FileIO[2]);
-    printf("+----------+-------------+-------------------+-----------------+\n");
-    printf("|  %s  |  %lf   |    %lf     |   %lf    |\n", "MmapIO", MmapIO[0], MmapIO[1], MmapIO[2]);
-    printf("+----------+-------------+-------------------+-----------------+\n");
-    printf("| %s |  %lf   |    %lf     |   %lf    |\n", "SharedIO", SharedIO[0], SharedIO[1], SharedIO[2]);
-    printf("+----------+-------------+-------------------+-----------------+\n");
-}
-
-int main() {
-    double *FileIO = (double *)malloc(sizeof(double));
-    double *MmapIO = (double *)malloc(sizeof(double));
-    double *SharedIO = (double *)malloc(sizeof(double));
-    FileIO = RunExperiment_FileIO("file.txt");
-    MmapIO = RunExperiment_MmapIO();
-    SharedIO = RunExperiment_SharedIO();
-
-    print_table_of_experiments(FileIO, MmapIO, SharedIO, 1);
+    printf("+----------+---------------------------+---------------------------+---------------------------+---------------------------+---------------------------+\n");
+    printf("|          |        Latency (s)        |     Throughput (MB/s)     |      Capacity (MB/s)      |   CPU-seconds per GB      |      Knee (msg/s)         |\n");
+    printf("| IPC Type |   process   |   thread    |   process   |   thread    |   process   |   thread    |   process   |   thread    |   process   |   thread    |\n");
+    printf("+----------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+\n");
+    for (int i = 0; i < number_of_methods; i++) {
+        printf("| %-8s | %11lf | %11lf | %11lf | %11lf | %11lf | %11lf | %11lf | %11lf | %11.0lf | %11.0lf |\n", names[i],
+               process_results[i][0], thread_results[i][0],
+               process_results[i][1], thread_results[i][1],
+               process_results[i][2], thread_results[i][2],
+               process_results[i][3], thread_results[i][3],
+               process_results[i][4], thread_results[i][4]);
+        printf("+----------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+\n");
+    }
+}
+
+// The settings a result file records alongside each run.
+const char *config_json(bool fifo) {
+    static char json[256];
+    snprintf(json, sizeof(json),
+             "{\"packet_size\":%d,\"number_of_experiments\":%d,\"measure_only\":%d,\"openloop_arrivals\":\"%s\",\"openloop_p99_bound_us\":%d,\"sched\":\"%s\"}",
+             PACKET_SIZE, NUMBER_OF_EXPERIMENTS, MEASURE_ONLY,
+             OPENLOOP_ARRIVALS == ARRIVAL_POISSON ? "poisson" : "constant", OPENLOOP_P99_BOUND_US, fifo ? "fifo" : "other");
+    return json;
+}
+
+// The sweep's parameters and defaults; the last one varies fastest.
+void define_grid(Grid *grid) {
+    char packet_size[16], experiments[16];
+    snprintf(packet_size, sizeof(packet_size), "%d", DEFAULT_PACKET_SIZE);
+    snprintf(experiments, sizeof(experiments), "%d", DEFAULT_NUMBER_OF_EXPERIMENTS);
+
+    Grid_define(grid, "transport", "file_io,mmap_io,shares_io,cma_io,socketpair,unix_stream,unix_seqpacket,tcp_loopback");
+    Grid_define(grid, "mode", "process,thread");
+    Grid_define(grid, "packet_size", packet_size);
+    Grid_define(grid, "experiments", experiments);
+    Grid_define(grid, "wait", "spin");
+    Grid_define(grid, "placement", "any");
+}
+
+// Loads the current point into `settings`; false (with a message) if one of
+// its values is invalid.
+bool apply_point(const Grid *grid, ExecMode *mode) {
+    const char *transport = Grid_get(grid, "transport");
+    const char *transports[] = { "file_io", "mmap_io", "shares_io", "cma_io" };
+    long packet_size = Grid_get_long(grid, "packet_size");
+    long experiments = Grid_get_long(grid, "experiments");
+    int known = 0;
+
+    for (int i = 0; i < 4; i++) {
+        known |= strcmp(transport, transports[i]) == 0;
+        known |= strcmp(transport, SOCKET_KIND_NAMES[i]) == 0;
+    }
+    if (!known) {
+        fprintf(stderr, "Unknown transport '%s' (file_io, mmap_io, shares_io, cma_io, socketpair, unix_stream, "
+                "unix_seqpacket, tcp_loopback)\n", transport);
+        return false;
+    }
+    if (strcmp(Grid_get(grid, "mode"), "process") != 0 && strcmp(Grid_get(grid, "mode"), "thread") != 0) {
+        fprintf(stderr, "Unknown mode '%s' (process, thread)\n", Grid_get(grid, "mode"));
+        return false;
+    }
+    if (packet_size < PACKET_SIZE_MIN || packet_size > PACKET_SIZE_MAX || experiments < 1) {
+        fprintf(stderr, "packet_size must be %d..%d and experiments at least 1\n", PACKET_SIZE_MIN, PACKET_SIZE_MAX);
+        return false;
+    }
+    if (!WaitStrategy_parse(Grid_get(grid, "wait"), &settings.wait)) {
+        fprintf(stderr, "Unknown wait strategy '%s' (spin, yield, sleep)\n", Grid_get(grid, "wait"));
+        return false;
+    }
+    if (!Placement_parse(Grid_get(grid, "placement"), &settings.placement)) {
+        fprintf(stderr, "Unknown placement '%s' (any, same, split)\n", Grid_get(grid, "placement"));
+        return false;
+    }
+
+    *mode = strcmp(Grid_get(grid, "mode"), "thread") == 0 ? EXEC_THREAD : EXEC_PROCESS;
+    settings.packet_size = (int)packet_size;
+    settings.number_of_experiments = (int)experiments;
+    return true;
+}
+
+double *run_point(const char *transport, ExecMode mode) {
+    if (strcmp(transport, "file_io") == 0) {
+        return RunExperiment_FileIO("file.txt", mode);
+    } else if (strcmp(transport, "mmap_io") == 0) {
+        return RunExperiment_MmapIO(mode);
+    } else if (strcmp(transport, "shares_io") == 0) {
+        return RunExperiment_SharedIO(mode);
+    } else if (strcmp(transport, "cma_io") == 0) {
+        return RunExperiment_CmaIO(mode);
+    }
+    for (int kind = 0; kind < 4; kind++) {
+        if (strcmp(transport, SOCKET_KIND_NAMES[kind]) == 0) {
+            return RunExperiment_SocketIO((SocketKind)kind, mode);
+        }
+    }
+    return NULL;
+}
+
+void print_table_of_sweep(char (*points)[GRID_MAX_VALUES * GRID_VALUE_SIZE], double **results, size_t count) {
+    printf("+----------------------------------------------------------------------------------------------+-------------+-------------+-------------+-------------+-------------+\n");
+    printf("| Point                                                                                        | Latency (s) | Thr. (MB/s) | Cap. (MB/s) |  CPU-s/GB   | Knee (msg/s)|\n");
+    printf("+----------------------------------------------------------------------------------------------+-------------+-------------+-------------+-------------+-------------+\n");
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] == NULL) {
+            printf("| %-92s | %11s | %11s | %11s | %11s | %11s |\n", points[i], "-", "-", "-", "-", "-");
+        } else {
+            printf("| %-92s | %11lf | %11lf | %11lf | %11lf | %11.0lf |\n", points[i],
+                   results[i][0], results[i][1], results[i][2], results[i][3], results[i][4]);
+        }
+    }
+    printf("+----------------------------------------------------------------------------------------------+-------------+-------------+-------------+-------------+-------------+\n");
+}
+
+// Runs every point of the grid in turn. Each point's results are printed
+// and written to the results file as soon as it finishes, labeled with the
+// point, so an interrupted sweep keeps what it measured.
+int main_sweep(Grid *grid, bool fifo) {
+    size_t points = Grid_points(grid);
+    char (*names)[GRID_MAX_VALUES * GRID_VALUE_SIZE] = calloc(points, sizeof(*names));
+    double **results = (double **)calloc(points, sizeof(double *));
+    ExecMode mode;
+
+    // Check every point before spending time on the first.
+    while (Grid_next(grid)) {
+        if (!apply_point(grid, &mode)) {
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; Grid_next(grid); i++) {
+        char label[GRID_MAX_VALUES * GRID_VALUE_SIZE];
+        apply_point(grid, &mode);
+        Grid_describe(grid, NULL, names[i], sizeof(names[i]));
+        Grid_describe(grid, "transport,mode", label, sizeof(label));
+
+        printf("\n=== Sweep point %zu/%zu: %s ===\n", i + 1, points, names[i]);
+        // FIFO threads of equal priority never preempt each other, so two
+        // spinners pinned to one CPU would never make progress.
+        if (fifo && settings.placement == PLACEMENT_SAME && settings.wait == WAIT_SPIN) {
+            printf("Skipped: spinning under SCHED_FIFO on one CPU would livelock\n");
+            continue;
+        }
+
+        Results_set_point(label);
+        results[i] = run_point(Grid_get(grid, "transport"), mode);
+        printf("Point %zu/%zu: latency %lf s, throughput %lf MB/s, capacity %lf MB/s, %lf CPU-s/GB, knee %.0lf msg/s\n",
+               i + 1, points, results[i][0], results[i][1], results[i][2], results[i][3], results[i][4]);
+        fflush(stdout);
+    }
+    Results_set_point("");
+
+    print_table_of_sweep(names, results, points);
+    for (size_t i = 0; i < points; i++) {
+        free(results[i]);
+    }
+    free(results);
+    free(names);
+    return 0;
+}
+
+// lab2 --calibrate <profile>: profiles every transport on this host.
+int main_calibrate(const char *path) {
+    Profile profile;
+    Profile_calibrate(&profile);
+    if (!Profile_save(&profile, path)) {
+        return 1;
+    }
+    printf("Profile: %s, %d entries\n", path, profile.count);
+    return 0;
+}
+
+// lab2 --profile <profile> <size> [latency budget us]: opens the channel
+// the profile picks for `size` and checks its latency against the estimate.
+int main_profile(const char *path, const char *size_text, double budget_us) {
+    Profile profile;
+    Channel channel;
+    EchoPeer peer;
+    long size;
+
+    if (!Grid_parse_long(size_text, &size) || size < PACKET_SIZE_MIN || size > PACKET_SIZE_MAX) {
+        fprintf(stderr, "Bad message size: %s\n", size_text);
+        return 1;
+    }
+    if (!Profile_load(&profile, path)) {
+        return 1;
+    }
+    if (!Profile_matches_host(&profile)) {
+        printf("Warning: %s was calibrated on %s; run --calibrate again on this host\n", path, profile.host);
+    }
+
+    settings.packet_size = size;
+    if (!Channel_open(&channel, &profile, size, budget_us / 1000000.0)) {
+        fprintf(stderr, "No transport in %s can be opened\n", path);
+        return 1;
+    }
+
+    double latency, throughput;
+    ProfileEntry measured;
+    Profile_estimate(&profile, channel.kind->name, size, &latency, &throughput);
+    EchoPeer_start(&peer, EXEC_PROCESS, channel.echo, channel.peer_io);
+    calibrate_channel(&channel, size, &measured);
+    channel.transport.close(channel.transport.io);
+    EchoPeer_join(&peer);
+    Channel_close(&channel);
+
+    printf("Chosen for %ld B messages (latency budget %.1f us): %s\n", size, budget_us, measured.transport);
+    printf("Latency: %.3f us estimated, %.3f us measured; throughput: %.1f MB/s estimated, %.1f MB/s measured\n",
+           latency * 1000000.0, measured.latency * 1000000.0, throughput, measured.throughput);
+    return 0;
+}
+
+// lab2 [--results <file.jsonl|file.csv>] [--fifo] [--replay <trace> [speed]]
+// lab2 [--results <file>] [--fifo] [--set name=v1,v2,...]... [--config <file>]
+// lab2 --calibrate <profile>
+// lab2 --profile <profile> <size> [latency budget us]
+// lab2 --compare <baseline> <candidate>
+// lab2 --merge-events <trace.json> <file.evt>...
+// lab2 --daemon <config>
+//
+// --events <prefix> (before any of the above) times every transport
+// operation, not one in PHASE_SAMPLE_RATE, and records its events; each
+// process, forked echo peers included, writes <prefix>.<pid>.evt at exit,
+// and --merge-events combines them into one Chrome/Perfetto trace.
+//
+// --fifo runs the request/response benchmarks under SCHED_FIFO; the fan-out
+// benchmarks start more spinning readers than there may be CPUs and always
+// run under the default policy.
+//
+// --set and --config run a sweep over the request/response transports
+// instead of the full suite: every combination of transport, mode
+// (process/thread), packet_size, experiments, wait (spin/yield/sleep) and
+// placement (any/same/split), e.g.
+//   lab2 --set transport=mmap_io --set packet_size=4k..1m*4 --set wait=spin,yield
+// A config file holds the same assignments, one "name = values" per line.
+//
+// --calibrate times every transport (pipes included) at a few message sizes
+// and writes a profile; --profile shows which transport Channel_open picks
+// from it: the highest throughput within the latency budget, or the lowest
+// latency without one.
+//
+// --daemon keeps probing the transports and working sets named in the
+// config on a schedule within a CPU budget and serves the results as
+// Prometheus metrics (see ProbeDaemon.h).
+int main(int argc, char *argv[]) {
+    const char *results_path = NULL;
+    const char *events_prefix = NULL;
+    bool fifo = false;
+    Grid grid;
+
+    if (argc >= 4 && strcmp(argv[1], "--compare") == 0) {
+        return Results_compare(argv[2], argv[3]) != 0;
+    }
+    if (argc >= 4 && strcmp(argv[1], "--merge-events") == 0) {
+        return !EventTrace_merge(argv[2], argv + 3, argc - 3);
+    }
+    Grid_init(&grid);
+    define_grid(&grid);
+    if (!Grid_parse_args(&grid, &argc, argv)) {
+        return 1;
+    }
+    for (;;) {
+        if (argc >= 3 && strcmp(argv[1], "--results") == 0) {
+            results_path = argv[2];
+            argc -= 2;
+            argv += 2;
+        } else if (argc >= 2 && strcmp(argv[1], "--fifo") == 0) {
+            fifo = true;
+            argc -= 1;
+            argv += 1;
+        } else if (argc >= 3 && strcmp(argv[1], "--events") == 0) {
+            events_prefix = argv[2];
+            argc -= 2;
+            argv += 2;
+        } else {
+            break;
+        }
+    }
+
+    HostInfo host;
+    HostInfo_collect(&host);
+    HostInfo_print(&host);
+    HostInfo_warn(&host);
+
+    fifo = fifo && Realtime_enable(REALTIME_PRIORITY);
+    if (results_path != NULL && !Results_open(results_path, "lab2", config_json(fifo))) {
+        return 1;
+    }
+    if (events_prefix != NULL) {
+        if (!EventTrace_open(events_prefix, "lab2", PHASE_TRANSPORT_NAMES, PHASE_TRANSPORTS)) {
+            return 1;
+        }
+        PhaseStats_sample_all();
+    }
+    if (argc >= 3 && strcmp(argv[1], "--replay") == 0) {
+        int status = main_replay(argv[2], argc >= 4 ? atof(argv[3]) : 1.0);
+        Results_close();
+        return status;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--calibrate") == 0) {
+        int status = main_calibrate(argv[2]);
+        Results_close();
+        return status;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--daemon") == 0) {
+        int status = ProbeDaemon_run(argv[2]);
+        Results_close();
+        return status;
+    }
+    if (argc >= 4 && strcmp(argv[1], "--profile") == 0) {
+        int status = main_profile(argv[2], argv[3], argc >= 5 ? atof(argv[4]) : 0);
+        Results_close();
+        return status;
+    }
+    if (Grid_customized(&grid)) {
+        int status = main_sweep(&grid, fifo);
+        Results_close();
+        return status;
+    }
+
+    const char *names[] = { "FileIO", "MmapIO", "SharedIO", "CmaIO", "SockPair", "UnixStrm", "UnixSeq", "TCP" };
+    double *process_results[] = {
+        RunExperiment_FileIO("file.txt", EXEC_PROCESS),
+        RunExperiment_MmapIO(EXEC_PROCESS),
+        RunExperiment_SharedIO(EXEC_PROCESS),
+        RunExperiment_CmaIO(EXEC_PROCESS),
+        RunExperiment_SocketIO(SOCKET_PAIR, EXEC_PROCESS),
+        RunExperiment_SocketIO(SOCKET_UNIX_STREAM, EXEC_PROCESS),
+        RunExperiment_SocketIO(SOCKET_UNIX_SEQPACKET, EXEC_PROCESS),
+        RunExperiment_SocketIO(SOCKET_TCP, EXEC_PROCESS),
+    };
+    double *thread_results[] = {
+        RunExperiment_FileIO("file.txt", EXEC_THREAD),
+        RunExperiment_MmapIO(EXEC_THREAD),
+        RunExperiment_SharedIO(EXEC_THREAD),
+        RunExperiment_CmaIO(EXEC_THREAD),
+        RunExperiment_SocketIO(SOCKET_PAIR, EXEC_THREAD),
+        RunExperiment_SocketIO(SOCKET_UNIX_STREAM, EXEC_THREAD),
+        RunExperiment_SocketIO(SOCKET_UNIX_SEQPACKET, EXEC_THREAD),
+        RunExperiment_SocketIO(SOCKET_TCP, EXEC_THREAD),
+    };
+    int number_of_methods = sizeof(names) / sizeof(names[0]);
+
+    print_table_of_experiments(names, process_results, thread_results, number_of_methods);
+
+    for (int i = 0; i < number_of_methods; i++) {
+        free(process_results[i]);
+        free(thread_results[i]);
+    }
+
+    if (fifo) {
+        Realtime_disable();
+    }
+    RunExperiment_Broadcast();
+    RunExperiment_Seqlock();
+    RunExperiment_SlabPool();
+    RunExperiment_ChannelSet();
+    RunExperiment_LaneIO();
+    RunExperiment_WorkPool();
+    RunExperiment_MessageFormat();
+    Results_close();
 
     return 0;
 }
@@ -1,21 +1,30 @@
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
 #include <stdatomic.h>
+#include <string.h>
+#include "../common/Grid.h"
+#include "../common/HostInfo.h"
+#include "../common/PerfCounters.h"
+#include "../common/Realtime.h"
+#include "../common/Results.h"
+#include "../common/Runner.h"
 
-const int64_t SIZES[3] = { 256 * 1024, 1024 * 1024, 64 * 1024 * 1024};
+// Array sizes swept by default; --set size=... replaces them.
+#define DEFAULT_SIZES "256k,1m,64m"
 
-static uint64_t getCurTime() {
+static uint64_t getCurTimeNs() {
     struct timespec tms;
-    if (clock_gettime(CLOCK_REALTIME, &tms)) {
+    if (clock_gettime(CLOCK_MONOTONIC, &tms)) {
         return -1;
     }
-    return tms.tv_sec * 1000000 + tms.tv_nsec / 1000;
+    return tms.tv_sec * 1000000000ull + tms.tv_nsec;
 }
 
 // Передбачаємо частину функції RunBenchmark
-float RunBenchmark_AtomicMemory(const int64_t SIZE) {
+double RunBenchmark_AtomicMemory(const int64_t SIZE, PerfCounters *counters) {
     atomic_int* atomic_array = malloc(sizeof(atomic_int) * SIZE);
 
     // Ініціалізація
@@ -23,20 +32,21 @@ float RunBenchmark_AtomicMemory(const int64_t SIZE) {
         atomic_init(&atomic_array[i], 0);
     }
 
-    uint64_t startTime = getCurTime();
+    PerfCounters_start(counters);
+    uint64_t startTime = getCurTimeNs();
     for (int64_t i = 0; i < SIZE; i++) {
         atomic_fetch_add(&atomic_array[i], 1);
     }
-    uint64_t finishTime = getCurTime();
+    uint64_t finishTime = getCurTimeNs();
+    PerfCounters_stop(counters);
 
-    float time_atomic_memory = (finishTime - startTime) / 1000000.0;
-    printf("time_atomic_memory: %f \n", time_atomic_memory);
+    double time_atomic_memory = (finishTime - startTime) / 1000000000.0;
     free(atomic_array);
     return time_atomic_memory;
 }
 
 // Частина функції RunBenchmark
-float RunBenchmark_CacheDelays(const int64_t SIZE) {
+double RunBenchmark_CacheDelays(const int64_t SIZE, PerfCounters *counters) {
     volatile int* volatile_array = malloc(sizeof(volatile int) * SIZE);
 
     // Ініціалізація
@@ -44,19 +54,20 @@ float RunBenchmark_CacheDelays(const int64_t SIZE) {
         volatile_array[i] = 0;
     }
 
-    uint64_t startTime = getCurTime();
+    PerfCounters_start(counters);
+    uint64_t startTime = getCurTimeNs();
     for (int64_t i = 0; i < SIZE; ++i) {
         volatile_array[i]++;
     }
-    uint64_t finishTime = getCurTime();
+    uint64_t finishTime = getCurTimeNs();
+    PerfCounters_stop(counters);
 
-    float time_cache_delays = (finishTime - startTime) / 1000000.0;
-    printf("time_cache_delays: %f \n", time_cache_delays);
+    double time_cache_delays = (finishTime - startTime) / 1000000000.0;
     free((void*)volatile_array);
     return time_cache_delays;
 }
 
-float* RunBenchmark_SequentialAndRandom(const int64_t SIZE, int number_of_experiment)
+double* RunBenchmark_SequentialAndRandom(const int64_t SIZE, PerfCounters *sequential_counters, PerfCounters *random_counters)
 {
     unsigned char** sequential_pointers = (unsigned char**)malloc(SIZE * sizeof(unsigned char*));
     unsigned char** random_pointers = (unsigned char**)malloc(SIZE * sizeof(unsigned char*));
@@ -67,8 +78,6 @@ float* RunBenchmark_SequentialAndRandom(const int64_t SIZE, int number_of_experi
         return 0;
     }
 
-    //printf("Number of experiment: %d \n", number_of_experiment);
-
     for(int64_t i = 0; i < SIZE; i++)
     {
         static_array[i] = i%255;
@@ -82,22 +91,24 @@ float* RunBenchmark_SequentialAndRandom(const int64_t SIZE, int number_of_experi
         random_pointers[i] = val;
     }
 
-    uint64_t startTime = getCurTime();
+    PerfCounters_start(sequential_counters);
+    uint64_t startTime = getCurTimeNs();
     for (int i = 0; i < SIZE; ++i) {
         (*sequential_pointers[i])++;
     }
-    uint64_t finishTime = getCurTime();
-    double time_sequential_pointers = (finishTime - startTime) / 1000000.0;
-    //printf("time_sequential_pointers: %f \n", time_sequential_pointers);
+    uint64_t finishTime = getCurTimeNs();
+    PerfCounters_stop(sequential_counters);
+    double time_sequential_pointers = (finishTime - startTime) / 1000000000.0;
 
-    startTime = getCurTime();
+    PerfCounters_start(random_counters);
+    startTime = getCurTimeNs();
     for(int64_t i = 0; i < SIZE; i++)
     {
         (*random_pointers[i])++;
     }
-    finishTime = getCurTime();
-    double time_random_pointers = (finishTime - startTime) / 1000000.0;
-    //printf("time_random_pointers: %f \n", time_random_pointers);
+    finishTime = getCurTimeNs();
+    PerfCounters_stop(random_counters);
+    double time_random_pointers = (finishTime - startTime) / 1000000000.0;
 
     for(int64_t i = 0; i < SIZE; i++)
         free(random_pointers[i]);
@@ -105,48 +116,166 @@ float* RunBenchmark_SequentialAndRandom(const int64_t SIZE, int number_of_experi
     free(random_pointers);
     free(static_array);
 
-    float *time_results = (float *) malloc(3);
+    double *time_results = (double *) malloc(2 * sizeof(double));
     time_results[0] = time_sequential_pointers;
     time_results[1] = time_random_pointers;
     return time_results;
 }
 
 
-void print_table_of_experiments(double cache_delays_result_time,double atomic_memory_result_time, double sequential_pointers_result_time, double random_pointers_result_time, int64_t array_size, int number_of_experiments) {
-    printf("Number of experiments: %d\n", number_of_experiments);
-    printf("+---------------+--------------+------------+\n");
-    printf("|     Mode      |   Time (s)   | Array Size |\n");
-    printf("+---------------+--------------+------------+\n");
-    printf("|  Cache Delay  |   %lf   |  %lld   |\n", cache_delays_result_time, array_size);
-    printf("+---------------+--------------+------------+\n");
-    printf("|     Atomic    |   %lf   |  %lld   |\n", atomic_memory_result_time, array_size);
-    printf("+---------------+--------------+------------+\n");
-    printf("|  Sequential   |   %lf   |  %lld   |\n", sequential_pointers_result_time, array_size);
-    printf("+---------------+--------------+------------+\n");
-    printf("|    Random     |   %lf   |  %lld   |\n", random_pointers_result_time, array_size);
-    printf("+---------------+--------------+------------+\n");
+void print_table_of_experiments(const char **names, Runner *runners, int number_of_modes, int64_t array_size) {
+    printf("Array size: %lld\n", (long long)array_size);
+    printf("+---------------+--------------+-----------------------------+--------+--------+\n");
+    printf("|     Mode      |  Median (s)  |        95%% CI (s)           |  Runs  | Noisy  |\n");
+    printf("+---------------+--------------+-----------------------------+--------+--------+\n");
+    for (int m = 0; m < number_of_modes; m++) {
+        RunnerResult *result = Runner_result(&runners[m]);
+        printf("| %-13s | %12.6lf | [%12.6lf, %12.6lf] | %6zu | %-6s |\n", names[m],
+               result->median / 1000000000.0, result->ci_low / 1000000000.0, result->ci_high / 1000000000.0,
+               result->samples, result->noise ? "yes" : "no");
+        printf("+---------------+--------------+-----------------------------+--------+--------+\n");
+    }
 }
 
+// lab3 [--results <file.jsonl|file.csv>] [--fifo] [--set name=v1,v2,...]... [--config <file>]
+// lab3 --compare <baseline> <candidate>
+//
+// Each mode runs until the median's 95% confidence interval is within
+// RUNNER_TARGET_ERROR (see ../common/Runner.h), after a warm-up.
+//
+// The array sizes and the CPU to pin to form a grid (../common/Grid.h) run
+// in one go, e.g. --set size=4k..256m*4 --set cpu=0,3; a config file holds
+// the same assignments, one "name = values" per line.
 int main(int argc, char* argv[]) {
-    int number_of_experiments = 10;
-    for (int i = 0; i < sizeof(SIZES)/sizeof(SIZES[0]); ++i)
+    const char *names[4] = { "Cache Delay", "Atomic", "Sequential", "Random" };
+    const char *modes[4] = { "cache_delay", "atomic", "sequential", "random" };
+    int number_of_modes = 4;
+    const char *results_path = NULL;
+    bool fifo = false;
+
+    if (argc >= 4 && strcmp(argv[1], "--compare") == 0) {
+        return Results_compare(argv[2], argv[3]) != 0;
+    }
+    Grid grid;
+    Grid_init(&grid);
+    Grid_define(&grid, "size", DEFAULT_SIZES);
+    Grid_define(&grid, "cpu", "any");
+    if (!Grid_parse_args(&grid, &argc, argv)) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--results") == 0 && i + 1 < argc) {
+            results_path = argv[++i];
+        } else if (strcmp(argv[i], "--fifo") == 0) {
+            fifo = true;
+        }
+    }
+
+    HostInfo host;
+    HostInfo_collect(&host);
+    HostInfo_print(&host);
+    HostInfo_warn(&host);
+    fifo = fifo && Realtime_enable(REALTIME_PRIORITY);
+
+    char config[160];
+    snprintf(config, sizeof(config), "{\"warmup_ms\":%d,\"target_error\":%g,\"max_ms\":%d,\"sched\":\"%s\"}",
+             RUNNER_WARMUP_MS, RUNNER_TARGET_ERROR, RUNNER_MAX_MS, fifo ? "fifo" : "other");
+    if (results_path != NULL && !Results_open(results_path, "lab3", config)) {
+        return 1;
+    }
+
+    // Check every point before spending time on the first.
+    cpu_set_t all_cpus;
+    sched_getaffinity(0, sizeof(all_cpus), &all_cpus);
+    while (Grid_next(&grid)) {
+        long size, cpu;
+        const char *cpu_name = Grid_get(&grid, "cpu");
+        if (!Grid_parse_long(Grid_get(&grid, "size"), &size) || size < 1) {
+            fprintf(stderr, "Bad size '%s'\n", Grid_get(&grid, "size"));
+            return 1;
+        }
+        if (strcmp(cpu_name, "any") != 0 && (!Grid_parse_long(cpu_name, &cpu) || cpu < 0 ||
+                                             cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &all_cpus))) {
+            fprintf(stderr, "CPU '%s' is not available (use a CPU number or 'any')\n", cpu_name);
+            return 1;
+        }
+    }
+
+    // Modes that are done keep running while the others finish; their
+    // counters go to `finished` so they only cover measured runs.
+    PerfCounters counters[4], finished;
+    Runner runners[4];
+    for (int m = 0; m < number_of_modes; m++) {
+        PerfCounters_init(&counters[m]);
+    }
+    PerfCounters_init(&finished);
+
+    while (Grid_next(&grid))
     {
-        float cache_delays_result_time = 0.0,
-              atomic_memory_result_time = 0.0,
-              sequential_pointers_result_time = 0.0,
-              random_pointers_result_time = 0.0;
-        for (int number_of_experiment = 1; number_of_experiment <= number_of_experiments; ++number_of_experiment) {
-            cache_delays_result_time += RunBenchmark_CacheDelays(SIZES[i]);
-            atomic_memory_result_time += RunBenchmark_AtomicMemory(SIZES[i]);
-            float *time_results = RunBenchmark_SequentialAndRandom(SIZES[i], number_of_experiment);
-            sequential_pointers_result_time += time_results[0];
-            random_pointers_result_time     += time_results[1];
+        const int64_t size = Grid_get_long(&grid, "size");
+        const char *cpu_name = Grid_get(&grid, "cpu");
+        cpu_set_t cpus = all_cpus;
+        char point[32] = "";
+
+        if (strcmp(cpu_name, "any") != 0) {
+            CPU_ZERO(&cpus);
+            CPU_SET(Grid_get_long(&grid, "cpu"), &cpus);
+            snprintf(point, sizeof(point), "cpu=%s", cpu_name);
+            printf("Pinned to CPU %s\n", cpu_name);
+        }
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+        Results_set_point(point);
+
+        for (int m = 0; m < number_of_modes; m++) {
+            Runner_init(&runners[m], names[m], NULL);
+            PerfCounters_reset(&counters[m]);
+        }
+
+        while (!Runner_done(&runners[0]) || !Runner_done(&runners[1]) || !Runner_done(&runners[2]) || !Runner_done(&runners[3])) {
+            PerfCounters *active[4];
+            double times[4];
+            for (int m = 0; m < number_of_modes; m++) {
+                active[m] = Runner_done(&runners[m]) ? &finished : &counters[m];
+            }
+
+            times[0] = RunBenchmark_CacheDelays(size, active[0]);
+            times[1] = RunBenchmark_AtomicMemory(size, active[1]);
+            double *time_results = RunBenchmark_SequentialAndRandom(size, active[2], active[3]);
+            times[2] = time_results[0];
+            times[3] = time_results[1];
+            free(time_results);
+
+            for (int m = 0; m < number_of_modes; m++) {
+                if (Runner_done(&runners[m])) {
+                    continue;
+                }
+                Runner_add(&runners[m], times[m] * 1000000000.0);
+                if (runners[m].count == 0) {
+                    PerfCounters_reset(&counters[m]);  // still warming up
+                }
+            }
+        }
+
+        print_table_of_experiments(names, runners, number_of_modes, size);
+
+        char variant[32];
+        snprintf(variant, sizeof(variant), "size=%lld", (long long)size);
+        for (int m = 0; m < number_of_modes; m++) {
+            Runner_print(&runners[m], 1 / 1000000000.0, "s");
+            PerfCounters_print(&counters[m], names[m], size * runners[m].count, "element");
+
+            for (size_t k = 0; k < runners[m].count; k++) {
+                Results_sample(runners[m].samples[k] / 1000000000.0);
+            }
+            Results_record(modes[m], variant, "time", "s", true);
+            Runner_free(&runners[m]);
         }
-        cache_delays_result_time /=number_of_experiments;
-        atomic_memory_result_time /=number_of_experiments;
-        sequential_pointers_result_time /=number_of_experiments;
-        random_pointers_result_time /=number_of_experiments;
-        print_table_of_experiments(cache_delays_result_time, atomic_memory_result_time, sequential_pointers_result_time, random_pointers_result_time, SIZES[i], number_of_experiments);
     }
+
+    for (int m = 0; m < number_of_modes; m++) {
+        PerfCounters_close(&counters[m]);
+    }
+    PerfCounters_close(&finished);
+    Results_close();
     return 0;
-}
\ No newline at end of file
+}